@@ -48,6 +48,7 @@ struct capture_ {
 	unsigned int n_buffers;
 	int width;
 	int height;
+	int pitch;
 	unsigned int pixel_format;
 	UIOMux *uiomux;
 } sh_ceu;
@@ -471,6 +472,11 @@ static void init_device(capture * cap)
 	cap->width = fmt.fmt.pix.width;
 	cap->height = fmt.fmt.pix.height;
 
+	/* Lines may be padded. For NV12, the bytes per line is the pitch in pixels */
+	cap->pitch = fmt.fmt.pix.bytesperline;
+	if (cap->pitch < cap->width)
+		cap->pitch = cap->width;
+
 	switch (cap->io) {
 	case IO_METHOD_READ:
 		init_read(cap, fmt.fmt.pix.sizeimage);
@@ -574,6 +580,11 @@ int capture_get_height(capture * cap)
 	return cap->height;
 }
 
+int capture_get_pitch(capture * cap)
+{
+	return cap->pitch;
+}
+
 unsigned int capture_get_pixel_format(capture * cap)
 {
 	return cap->pixel_format;
@@ -48,6 +48,7 @@ void capture_queue_buffer(capture * cap, const void * buffer_data);
  */
 int capture_get_width(capture * cap);
 int capture_get_height(capture * cap);
+int capture_get_pitch(capture * cap);
 unsigned int capture_get_pixel_format(capture * cap);
 
 #endif				/* __CAPTURE_H__ */
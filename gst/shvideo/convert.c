@@ -0,0 +1,87 @@
+/**
+ * Software conversion of planar & packed YUV to NV12
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <shveu/shveu.h>
+
+#include "convert.h"
+
+void convert_planar_to_nv12(
+	const unsigned char *y, int y_pitch,
+	const unsigned char *u, const unsigned char *v, int uv_pitch,
+	const struct ren_vid_surface *dst)
+{
+	uint8_t *dy = dst->py;
+	uint8_t *dc = dst->pc;
+	int cw = dst->w / 2;
+	int line, x;
+
+	for (line = 0; line < dst->h; line++) {
+		memcpy(dy, y, dst->w);
+		dy += dst->pitch;
+		y += y_pitch;
+	}
+
+	/* Interleave the chroma, two UV pairs per 32-bit write when aligned */
+	for (line = 0; line < dst->h / 2; line++) {
+		uint32_t *d = (uint32_t *)dc;
+
+		x = 0;
+		if (((uintptr_t)dc & 3) == 0) {
+			for (; x + 1 < cw; x += 2) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+				*d++ = (u[x] << 24) | (v[x] << 16) | (u[x+1] << 8) | v[x+1];
+#else
+				*d++ = u[x] | (v[x] << 8) | (u[x+1] << 16) | (v[x+1] << 24);
+#endif
+			}
+		}
+		for (; x < cw; x++) {
+			dc[2*x] = u[x];
+			dc[2*x+1] = v[x];
+		}
+
+		dc += dst->pitch;
+		u += uv_pitch;
+		v += uv_pitch;
+	}
+}
+
+void convert_yuy2_to_nv12(
+	const unsigned char *src, int pitch,
+	const struct ren_vid_surface *dst)
+{
+	uint8_t *dy = dst->py;
+	uint8_t *dc = dst->pc;
+	const uint8_t *s0, *s1;
+	int line, x;
+
+	for (line = 0; line + 1 < dst->h; line += 2) {
+		s0 = src + line * pitch;
+		s1 = s0 + pitch;
+
+		/* Both lines of luma, and the average of their chroma */
+		for (x = 0; x < dst->w; x += 2) {
+			dy[x]               = s0[2*x];
+			dy[x+1]             = s0[2*x+2];
+			dy[dst->pitch+x]    = s1[2*x];
+			dy[dst->pitch+x+1]  = s1[2*x+2];
+			dc[x]   = (s0[2*x+1] + s1[2*x+1] + 1) >> 1;
+			dc[x+1] = (s0[2*x+3] + s1[2*x+3] + 1) >> 1;
+		}
+
+		dy += 2 * dst->pitch;
+		dc += dst->pitch;
+	}
+
+	/* The last line of an odd height has no chroma line of its own, like
+	   the planar formats */
+	if (line < dst->h) {
+		s0 = src + line * pitch;
+		for (x = 0; x < dst->w; x++)
+			dy[x] = s0[2*x];
+	}
+}
@@ -0,0 +1,38 @@
+/**
+ * Software conversion of planar & packed YUV to NV12
+ *
+ * The VEU only reads NV12, NV16 and RGB, so other YUV formats are converted
+ * in one pass straight into the (uiomux) destination surface.
+ */
+
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <shveu/shveu.h>
+
+/**
+ * Convert planar YUV 4:2:0 (I420 or YV12) to NV12
+ * \param y Luma plane
+ * \param y_pitch Luma plane pitch in bytes
+ * \param u Cb plane
+ * \param v Cr plane
+ * \param uv_pitch Cb & Cr plane pitch in bytes
+ * \param dst Output surface, NV12. The size of the frame is taken from here.
+ */
+void convert_planar_to_nv12(
+	const unsigned char *y, int y_pitch,
+	const unsigned char *u, const unsigned char *v, int uv_pitch,
+	const struct ren_vid_surface *dst);
+
+/**
+ * Convert packed YUV 4:2:2 (YUY2) to NV12. The chroma of each pair of lines
+ * is averaged. With an odd height, the chroma of the last line is dropped.
+ * \param src YUY2 data
+ * \param pitch Pitch in bytes
+ * \param dst Output surface, NV12. The size of the frame is taken from here.
+ */
+void convert_yuy2_to_nv12(
+	const unsigned char *src, int pitch,
+	const struct ren_vid_surface *dst);
+
+#endif
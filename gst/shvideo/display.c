@@ -16,6 +16,7 @@
 #include <shveu/shveu.h>
 
 #include "display.h"
+#include "veusched.h"
 
 #ifndef FBIO_WAITFORVSYNC
 #define FBIO_WAITFORVSYNC _IOW('F', 0x20, __u32)
@@ -40,7 +41,8 @@ struct DISPLAY {
 	int fullscreen;
 	struct ren_vid_rect dst_sel;
 
-	SHVEU *veu;
+	VEU_SERVICE *veu;
+	int veu_priority;
 };
 
 
@@ -53,11 +55,12 @@ DISPLAY *display_open(void)
 	if (!disp)
 		return NULL;
 
-	disp->veu = shveu_open_named("VEU");
+	disp->veu = veu_service_open();
 	if (!disp->veu) {
 		free(disp);
 		return NULL;
 	}
+	disp->veu_priority = VEU_PRIORITY_NORMAL;
 
 	/* Initialize display */
 	device = getenv("FRAMEBUFFER");
@@ -71,21 +74,25 @@ DISPLAY *display_open(void)
 
 	if ((disp->fb_handle = open(device, O_RDWR)) < 0) {
 		fprintf(stderr, "Open %s: %s.\n", device, strerror(errno));
+		veu_service_close(disp->veu);
 		free(disp);
 		return 0;
 	}
 	if (ioctl(disp->fb_handle, FBIOGET_FSCREENINFO, &disp->fb_fix) < 0) {
 		fprintf(stderr, "Ioctl FBIOGET_FSCREENINFO error.\n");
+		veu_service_close(disp->veu);
 		free(disp);
 		return 0;
 	}
 	if (ioctl(disp->fb_handle, FBIOGET_VSCREENINFO, &disp->fb_var) < 0) {
 		fprintf(stderr, "Ioctl FBIOGET_VSCREENINFO error.\n");
+		veu_service_close(disp->veu);
 		free(disp);
 		return 0;
 	}
 	if (disp->fb_fix.type != FB_TYPE_PACKED_PIXELS) {
 		fprintf(stderr, "Frame buffer isn't packed pixel.\n");
+		veu_service_close(disp->veu);
 		free(disp);
 		return 0;
 	}
@@ -124,7 +131,7 @@ void display_close(DISPLAY *disp)
 	ioctl(disp->fb_handle, FBIOPAN_DISPLAY, &disp->fb_var);
 
 	close(disp->fb_handle);
-	shveu_close(disp->veu);
+	veu_service_close(disp->veu);
 	free(disp);
 }
 
@@ -242,7 +249,7 @@ int display_update(
 	}
 
 	/* Hardware resize */
-	ret = shveu_resize(disp->veu, &src2, &dst);
+	ret = veu_service_resize(disp->veu, &src2, &dst, disp->veu_priority);
 
 	if (!ret)
 		display_flip(disp);
@@ -250,6 +257,11 @@ int display_update(
 	return ret;
 }
 
+void display_set_veu_priority(DISPLAY *disp, int priority)
+{
+	disp->veu_priority = priority;
+}
+
 void display_set_fullscreen(DISPLAY *disp)
 {
 	disp->fullscreen = 1;
@@ -61,6 +61,13 @@ int display_flip(DISPLAY *disp);
 
 /* The functions below are used to place an image on the display */
 
+/**
+ * Set the priority of the display's jobs on the shared VEU
+ * \param disp Handle returned from display_open
+ * \param priority VEU_PRIORITY_LOW, VEU_PRIORITY_NORMAL or VEU_PRIORITY_HIGH
+ */
+void display_set_veu_priority(DISPLAY *disp, int priority);
+
 /**
  * Position the output fullscreen (but observe aspect ratio)
  * \param disp Handle returned from display_open
@@ -108,3 +108,6 @@
 #define DEFAULT_OUT_VUI_PARAMETERS 0
 #define DEFAULT_CHROMA_QP_INDEX_OFFSET 0
 #define DEFAULT_CONSTRAINED_INTRA_PRED 0
+/* Pull mode */
+#define DEFAULT_PREFETCH_FRAMES 2
+#define DEFAULT_REPEAT_HEADERS FALSE
@@ -36,6 +36,7 @@
 #include "ControlFileUtil.h"
 #include "capture.h"
 #include "display.h"
+#include "veusched.h"
 
 #define CHROMA_ALIGNMENT 16
 
@@ -81,6 +82,7 @@ struct _GstSHV4L2Src {
 
 	int cap_w;
 	int cap_h;
+	int cap_pitch;
 	GstSHV4L2SrcPreview preview;
 
 	/* This is used to stop the plugin sending data downstream when PAUSED */
@@ -187,6 +189,7 @@ static void capture_image_cb(capture * ceu, const unsigned char *frame_data, siz
 
 	GstBuffer *buf = gst_buffer_new();
 	gst_buffer_set_data(buf, (unsigned char*)frame_data, length);
+	gst_buffer_set_caps(buf, GST_PAD_CAPS(shv4l2src->srcpad));
 
 	GST_BUFFER_OFFSET(buf) = shv4l2src->offset++;
 	GST_BUFFER_OFFSET_END(buf) = shv4l2src->offset;
@@ -204,9 +207,9 @@ static void capture_image_cb(capture * ceu, const unsigned char *frame_data, siz
 		frame_surface.format = REN_NV12;
 		frame_surface.w = shv4l2src->cap_w;
 		frame_surface.h = shv4l2src->cap_h;
-		frame_surface.pitch = frame_surface.w;
+		frame_surface.pitch = shv4l2src->cap_pitch;
 		frame_surface.py = (void*)frame_data;
-		frame_surface.pc = frame_surface.py + (frame_surface.w * frame_surface.h);
+		frame_surface.pc = frame_surface.py + (frame_surface.pitch * frame_surface.h);
 		frame_surface.pa = NULL;
 
 		display_update(shv4l2src->display, &frame_surface);
@@ -579,6 +582,9 @@ static void *shv4l2src_thread(void *data)
 		if (!shv4l2src->display) {
 			GST_ELEMENT_ERROR((GstElement *) shv4l2src, CORE, FAILED,
 					  ("Error opening fb device"), (NULL));
+		} else {
+			/* The preview must not hold up scaling downstream */
+			display_set_veu_priority(shv4l2src->display, VEU_PRIORITY_LOW);
 		}
 	}
 
@@ -591,6 +597,7 @@ static void *shv4l2src_thread(void *data)
 	}
 	shv4l2src->cap_w = capture_get_width(shv4l2src->ceu);
 	shv4l2src->cap_h = capture_get_height(shv4l2src->ceu);
+	shv4l2src->cap_pitch = capture_get_pitch(shv4l2src->ceu);
 
 	if ((shv4l2src->cap_w != shv4l2src->width)
 	    || (shv4l2src->cap_h != shv4l2src->height)) {
@@ -605,12 +612,24 @@ static void *shv4l2src_thread(void *data)
 
 	/* Check for frame size that result in v4l2 capture buffers with the CbCr
 	   plane located at an unsupported memory alignment. */
-	if ((shv4l2src->width * shv4l2src->height) & (CHROMA_ALIGNMENT-1)) {
+	if ((shv4l2src->cap_pitch * shv4l2src->height) & (CHROMA_ALIGNMENT-1)) {
 		GST_ELEMENT_ERROR((GstElement *) shv4l2src, CORE, FAILED,
 				  ("unsupported encode size due to Chroma plane alignment"), (NULL));
 	}
 
-	GST_DEBUG_OBJECT(shv4l2src, "Capturing at %dx%d", shv4l2src->cap_w, shv4l2src->cap_h);
+	/* Describe padded lines in the caps, rather than repacking every frame */
+	if (shv4l2src->cap_pitch != shv4l2src->cap_w && GST_PAD_CAPS(shv4l2src->srcpad)) {
+		GstCaps *caps = gst_caps_copy(GST_PAD_CAPS(shv4l2src->srcpad));
+		gst_caps_set_simple(caps, "pitch", G_TYPE_INT, shv4l2src->cap_pitch, NULL);
+		if (!gst_pad_set_caps(shv4l2src->srcpad, caps)) {
+			GST_ELEMENT_ERROR((GstElement *) shv4l2src, CORE, NEGOTIATION,
+					  ("Downstream does not accept padded frames"), (NULL));
+		}
+		gst_caps_unref(caps);
+	}
+
+	GST_DEBUG_OBJECT(shv4l2src, "Capturing at %dx%d, pitch %d",
+			 shv4l2src->cap_w, shv4l2src->cap_h, shv4l2src->cap_pitch);
 
 	capture_start_capturing(shv4l2src->ceu);
 
@@ -22,9 +22,35 @@
 #include <shveu/shveu.h>
 
 #include "gstshvideobuffer.h"
+#include "rotate.h"
 
 static GstBufferClass *parent_class;
 
+struct _GstSHVideoBufferPool
+{
+	GMutex *lock;
+	gint refcount;
+	gboolean running;
+
+	UIOMux *uiomux;
+	gint width;
+	gint height;
+	int format;
+
+	/* Released buffers, ready to be reused */
+	GSList *free;
+};
+
+static void
+gst_sh_video_buffer_pool_unref (GstSHVideoBufferPool *pool)
+{
+	if (!g_atomic_int_dec_and_test (&pool->refcount))
+		return;
+
+	g_mutex_free (pool->lock);
+	g_free (pool);
+}
+
 /**
  * Initialize the buffer
  * \param shbuffer GstSHVideoBuffer object
@@ -35,6 +61,9 @@ gst_sh_video_buffer_init (GstSHVideoBuffer *shbuffer, gpointer g_class)
 {
 	/* Mark the buffer as not allocated by us */
 	shbuffer->allocated = 0;
+	shbuffer->pool = NULL;
+	shbuffer->pitch = 0;
+	shbuffer->c_offset = 0;
 }
 
 /**
@@ -46,14 +75,18 @@ gst_sh_video_buffer_init (GstSHVideoBuffer *shbuffer, gpointer g_class)
 GstBuffer *gst_sh_video_buffer_new(UIOMux *uiomux, gint width, gint height, int fmt)
 {
 	GstSHVideoBuffer *buf;
+	gint c_offset;
 	gint size;
 
 	// TODO the size calc should really take into account that the chroma plane needs to
 	// be 32-byte aligned. We should also cover min width/height requirements of all IP
 	// so that the buffer can be used with all HW.
-	// This also means that the buffer can't be used by non-SH elements.
+	// This also means that the buffer can't be used by non-SH elements, unless
+	// the layout is described in the caps ("pitch" & "chroma-offset").
 
-	size = size_y(fmt, width * height) + size_c(fmt, width * height);
+	/* Packed, as the caps of our outputs describe */
+	c_offset = size_y(fmt, width * height);
+	size = gst_sh_video_layout_get_size(fmt, height, width, c_offset);
 
 	buf = (GstSHVideoBuffer*)gst_mini_object_new(GST_TYPE_SH_VIDEO_BUFFER);
 	g_return_val_if_fail(buf != NULL, NULL);
@@ -72,6 +105,8 @@ GstBuffer *gst_sh_video_buffer_new(UIOMux *uiomux, gint width, gint height, int
 	buf->allocated_size = size;
 	buf->uiomux = uiomux;
 	buf->format = fmt;
+	buf->pitch = width;
+	buf->c_offset = c_offset;
 
 	return GST_BUFFER(buf);
 }
@@ -84,6 +119,23 @@ GstBuffer *gst_sh_video_buffer_new(UIOMux *uiomux, gint width, gint height, int
 static void
 gst_sh_video_buffer_finalize (GstSHVideoBuffer *shbuffer)
 {
+	GstSHVideoBufferPool *pool = shbuffer->pool;
+
+	if (pool) {
+		g_mutex_lock (pool->lock);
+		if (pool->running) {
+			/* Take the buffer back, rather than freeing it */
+			gst_buffer_ref (GST_BUFFER (shbuffer));
+			pool->free = g_slist_prepend (pool->free, shbuffer);
+			g_mutex_unlock (pool->lock);
+			return;
+		}
+		g_mutex_unlock (pool->lock);
+
+		shbuffer->pool = NULL;
+		gst_sh_video_buffer_pool_unref (pool);
+	}
+
 	if (shbuffer->allocated && shbuffer->uiomux) {
 		/* Free the buffer */
 		uiomux_free (shbuffer->uiomux, UIOMUX_SH_VEU,
@@ -140,6 +192,88 @@ gst_sh_video_buffer_get_type (void)
 	return gst_sh_video_buffer_type;
 }
 
+GstSHVideoBufferPool *
+gst_sh_video_buffer_pool_new(UIOMux *uiomux, gint width, gint height, int fmt)
+{
+	GstSHVideoBufferPool *pool;
+
+	pool = g_new0 (GstSHVideoBufferPool, 1);
+	pool->lock = g_mutex_new ();
+	pool->refcount = 1;
+	pool->running = TRUE;
+	pool->uiomux = uiomux;
+	pool->width = width;
+	pool->height = height;
+	pool->format = fmt;
+
+	return pool;
+}
+
+void
+gst_sh_video_buffer_pool_free(GstSHVideoBufferPool *pool)
+{
+	GSList *free;
+	GSList *walk;
+
+	if (!pool)
+		return;
+
+	g_mutex_lock (pool->lock);
+	pool->running = FALSE;
+	free = pool->free;
+	pool->free = NULL;
+	g_mutex_unlock (pool->lock);
+
+	/* Not running, so these are freed rather than taken back */
+	for (walk = free; walk; walk = g_slist_next (walk))
+		gst_buffer_unref (GST_BUFFER (walk->data));
+	g_slist_free (free);
+
+	gst_sh_video_buffer_pool_unref (pool);
+}
+
+GstBuffer *
+gst_sh_video_buffer_pool_get(GstSHVideoBufferPool *pool)
+{
+	GstSHVideoBuffer *shbuffer = NULL;
+	GstBuffer *buf;
+
+	g_mutex_lock (pool->lock);
+	if (pool->free) {
+		shbuffer = pool->free->data;
+		pool->free = g_slist_delete_link (pool->free, pool->free);
+	}
+	g_mutex_unlock (pool->lock);
+
+	if (shbuffer) {
+		/* Clear what the last user left on the buffer */
+		buf = GST_BUFFER (shbuffer);
+		GST_BUFFER_SIZE (buf) = shbuffer->allocated_size;
+		GST_BUFFER_FLAGS (buf) = 0;
+		GST_BUFFER_TIMESTAMP (buf) = GST_CLOCK_TIME_NONE;
+		GST_BUFFER_DURATION (buf) = GST_CLOCK_TIME_NONE;
+		GST_BUFFER_OFFSET (buf) = GST_BUFFER_OFFSET_NONE;
+		GST_BUFFER_OFFSET_END (buf) = GST_BUFFER_OFFSET_NONE;
+		gst_buffer_set_caps (buf, NULL);
+		return buf;
+	}
+
+	buf = gst_sh_video_buffer_new (pool->uiomux, pool->width, pool->height, pool->format);
+	if (!buf)
+		return NULL;
+
+	g_atomic_int_inc (&pool->refcount);
+	GST_SH_VIDEO_BUFFER (buf)->pool = pool;
+
+	return buf;
+}
+
+gboolean
+gst_sh_video_buffer_pool_matches(GstSHVideoBufferPool *pool, gint width, gint height, int fmt)
+{
+	return (pool->width == width && pool->height == height && pool->format == fmt);
+}
+
 
 /***************************** Helper functions *****************************/
 
@@ -216,6 +350,8 @@ gboolean gst_caps_to_renesas_format (GstCaps *caps, ren_vid_format_t *ren_fmt)
 			*ren_fmt = REN_RGB565;
 		else if (format == GST_VIDEO_FORMAT_RGBx)
 			*ren_fmt = REN_RGB32;
+		else if (format == GST_VIDEO_FORMAT_ARGB)
+			*ren_fmt = REN_ARGB32;
 		else if (format == GST_VIDEO_FORMAT_NV12)
 			*ren_fmt = REN_NV12;
 		else if (format == GST_VIDEO_FORMAT_NV16)
@@ -230,6 +366,118 @@ gboolean gst_caps_to_renesas_format (GstCaps *caps, ren_vid_format_t *ren_fmt)
 	return TRUE;
 }
 
+gboolean gst_sh_video_format_parse_crop (GstCaps *caps, struct ren_vid_rect *crop)
+{
+	GstStructure *structure;
+	gint left = 0;
+	gint right = 0;
+	gint top = 0;
+	gint bottom = 0;
+
+	crop->x = 0;
+	crop->y = 0;
+	crop->w = 0;
+	crop->h = 0;
+
+	structure = gst_caps_get_structure(caps, 0);
+	if (!structure)
+		return FALSE;
+
+	gst_structure_get_int(structure, "width", &crop->w);
+	gst_structure_get_int(structure, "height", &crop->h);
+
+	gst_structure_get_int(structure, "crop-left", &left);
+	gst_structure_get_int(structure, "crop-right", &right);
+	gst_structure_get_int(structure, "crop-top", &top);
+	gst_structure_get_int(structure, "crop-bottom", &bottom);
+
+	if ((left + right) >= crop->w || (top + bottom) >= crop->h) {
+		GST_WARNING("crop (%d,%d,%d,%d) larger than the frame, ignored",
+			left, right, top, bottom);
+		return FALSE;
+	}
+
+	crop->x = left;
+	crop->y = top;
+	crop->w -= left + right;
+	crop->h -= top + bottom;
+
+	return (left || right || top || bottom);
+}
+
+gboolean gst_sh_video_format_parse_layout (GstCaps *caps, gint *pitch, gint *c_offset)
+{
+	GstStructure *structure;
+	GstVideoFormat format;
+	gint width = 0;
+	gint height = 0;
+	gboolean padded = FALSE;
+
+	*pitch = 0;
+	*c_offset = 0;
+
+	structure = gst_caps_get_structure(caps, 0);
+	if (!structure
+	    || !gst_sh_video_format_parse_caps(caps, &format, &width, &height))
+		return FALSE;
+
+	if (gst_structure_get_int(structure, "pitch", pitch) && *pitch != width) {
+		if (*pitch < width) {
+			GST_WARNING("pitch (%d) less than the width (%d), ignored", *pitch, width);
+			*pitch = width;
+		} else {
+			padded = TRUE;
+		}
+	} else {
+		*pitch = width;
+	}
+
+	if (gst_structure_get_int(structure, "chroma-offset", c_offset)) {
+		if (*c_offset < size_y(get_renesas_format(format), *pitch * height)) {
+			GST_WARNING("chroma-offset (%d) inside the luma plane, ignored", *c_offset);
+			*c_offset = 0;
+		} else {
+			padded = TRUE;
+		}
+	}
+	if (!*c_offset)
+		*c_offset = size_y(get_renesas_format(format), *pitch * height);
+
+	return padded;
+}
+
+gint gst_sh_video_layout_get_size (ren_vid_format_t ren_format, gint height, gint pitch, gint c_offset)
+{
+	if (size_c(ren_format, pitch * height))
+		return c_offset + size_c(ren_format, pitch * height);
+
+	return size_y(ren_format, pitch * height);
+}
+
+void gst_sh_video_buffer_get_surface (GstBuffer *buf, ren_vid_format_t ren_format,
+	gint width, gint height, gint pitch, gint c_offset,
+	struct ren_vid_surface *surface)
+{
+	if (GST_IS_SH_VIDEO_BUFFER(buf) && GST_SH_VIDEO_BUFFER(buf)->pitch) {
+		pitch = GST_SH_VIDEO_BUFFER(buf)->pitch;
+		c_offset = GST_SH_VIDEO_BUFFER(buf)->c_offset;
+	}
+	if (!pitch)
+		pitch = width;
+	if (!c_offset)
+		c_offset = size_y(ren_format, pitch * height);
+
+	surface->format = ren_format;
+	surface->w = width;
+	surface->h = height;
+	surface->pitch = pitch;
+	surface->py = GST_BUFFER_DATA(buf);
+	surface->pc = NULL;
+	if (size_c(ren_format, pitch * height))
+		surface->pc = (unsigned char *)surface->py + c_offset;
+	surface->pa = NULL;
+}
+
 int get_renesas_format (GstVideoFormat format)
 {
 	int ren_fmt = 0;
@@ -238,6 +486,8 @@ int get_renesas_format (GstVideoFormat format)
 		ren_fmt = REN_RGB565;
 	else if (format == GST_VIDEO_FORMAT_RGBx)
 		ren_fmt = REN_RGB32;
+	else if (format == GST_VIDEO_FORMAT_ARGB)
+		ren_fmt = REN_ARGB32;
 	else if (format == GST_VIDEO_FORMAT_NV12)
 		ren_fmt = REN_NV12;
 	else if (format == GST_VIDEO_FORMAT_NV16)
@@ -246,6 +496,41 @@ int get_renesas_format (GstVideoFormat format)
 	return ren_fmt;
 }
 
+GType
+gst_sh_video_rotation_get_type (void)
+{
+	static GType object_type = 0;
+	static const GEnumValue rotation[] = {
+		{ROTATE_0, "No rotation", "0"},
+		{ROTATE_90, "Rotate 90 degrees clockwise", "90"},
+		{ROTATE_180, "Rotate 180 degrees", "180"},
+		{ROTATE_270, "Rotate 270 degrees clockwise", "270"},
+		{0, NULL, NULL},
+	};
+
+	if (object_type == 0) {
+		object_type = g_enum_register_static ("GstSHVideoRotation", rotation);
+	}
+	return object_type;
+}
+
+GType
+gst_sh_video_flip_get_type (void)
+{
+	static GType object_type = 0;
+	static const GEnumValue flip[] = {
+		{FLIP_NONE, "No flip", "none"},
+		{FLIP_HORIZONTAL, "Flip horizontally", "horizontal"},
+		{FLIP_VERTICAL, "Flip vertically", "vertical"},
+		{0, NULL, NULL},
+	};
+
+	if (object_type == 0) {
+		object_type = g_enum_register_static ("GstSHVideoFlip", flip);
+	}
+	return object_type;
+}
+
 void *get_c_addr (void *y, ren_vid_format_t ren_format, int width, int height)
 {
 	if (size_c(ren_format, width*height)) {
@@ -37,6 +37,7 @@
 
 typedef struct _GstSHVideoBuffer GstSHVideoBuffer;
 typedef struct _GstSHVideoBufferClass GstSHVideoBufferClass;
+typedef struct _GstSHVideoBufferPool GstSHVideoBufferPool;
 
 /**
  * \struct _GstSHVideoBuffer
@@ -51,6 +52,14 @@ struct _GstSHVideoBuffer
 	int format;
 	int allocated;
 	gint allocated_size;
+
+	/* Pool the buffer goes back to when it is released, if any */
+	GstSHVideoBufferPool *pool;
+
+	/* Layout of the planes, 0 if not known. The pitch is in pixels, the
+	   chroma offset in bytes from the start of the buffer */
+	gint pitch;
+	gint c_offset;
 };
 
 /**
@@ -69,10 +78,45 @@ struct _GstSHVideoBufferClass
 GType gst_sh_video_buffer_get_type (void);
 
 /**
- * Allocate a buffer that can be directly accessed by the SH hardware
+ * Allocate a buffer that can be directly accessed by the SH hardware. The
+ * frame is packed: the chroma plane directly follows the luma plane, so the
+ * buffer is exactly the size the caps describe.
  */
 GstBuffer *gst_sh_video_buffer_new(UIOMux *uiomux, gint width, gint height, int fmt);
 
+/**
+ * Create a pool of buffers of one size & format. Released buffers go back to
+ * the pool rather than being freed, so they can be reused without another
+ * allocation.
+ * \param uiomux UIOMux handle to allocate the buffers with
+ * \param width Width of frame
+ * \param height Height of frame
+ * \param fmt Video format
+ */
+GstSHVideoBufferPool *gst_sh_video_buffer_pool_new(UIOMux *uiomux, gint width, gint height, int fmt);
+
+/**
+ * Destroy a pool. Buffers that are still in use are freed when released.
+ * \param pool Pool returned from gst_sh_video_buffer_pool_new
+ */
+void gst_sh_video_buffer_pool_free(GstSHVideoBufferPool *pool);
+
+/**
+ * Get a buffer from the pool, allocating one if none are free
+ * \param pool Pool returned from gst_sh_video_buffer_pool_new
+ * \return The buffer, or NULL if allocation failed
+ */
+GstBuffer *gst_sh_video_buffer_pool_get(GstSHVideoBufferPool *pool);
+
+/**
+ * Check if the pool holds buffers of a size & format
+ * \param pool Pool returned from gst_sh_video_buffer_pool_new
+ * \param width Width of frame
+ * \param height Height of frame
+ * \param fmt Video format
+ */
+gboolean gst_sh_video_buffer_pool_matches(GstSHVideoBufferPool *pool, gint width, gint height, int fmt);
+
 
 /***************************** Helper functions *****************************/
 
@@ -100,8 +144,38 @@ gboolean gst_sh_video_format_parse_caps (
 
 gboolean gst_caps_to_renesas_format (GstCaps *caps, ren_vid_format_t *ren_format);
 
+/* Get the visible area of the frame described by the caps. The caps width &
+ * height describe the frame in memory, optional crop-left/right/top/bottom
+ * fields describe the padding around the picture. Returns TRUE if the caps
+ * describe a cropped frame */
+gboolean gst_sh_video_format_parse_crop (GstCaps *caps, struct ren_vid_rect *crop);
+
+/* Get the layout of the planes described by the caps. The optional pitch (in
+ * pixels) & chroma-offset (in bytes from the start of the frame) fields
+ * describe padded frames, without them the planes are packed. Returns TRUE if
+ * the caps describe a padded frame */
+gboolean gst_sh_video_format_parse_layout (GstCaps *caps, gint *pitch, gint *c_offset);
+
+/* Size of a frame with the given layout */
+gint gst_sh_video_layout_get_size (ren_vid_format_t ren_format, gint height, gint pitch, gint c_offset);
+
+/* Describe the frame held in a buffer. The layout carried by a
+ * GstSHVideoBuffer takes precedence over the pitch & chroma offset passed in,
+ * which normally come from the caps. A pitch or chroma offset of 0 means the
+ * planes are packed */
+void gst_sh_video_buffer_get_surface (GstBuffer *buf, ren_vid_format_t ren_format,
+	gint width, gint height, gint pitch, gint c_offset,
+	struct ren_vid_surface *surface);
+
 int get_renesas_format (GstVideoFormat format);
 
+/* Enum types for the rotation & flip properties, using the values in rotate.h */
+#define GST_TYPE_SH_VIDEO_ROTATION (gst_sh_video_rotation_get_type())
+GType gst_sh_video_rotation_get_type (void);
+
+#define GST_TYPE_SH_VIDEO_FLIP (gst_sh_video_flip_get_type())
+GType gst_sh_video_flip_get_type (void);
+
 void *get_c_addr (void *y, ren_vid_format_t ren_format, int width, int height);
 
 #endif //GSTSHVIDEOBUFFER_H
@@ -33,6 +33,7 @@
 #include "capture.h"
 #include "display.h"
 #include "thrqueue.h"
+#include "veusched.h"
 
 #define CHROMA_ALIGNMENT 16
 
@@ -76,11 +77,12 @@ struct _GstSHVideoCapEnc {
 	struct Queue * enc_input_empty_q;
 
 	UIOMux *uiomux;
-	SHVEU *veu;
+	VEU_SERVICE *veu;
 	DISPLAY *display;
 
 	int cap_w;
 	int cap_h;
+	int cap_pitch;
 	GstCameraPreview preview;
 
 	/* This is used to stop the plugin sending data downstream when PAUSED */
@@ -200,7 +202,7 @@ capture_image_cb(capture * ceu, const unsigned char *frame_data, size_t length,
 	cap_surface.format = REN_NV12;
 	cap_surface.w = pvt->cap_w;
 	cap_surface.h = pvt->cap_h;
-	cap_surface.pitch = cap_surface.w;
+	cap_surface.pitch = pvt->cap_pitch;
 	cap_surface.py = (void*)frame_data;
 	cap_surface.pc = cap_surface.py + (cap_surface.pitch * cap_surface.h);
 	cap_surface.pa = NULL;
@@ -217,8 +219,8 @@ capture_image_cb(capture * ceu, const unsigned char *frame_data, size_t length,
 
 	GST_DEBUG_OBJECT(pvt, "Starting blit to encoder input buffer...");
 
-	/* Hardware resize */
-	shveu_resize(pvt->veu, &cap_surface, &enc_surface);
+	/* Hardware resize, ahead of any preview or other scaling */
+	veu_service_resize(pvt->veu, &cap_surface, &enc_surface, VEU_PRIORITY_HIGH);
 
 	GST_DEBUG_OBJECT(pvt, "Blit to encoder input buffer complete");
 
@@ -322,7 +324,7 @@ gst_sh_video_enc_dispose(GObject * object)
 		display_close(enc->display);
 	}
 
-	shveu_close(enc->veu);
+	veu_service_close(enc->veu);
 	capture_close(enc->ceu);
 	uiomux_close(enc->uiomux);
 
@@ -647,7 +649,7 @@ static void *launch_camera_encoder_thread(void *data)
 	}
 
 	/* VEU initialization */
-	enc->veu = shveu_open_named("VEU");
+	enc->veu = veu_service_open();
 	if (enc->veu == NULL) {
 		GST_ELEMENT_ERROR((GstElement *) enc, CORE, FAILED,
 				  ("Error opening VEU"), (NULL));
@@ -659,6 +661,9 @@ static void *launch_camera_encoder_thread(void *data)
 		if (!enc->display) {
 			GST_ELEMENT_ERROR((GstElement *) enc, CORE, FAILED,
 					  ("Error opening fb device"), (NULL));
+		} else {
+			/* The preview must not hold up the encoder input */
+			display_set_veu_priority(enc->display, VEU_PRIORITY_LOW);
 		}
 	}
 
@@ -671,6 +676,7 @@ static void *launch_camera_encoder_thread(void *data)
 	}
 	enc->cap_w = capture_get_width(enc->ceu);
 	enc->cap_h = capture_get_height(enc->ceu);
+	enc->cap_pitch = capture_get_pitch(enc->ceu);
 
 	if (capture_get_pixel_format (enc->ceu) != V4L2_PIX_FMT_NV12) {
 		GST_ELEMENT_ERROR((GstElement *) enc, CORE, FAILED,
@@ -69,6 +69,33 @@
  * the buffers. Again, the static caps are needed to pass information to the
  * decoder.
  *
+ * \subsection dec-example-4 Buffering a bursty network stream
+ *
+ * \code
+ * gst-launch \
+ *  udpsrc port=5000 caps="application/x-rtp,clock-rate=90000" \
+ *  ! gstrtpjitterbuffer ! rtph264depay \
+ *  ! "video/x-h264, width=640, height=480, framerate=30/1" \
+ *  ! gst-sh-mobile-dec min-buffer-time=500000000 max-buffer-time=2000000000 \
+ *  ! gst-sh-mobile-sink
+ * \endcode
+ * The decoder holds back half a second of compressed video before it starts
+ * decoding, and decodes ahead whenever more than two seconds are buffered.
+ * While filling the buffer the decoder posts buffering messages on the bus,
+ * which an application can use to pause playback or switch bitrate.
+ *
+ * \section dec-cropping Cropping
+ * The decoder outputs frames with the width and height rounded up to whole
+ * macroblocks, e.g. 1920x1088 for a 1920x1080 stream. Instead of copying the
+ * picture out of each frame, the src caps describe the coded frame and carry
+ * crop-right & crop-bottom fields for the padding. gst-sh-mobile-sink and
+ * gst-sh-mobile-resize honour these fields, so cropping costs nothing.
+ *
+ * The chroma plane of a decoded frame does not have to follow the luma plane.
+ * When there is a gap, the src caps carry a chroma-offset field and the
+ * buffers describe their own layout, so the frames are passed on without a
+ * copy.
+ *
  * \section dec-properties Properties
  * \copydoc gstshvideodecproperties
  *
@@ -179,6 +206,33 @@ static GstStaticPadTemplate dec_src_factory =
 		);
 
 
+/**
+ * \enum gstshvideodecproperties
+ * gst-sh-mobile-dec has following properties:
+ * - "min-buffer-time" (uint64). Amount of compressed stream, in nanoseconds,
+ *   to buffer before decoding starts. Default: 0 (no buffering)
+ * - "max-buffer-time" (uint64). When more than this amount of compressed
+ *   stream, in nanoseconds, is buffered, the decoder decodes ahead until the
+ *   buffer level drops below it. Default: 0 (no limit)
+ *   Both buffer times need a known framerate, as the decoded stream time is
+ *   counted in frames. With a framerate of 0/1 they are ignored.
+ * - "vpu-priority" (int). Priority of the decoder's jobs when the VPU is
+ *   shared with other encoders & decoders. Default: 0
+ * - "vpu-utilisation" (double, read-only). Fraction of time the decoder
+ *   has used the VPU.
+ */
+enum gstshvideodecproperties
+{
+	PROP_0,
+	PROP_MIN_BUFFER_TIME,
+	PROP_MAX_BUFFER_TIME,
+	PROP_VPU_PRIORITY,
+	PROP_VPU_UTILISATION
+};
+
+#define DEFAULT_MIN_BUFFER_TIME 0
+#define DEFAULT_MAX_BUFFER_TIME 0
+
 static GstElementClass *parent_class = NULL;
 
 GST_DEBUG_CATEGORY_STATIC (gst_sh_video_dec_debug);
@@ -218,6 +272,26 @@ static void gst_sh_video_dec_class_init (GstSHVideoDecClass * klass);
  */
 static void gst_sh_video_dec_init (GstSHVideoDec * dec, GstSHVideoDecClass * gklass);
 
+/**
+ * The function will set the properties of the decoder
+ * @param object The object where to get Gstreamer SH video decoder object
+ * @param prop_id The property id
+ * @param value The value of the property
+ * @param pspec not used in function
+ */
+static void gst_sh_video_dec_set_property (GObject * object, guint prop_id,
+					   const GValue * value, GParamSpec * pspec);
+
+/**
+ * The function will return the wanted property of the decoder
+ * @param object The object where to get Gstreamer SH video decoder object
+ * @param prop_id The property id
+ * @param value The value of the property
+ * @param pspec not used in function
+ */
+static void gst_sh_video_dec_get_property (GObject * object, guint prop_id,
+					   GValue * value, GParamSpec * pspec);
+
 /**
  * Event handler for decoder sink events
  * @param pad Gstreamer sink pad
@@ -257,6 +331,49 @@ static gint gst_shcodecs_decoded_callback (SHCodecs_Decoder * decoder,
 					  guchar * c_buf, gint c_size,
 					  void * user_data);
 
+/**
+ * Describe the coded frame size & crop in the src caps
+ * @param dec Gstreamer SH video element
+ * @param y_size Size of the decoded luma plane
+ * @return returns true if the caps were set, else false
+ */
+static gboolean gst_sh_video_dec_set_coded_caps (GstSHVideoDec * dec, gint y_size);
+
+/**
+ * Describe the offset of the chroma plane in the src caps
+ * @param dec Gstreamer SH video element
+ * @param c_offset Offset of the chroma plane from the start of the frame
+ * @return returns true if the caps were set, else false
+ */
+static gboolean gst_sh_video_dec_set_chroma_offset (GstSHVideoDec * dec, gint c_offset);
+
+/**
+ * Decode the next frame from the buffered data
+ * @param dec Gstreamer SH video element
+ * @return returns GST_FLOW_OK if decoding was successful, else GST_FLOW_ERROR
+ */
+static GstFlowReturn gst_sh_video_dec_decode (GstSHVideoDec * dec);
+
+/**
+ * Hand the frames decoded by the last shcodecs call to the push thread
+ * @param dec Gstreamer SH video element
+ */
+static void gst_sh_video_dec_push_decoded (GstSHVideoDec * dec);
+
+/**
+ * Get the amount of buffered, not yet decoded stream
+ * @param dec Gstreamer SH video element
+ * @return The buffered stream time
+ */
+static GstClockTime gst_sh_video_dec_buffer_level (GstSHVideoDec * dec);
+
+/**
+ * Post a buffering message on the bus if the level has changed
+ * @param dec Gstreamer SH video element
+ * @param percent Buffering level in percent
+ */
+static void gst_sh_video_dec_post_buffering (GstSHVideoDec * dec, gint percent);
+
 /** Push a decoded buffer function
 * \var param data decoder object
 */
@@ -325,6 +442,10 @@ gst_sh_video_dec_dispose (GObject * object)
 
 	if (dec->decoder != NULL)
 		shcodecs_decoder_close (dec->decoder);
+	if (dec->vpu) {
+		vpu_client_close (dec->vpu);
+		dec->vpu = NULL;
+	}
 	if (dec->buffer)
 		gst_buffer_unref(dec->buffer);
 
@@ -335,6 +456,13 @@ gst_sh_video_dec_dispose (GObject * object)
 		pthread_join(dec->push_thread, NULL);
 	}
 
+	if (dec->decoded) {
+		while (!g_queue_is_empty(dec->decoded))
+			gst_buffer_unref(g_queue_pop_head(dec->decoded));
+		g_queue_free(dec->decoded);
+		dec->decoded = NULL;
+	}
+
 	G_OBJECT_CLASS (parent_class)->dispose (object);
 }
 
@@ -351,6 +479,32 @@ gst_sh_video_dec_class_init (GstSHVideoDecClass * klass)
 				 0, "Decoder for H264/MPEG4 streams");
 
 	gobject_class->dispose = gst_sh_video_dec_dispose;
+	gobject_class->set_property = gst_sh_video_dec_set_property;
+	gobject_class->get_property = gst_sh_video_dec_get_property;
+
+	g_object_class_install_property (gobject_class, PROP_MIN_BUFFER_TIME,
+		g_param_spec_uint64 ("min-buffer-time", "Minimum buffer time",
+			"Stream time (ns) to buffer before decoding starts",
+			0, G_MAXUINT64, DEFAULT_MIN_BUFFER_TIME,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_MAX_BUFFER_TIME,
+		g_param_spec_uint64 ("max-buffer-time", "Maximum buffer time",
+			"Stream time (ns) above which buffered data is decoded ahead (0 = no limit)",
+			0, G_MAXUINT64, DEFAULT_MAX_BUFFER_TIME,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_VPU_PRIORITY,
+		g_param_spec_int ("vpu-priority", "VPU priority",
+			"Priority of the decoder's jobs on the shared VPU",
+			VPU_PRIORITY_LOW, VPU_PRIORITY_HIGH, VPU_PRIORITY_NORMAL,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_VPU_UTILISATION,
+		g_param_spec_double ("vpu-utilisation", "VPU utilisation",
+			"Fraction of time the decoder has used the VPU",
+			0.0, 1.0, 0.0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -374,12 +528,97 @@ gst_sh_video_dec_init (GstSHVideoDec * dec, GstSHVideoDecClass * gklass)
 	dec->codec_data_present = FALSE;
 	dec->codec_data_present_first = TRUE;
 	dec->push_buf = NULL;
+	dec->decoded = g_queue_new();
 	dec->end = FALSE;
+	dec->coded_width = 0;
+	dec->coded_height = 0;
+	dec->c_offset = 0;
+
+	dec->min_buffer_time = DEFAULT_MIN_BUFFER_TIME;
+	dec->max_buffer_time = DEFAULT_MAX_BUFFER_TIME;
+	dec->buffering = TRUE;
+	dec->buffering_percent = -1;
+	dec->in_ts_first = GST_CLOCK_TIME_NONE;
+	dec->in_time_base = 0;
+	dec->in_time = 0;
+
+	dec->vpu = NULL;
+	dec->vpu_priority = VPU_PRIORITY_NORMAL;
 
 	sem_init(&dec->dec_sem, 0, 1);
 	sem_init(&dec->push_sem, 0, 0);
 }
 
+static void
+gst_sh_video_dec_set_property (GObject * object, guint prop_id,
+			       const GValue * value, GParamSpec * pspec)
+{
+	GstSHVideoDec *dec = GST_SH_VIDEO_DEC (object);
+
+	switch (prop_id)
+	{
+		case PROP_MIN_BUFFER_TIME:
+		{
+			dec->min_buffer_time = g_value_get_uint64 (value);
+			break;
+		}
+		case PROP_MAX_BUFFER_TIME:
+		{
+			dec->max_buffer_time = g_value_get_uint64 (value);
+			break;
+		}
+		case PROP_VPU_PRIORITY:
+		{
+			dec->vpu_priority = g_value_get_int (value);
+			if (dec->vpu)
+				vpu_client_set_priority (dec->vpu, dec->vpu_priority);
+			break;
+		}
+		default:
+		{
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+		}
+	}
+}
+
+static void
+gst_sh_video_dec_get_property (GObject * object, guint prop_id,
+			       GValue * value, GParamSpec * pspec)
+{
+	GstSHVideoDec *dec = GST_SH_VIDEO_DEC (object);
+
+	switch (prop_id)
+	{
+		case PROP_MIN_BUFFER_TIME:
+		{
+			g_value_set_uint64 (value, dec->min_buffer_time);
+			break;
+		}
+		case PROP_MAX_BUFFER_TIME:
+		{
+			g_value_set_uint64 (value, dec->max_buffer_time);
+			break;
+		}
+		case PROP_VPU_PRIORITY:
+		{
+			g_value_set_int (value, dec->vpu_priority);
+			break;
+		}
+		case PROP_VPU_UTILISATION:
+		{
+			g_value_set_double (value,
+				dec->vpu ? vpu_client_get_utilisation (dec->vpu) : 0.0);
+			break;
+		}
+		default:
+		{
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+		}
+	}
+}
+
 static gboolean
 gst_sh_video_dec_sink_event (GstPad * pad, GstEvent * event)
 {
@@ -392,13 +631,40 @@ gst_sh_video_dec_sink_event (GstPad * pad, GstEvent * event)
 		GST_DEBUG_OBJECT (dec, "EOS gst event");
 
 		if (dec->decoder) {
+			/* Decode whatever is still buffered */
+			while (dec->buffer) {
+				guint remaining = GST_BUFFER_SIZE(dec->buffer);
+
+				if (gst_sh_video_dec_decode(dec) != GST_FLOW_OK)
+					break;
+				if (dec->buffer && GST_BUFFER_SIZE(dec->buffer) == remaining)
+					break;
+			}
+			if (dec->buffering) {
+				dec->buffering = FALSE;
+				gst_sh_video_dec_post_buffering(dec, 100);
+			}
+
 			GST_DEBUG_OBJECT(dec,"We are done, calling finalize.");
 			shcodecs_decoder_finalize(dec->decoder);
+			gst_sh_video_dec_push_decoded(dec);
 			GST_DEBUG_OBJECT(dec,
 					 "Stream finalized. Total decoded %d frames.",
 					 shcodecs_decoder_get_frame_count(dec->decoder));
 		}
 	}
+	else if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP)
+	{
+		/* Drop the buffered data and start filling the buffer again */
+		if (dec->buffer) {
+			gst_buffer_unref(dec->buffer);
+			dec->buffer = NULL;
+		}
+		dec->in_ts_first = GST_CLOCK_TIME_NONE;
+		dec->in_time_base = dec->in_time - gst_sh_video_dec_buffer_level(dec);
+		dec->in_time = dec->in_time_base;
+		dec->buffering = TRUE;
+	}
 	return gst_pad_push_event(dec->srcpad,event);
 }
 
@@ -513,6 +779,9 @@ gst_sh_video_dec_setcaps (GstPad * pad, GstCaps * sink_caps)
 	{
 		GST_INFO_OBJECT(dec,"Framerate: %d/%d",dec->fps_numerator,
 				dec->fps_denominator);
+		if (dec->fps_numerator == 0
+		    && (dec->min_buffer_time > 0 || dec->max_buffer_time > 0))
+			GST_WARNING_OBJECT(dec, "Unknown framerate, buffering is disabled");
 	} else {
 		GST_INFO_OBJECT(dec,"Failed (no framerate)");
 		return FALSE;
@@ -537,6 +806,9 @@ gst_sh_video_dec_setcaps (GstPad * pad, GstCaps * sink_caps)
 		return FALSE;
 	}
 
+	if (!dec->vpu)
+		dec->vpu = vpu_client_open(GST_ELEMENT_NAME(dec), dec->vpu_priority);
+
 	/* Set frame by frame as it is natural for GStreamer data flow */
 	shcodecs_decoder_set_frame_by_frame(dec->decoder,1);
 
@@ -575,6 +847,10 @@ gst_sh_video_dec_chain (GstPad * pad, GstBuffer * inbuffer)
 	GstFlowReturn ret = GST_FLOW_OK;
 	gint used_bytes;
 	GstBuffer* buffer = inbuffer;
+	GstClockTime duration;
+	GstClockTime level;
+	GstClockTime min_buffer_time;
+	GstClockTime max_buffer_time;
 
 	if (!dec->push_thread) {
 		pthread_create( &dec->push_thread, NULL, gst_sh_video_dec_pad_push, dec);
@@ -629,22 +905,111 @@ gst_sh_video_dec_chain (GstPad * pad, GstBuffer * inbuffer)
 		GST_TIME_AS_MSECONDS(GST_BUFFER_TIMESTAMP (buffer)),
 		GST_TIME_AS_MSECONDS(GST_BUFFER_DURATION (buffer)));
 
+	/* Keep track of the stream time we have received */
+	duration = GST_BUFFER_DURATION(buffer);
+	if (!GST_CLOCK_TIME_IS_VALID(duration) && dec->fps_numerator > 0)
+		duration = gst_util_uint64_scale_int(GST_SECOND,
+				dec->fps_denominator, dec->fps_numerator);
+	if (!GST_CLOCK_TIME_IS_VALID(duration))
+		duration = 0;
+
+	if (GST_BUFFER_TIMESTAMP_IS_VALID(buffer)) {
+		if (!GST_CLOCK_TIME_IS_VALID(dec->in_ts_first))
+			dec->in_ts_first = GST_BUFFER_TIMESTAMP(buffer);
+		if (GST_BUFFER_TIMESTAMP(buffer) >= dec->in_ts_first)
+			dec->in_time = dec->in_time_base + duration
+				+ GST_BUFFER_TIMESTAMP(buffer) - dec->in_ts_first;
+	} else {
+		dec->in_time += duration;
+	}
+
 	/* Buffering */
 	if (dec->buffer) {
 		buffer = gst_buffer_join(dec->buffer,buffer);
 		GST_LOG_OBJECT(dec,"Added to unused data, now got %d bytes", GST_BUFFER_SIZE(buffer));
 	}
 
+	dec->buffer = buffer;
+
+	/* The decoded stream time is counted in frames, so without a framerate
+	   the level can't be measured and buffering is off */
+	min_buffer_time = dec->fps_numerator > 0 ? dec->min_buffer_time : 0;
+	max_buffer_time = dec->fps_numerator > 0 ? dec->max_buffer_time : 0;
+
+	level = gst_sh_video_dec_buffer_level(dec);
+
+	if (dec->buffering) {
+		if (level < min_buffer_time) {
+			GST_LOG_OBJECT(dec, "Buffering, %" GST_TIME_FORMAT " of %"
+				GST_TIME_FORMAT, GST_TIME_ARGS(level),
+				GST_TIME_ARGS(min_buffer_time));
+			gst_sh_video_dec_post_buffering(dec,
+				(gint) gst_util_uint64_scale(level, 100, min_buffer_time));
+			return GST_FLOW_OK;
+		}
+
+		GST_DEBUG_OBJECT(dec, "Buffered %" GST_TIME_FORMAT ", start decoding",
+			GST_TIME_ARGS(level));
+		dec->buffering = FALSE;
+		if (min_buffer_time > 0)
+			gst_sh_video_dec_post_buffering(dec, 100);
+	}
+
+	ret = gst_sh_video_dec_decode(dec);
+
+	/* Decode ahead while there is too much buffered */
+	while (ret == GST_FLOW_OK && dec->buffer && max_buffer_time > 0
+	       && gst_sh_video_dec_buffer_level(dec) > max_buffer_time) {
+		guint remaining = GST_BUFFER_SIZE(dec->buffer);
+
+		GST_LOG_OBJECT(dec, "Over max-buffer-time, decoding ahead");
+		ret = gst_sh_video_dec_decode(dec);
+
+		if (dec->buffer && GST_BUFFER_SIZE(dec->buffer) == remaining)
+			break;
+	}
+
+	/* Ran dry, fill the buffer again before continuing */
+	if (ret == GST_FLOW_OK && !dec->buffer && min_buffer_time > 0) {
+		GST_DEBUG_OBJECT(dec, "Buffer underrun, rebuffering");
+		dec->buffering = TRUE;
+		gst_sh_video_dec_post_buffering(dec, 0);
+	}
+
+	return ret;
+}
+
+static GstFlowReturn
+gst_sh_video_dec_decode (GstSHVideoDec * dec)
+{
+	GstBuffer *buffer = dec->buffer;
+	gint used_bytes;
+
+	if (!buffer)
+		return GST_FLOW_OK;
+
 	dec->buffer = NULL;
 
+	/* Wait for our turn on the VPU, aiming to finish within a frame */
+	if (dec->vpu)
+		vpu_acquire(dec->vpu, dec->fps_numerator > 0 ?
+			1000000 * dec->fps_denominator / dec->fps_numerator : 0);
+
 	used_bytes = shcodecs_decode(dec->decoder,
 			GST_BUFFER_DATA (buffer),
 			GST_BUFFER_SIZE (buffer));
 
+	/* Only push the frames once the decoder is done with the VPU, so a
+	   blocked sink can't hold it up */
+	if (dec->vpu)
+		vpu_release(dec->vpu);
+	gst_sh_video_dec_push_decoded(dec);
+
 	GST_DEBUG_OBJECT(dec, "decoder used %d bytes", used_bytes);
 	if (used_bytes < 0) {
 		GST_ELEMENT_ERROR((GstElement *) dec, CORE, FAILED,
 				  ("Decode error"), ("Failed (Error on shcodecs_decode)"));
+		gst_buffer_unref(buffer);
 		return GST_FLOW_ERROR;
 	}
 
@@ -658,8 +1023,102 @@ gst_sh_video_dec_chain (GstPad * pad, GstBuffer * inbuffer)
 	}
 
 	gst_buffer_unref(buffer);
+	return GST_FLOW_OK;
+}
+
+static GstClockTime
+gst_sh_video_dec_buffer_level (GstSHVideoDec * dec)
+{
+	GstClockTime decoded = 0;
+
+	if (dec->decoder && dec->fps_numerator > 0)
+		decoded = gst_util_uint64_scale_int(
+				shcodecs_decoder_get_frame_count(dec->decoder) * GST_SECOND,
+				dec->fps_denominator, dec->fps_numerator);
+
+	if (dec->in_time <= decoded)
+		return 0;
+
+	return dec->in_time - decoded;
+}
+
+static void
+gst_sh_video_dec_post_buffering (GstSHVideoDec * dec, gint percent)
+{
+	if (percent > 100)
+		percent = 100;
+
+	if (percent == dec->buffering_percent)
+		return;
+
+	dec->buffering_percent = percent;
+	gst_element_post_message (GST_ELEMENT (dec),
+		gst_message_new_buffering (GST_OBJECT (dec), percent));
+}
+
+static gboolean
+gst_sh_video_dec_set_coded_caps (GstSHVideoDec * dec, gint y_size)
+{
+	GstCaps *caps;
+	gint coded_width, coded_height;
+	gboolean ret;
+
+	dec->coded_width = dec->width;
+	dec->coded_height = dec->height;
+
+	if (y_size == dec->width * dec->height)
+		return TRUE;
+
+	/* The decoder works on whole macroblocks. libshcodecs does not give us
+	   the SPS frame cropping, so the picture is assumed to be top-left */
+	coded_width = GST_ROUND_UP_16(dec->width);
+	coded_height = y_size / coded_width;
+
+	if ((coded_width * coded_height != y_size) || (coded_height < dec->height)) {
+		GST_WARNING_OBJECT(dec, "Unexpected decoded frame size (%d bytes)", y_size);
+		return FALSE;
+	}
+
+	GST_INFO_OBJECT(dec, "Coded frame %dx%d, cropped to %dx%d",
+			coded_width, coded_height, dec->width, dec->height);
+
+	dec->coded_width = coded_width;
+	dec->coded_height = coded_height;
+
+	caps = gst_caps_copy(GST_PAD_CAPS(dec->srcpad));
+	gst_caps_set_simple(caps,
+		"width",       G_TYPE_INT, coded_width,
+		"height",      G_TYPE_INT, coded_height,
+		"crop-right",  G_TYPE_INT, coded_width - dec->width,
+		"crop-bottom", G_TYPE_INT, coded_height - dec->height,
+		NULL);
+
+	ret = gst_pad_set_caps(dec->srcpad, caps);
+	gst_caps_unref(caps);
+
 	return ret;
+}
+
+static gboolean
+gst_sh_video_dec_set_chroma_offset (GstSHVideoDec * dec, gint c_offset)
+{
+	GstCaps *caps;
+	gboolean ret;
+
+	GST_INFO_OBJECT(dec, "Chroma plane at offset %d", c_offset);
+
+	dec->c_offset = c_offset;
 
+	caps = gst_caps_copy(GST_PAD_CAPS(dec->srcpad));
+	if (c_offset == dec->coded_width * dec->coded_height)
+		gst_structure_remove_field(gst_caps_get_structure(caps, 0), "chroma-offset");
+	else
+		gst_caps_set_simple(caps, "chroma-offset", G_TYPE_INT, c_offset, NULL);
+
+	ret = gst_pad_set_caps(dec->srcpad, caps);
+	gst_caps_unref(caps);
+
+	return ret;
 }
 
 static gint
@@ -670,38 +1129,68 @@ gst_shcodecs_decoded_callback (SHCodecs_Decoder * decoder,
 {
 	GstSHVideoDec *dec = (GstSHVideoDec *) user_data;
 	gint offset = shcodecs_decoder_get_frame_count(dec->decoder);
+	gint c_offset;
+	GstBuffer *buf;
 
-	/* We require the chroma plane of the video decoder output frame to follow the luma
-	   plane - without this, it is not possible for standard GStreamer elements
-	   to use the buffers */
-	if (c_buf != (y_buf + y_size)) {
+	/* The chroma plane may be after a gap, which is described in the caps,
+	   but can't overlap the luma plane */
+	if (c_buf < (y_buf + y_size)) {
 		GST_ELEMENT_ERROR((GstElement *) dec, CORE, FAILED,
-				  ("Decode error"), ("Decoded frame chroma plane does not follow luma plane!"));
+				  ("Decode error"), ("Decoded frame chroma plane overlaps luma plane!"));
+		return -1;
+	}
+	c_offset = c_buf - y_buf;
+
+	if (!dec->coded_width && !gst_sh_video_dec_set_coded_caps(dec, y_size)) {
+		GST_ELEMENT_ERROR((GstElement *) dec, CORE, NEGOTIATION,
+				  ("Decode error"), ("Failed to set caps for the coded frame size"));
+		return -1;
+	}
+
+	if (c_offset != dec->c_offset
+	    && (dec->c_offset || c_offset != y_size)
+	    && !gst_sh_video_dec_set_chroma_offset(dec, c_offset)) {
+		GST_ELEMENT_ERROR((GstElement *) dec, CORE, NEGOTIATION,
+				  ("Decode error"), ("Failed to set caps for the chroma offset"));
 		return -1;
 	}
+	dec->c_offset = c_offset;
 
-	sem_wait(&dec->dec_sem);
 	GST_LOG_OBJECT(dec,"Frame decoded");
 
 	/* Wrap the video decoder output buffer in a GST buffer */
-	dec->push_buf = (GstBuffer *) gst_mini_object_new (GST_TYPE_SH_VIDEO_BUFFER);
-	GST_BUFFER_MALLOCDATA(dec->push_buf) = NULL;
-	GST_BUFFER_DATA(dec->push_buf) = y_buf;
-	GST_BUFFER_SIZE(dec->push_buf) = y_size + c_size;
+	buf = (GstBuffer *) gst_mini_object_new (GST_TYPE_SH_VIDEO_BUFFER);
+	GST_BUFFER_MALLOCDATA(buf) = NULL;
+	GST_BUFFER_DATA(buf) = y_buf;
+	GST_BUFFER_SIZE(buf) = c_offset + c_size;
+	GST_SH_VIDEO_BUFFER(buf)->pitch = dec->coded_width;
+	GST_SH_VIDEO_BUFFER(buf)->c_offset = c_offset;
+
+	GST_BUFFER_OFFSET(buf) = offset;
+	GST_BUFFER_CAPS(buf) = gst_caps_copy(GST_PAD_CAPS(dec->srcpad));
+	GST_BUFFER_DURATION(buf) = GST_SECOND * dec->fps_denominator / dec->fps_numerator;
+	GST_BUFFER_TIMESTAMP(buf) = offset * GST_BUFFER_DURATION(buf);
+	GST_BUFFER_OFFSET_END(buf) = offset;
+
+	/* The decoder may still be using the VPU, push once it returns */
+	g_queue_push_tail(dec->decoded, buf);
 
-	GST_BUFFER_OFFSET(dec->push_buf) = offset;
-	GST_BUFFER_CAPS(dec->push_buf) = gst_caps_copy(GST_PAD_CAPS(dec->srcpad));
-	GST_BUFFER_DURATION(dec->push_buf) = GST_SECOND * dec->fps_denominator / dec->fps_numerator;
-	GST_BUFFER_TIMESTAMP(dec->push_buf) = offset * GST_BUFFER_DURATION(dec->push_buf);
-	GST_BUFFER_OFFSET_END(dec->push_buf) = offset;
+	return 0; /* continue decoding */
+}
 
-	GST_LOG_OBJECT (dec, "Pushing frame number: %d time: %" GST_TIME_FORMAT,
-			offset,
-			GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (dec->push_buf)));
+static void
+gst_sh_video_dec_push_decoded (GstSHVideoDec * dec)
+{
+	while (!g_queue_is_empty(dec->decoded)) {
+		sem_wait(&dec->dec_sem);
 
-	sem_post(&dec->push_sem);
+		dec->push_buf = g_queue_pop_head(dec->decoded);
+		GST_LOG_OBJECT (dec, "Pushing frame number: %" G_GUINT64_FORMAT " time: %" GST_TIME_FORMAT,
+				GST_BUFFER_OFFSET (dec->push_buf),
+				GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (dec->push_buf)));
 
-	return 0; /* continue decoding */
+		sem_post(&dec->push_sem);
+	}
 }
 
 static void *
@@ -28,6 +28,8 @@
 #include <gst/gstelement.h>
 #include <semaphore.h>
 
+#include "vpusched.h"
+
 G_BEGIN_DECLS
 #define GST_TYPE_SH_VIDEO_DEC \
 	(gst_sh_video_dec_get_type())
@@ -52,6 +54,9 @@ typedef struct _GstSHVideoDecClass GstSHVideoDecClass;
  * \var format Stream type. Possible values: 0(none), 1(MPEG4) and 2 (H264)
  * \var width Width of the video
  * \var height Height of the video
+ * \var coded_width Width of the decoded frames, 0 until the first frame
+ * \var coded_height Height of the decoded frames, 0 until the first frame
+ * \var c_offset Offset of the chroma plane in the decoded frames, 0 until the first frame
  * \var fps_numerator Numerator of the framerate fraction
  * \var fps_denominator Denominator of the framerate fraction
  * \var decoder pointer to the SHCodecs decoder object
@@ -59,9 +64,19 @@ typedef struct _GstSHVideoDecClass GstSHVideoDecClass;
  * \var running A flag indicating that the decoding thread should be running
  * \var buffer Pointer to the cache buffer
  * \var push_buf Pointer to src buffer
+ * \var decoded Frames decoded by the current shcodecs call, pushed once it returns
  * \var push_thread Src thread for push buffer
  * \var dec_sem for the Src function
  * \var push_sem for the Src function
+ * \var min_buffer_time Stream time to buffer before decoding starts
+ * \var max_buffer_time Stream time above which buffered data is decoded
+ * \var buffering A flag indicating that the decoder is (re)filling its buffer
+ * \var buffering_percent Last buffering level posted on the bus
+ * \var in_ts_first Timestamp of the first input buffer after a flush
+ * \var in_time_base Stream time decoded before the last flush
+ * \var in_time Stream time received by the decoder
+ * \var vpu Handle for the VPU scheduler
+ * \var vpu_priority Priority of the decoder's VPU jobs
  */
 struct _GstSHVideoDec
 {
@@ -73,6 +88,9 @@ struct _GstSHVideoDec
 	SHCodecs_Format format;
 	gint width;
 	gint height;
+	gint coded_width;
+	gint coded_height;
+	gint c_offset;
 	gint fps_numerator;
 	gint fps_denominator;
 	SHCodecs_Decoder * decoder;
@@ -82,12 +100,24 @@ struct _GstSHVideoDec
 
 	GstBuffer* buffer;
 	GstBuffer* push_buf;
+	GQueue *decoded;
 
 	pthread_t push_thread;
 
 	sem_t dec_sem;
 	sem_t push_sem;
 
+	guint64 min_buffer_time;
+	guint64 max_buffer_time;
+	gboolean buffering;
+	gint buffering_percent;
+	GstClockTime in_ts_first;
+	GstClockTime in_time_base;
+	GstClockTime in_time;
+
+	VPU_CLIENT *vpu;
+	gint vpu_priority;
+
 	gboolean codec_data_present;
 	gboolean codec_data_present_first;
 	guint num_sps;
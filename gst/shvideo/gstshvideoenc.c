@@ -23,6 +23,17 @@
  * stream is length prefixed (1), otherwise its startcode delimited (where the SPS and
  * PPS are in the stream and not in codec-data).
  *
+ * With B-VOPs (b-vop-num) frames are output in coding order. Each buffer has
+ * the presentation timestamp of the frame, and the decode timestamp in
+ * GST_BUFFER_OFFSET_END. The decode timestamp is the input timestamp of the
+ * frame in coding order, and the presentation timestamp is moved later by the
+ * B-VOP delay, so both keep increasing from the first frame. The latency
+ * query includes the frames held back.
+ *
+ * The encoder reads NV12. I420, YV12 and YUY2 input is also accepted, and is
+ * converted into the encoder's input frame by the element, so a separate
+ * ffmpegcolorspace element isn't needed.
+ *
  * \section enc-examples Example launch lines
  * \subsection enc-examples-1 Encoding from a file to a file
  * \code
@@ -103,11 +114,13 @@
 #include <string.h>
 
 #include <gst/gst.h>
+#include <gst/video/video.h>
 
 #include "gstshvideoenc.h"
 #include "gstshencdefaults.h"
 #include "gstshvideobuffer.h"
 #include "ControlFileUtil.h"
+#include "convert.h"
 
 /**
  * \var enc_sink_factory
@@ -115,8 +128,8 @@
  * Direction: sink \n
  * Available: always \n
  * Caps:
- * - video/x-raw-yuv, format=(fourcc)NV12, width=(int)[48, 1280],
- *   height=(int)[48, 720], framerate=(fraction)[1, 30]
+ * - video/x-raw-yuv, format=(fourcc){NV12, I420, YV12, YUY2},
+ *   width=(int)[48, 1280], height=(int)[48, 720], framerate=(fraction)[1, 30]
  */
 static GstStaticPadTemplate enc_sink_factory =
 	GST_STATIC_PAD_TEMPLATE("sink",
@@ -124,7 +137,7 @@ static GstStaticPadTemplate enc_sink_factory =
 		GST_PAD_ALWAYS,
 		GST_STATIC_CAPS(
 			"video/x-raw-yuv, "
-			"format = (fourcc) NV12,"
+			"format = (fourcc) { NV12, I420, YV12, YUY2 },"
 			"width = (int) [48, 1280],"
 			"height = (int) [48, 720],"
 			"framerate = (fraction) [0, 30]"
@@ -198,6 +211,19 @@ static GstElementClass *parent_class = NULL;
  *    Default: 0.
  * - "weighted-q-mode" (long). Used to specify whether weighted quantization for
  *   encoding is used or not (0/1). Default: 0.
+ * - "vpu-priority" (int). Priority of the encoder's jobs when the VPU is
+ *   shared with other encoders & decoders. Default: 0
+ * - "vpu-utilisation" (double, read-only). Fraction of time the encoder has
+ *   used the VPU.
+ * - "prefetch-frames" (int). Number of frames read ahead of the encoder in
+ *   pull mode, so that reading the input overlaps encoding. 0 reads each frame
+ *   when it is encoded. Default: 2
+ * - "zero-copy-frames" (guint64, read-only). Number of input frames read by
+ *   the encoder straight from the upstream buffer.
+ * - "copied-frames" (guint64, read-only). Number of input frames that had to
+ *   be copied or converted into uiomux memory first.
+ * - "repeat-headers" (boolean). Put the H.264 SPS & PPS in front of every IDR
+ *   frame, so that receivers can join mid-stream. Default: FALSE
  */
 enum gst_sh_video_enc_properties
 {
@@ -305,6 +331,16 @@ enum gst_sh_video_enc_properties
 	PROP_OUT_VUI_PARAMETERS,
 	PROP_CHROMA_QP_INDEX_OFFSET,
 	PROP_CONSTRAINED_INTRA_PRED,
+	/* VPU scheduling */
+	PROP_VPU_PRIORITY,
+	PROP_VPU_UTILISATION,
+	/* Pull mode */
+	PROP_PREFETCH_FRAMES,
+	/* Input statistics */
+	PROP_ZERO_COPY_FRAMES,
+	PROP_COPIED_FRAMES,
+	/* H.264 */
+	PROP_REPEAT_HEADERS,
 	PROP_LAST
 };
 
@@ -324,6 +360,7 @@ static gboolean	gst_sh_video_enc_activate(GstPad *pad);
 static gboolean	gst_sh_video_enc_activate_pull(GstPad *pad, gboolean active);
 static GstFlowReturn gst_sh_video_enc_chain(GstPad *pad, GstBuffer *buffer);
 static void gst_sh_video_enc_loop(GstSHVideoEnc *enc);
+static void gst_sh_video_enc_stop_reader(GstSHVideoEnc *enc);
 static void gst_sh_video_enc_set_property(GObject *object, guint prop_id,
 					const GValue *value, GParamSpec * pspec);
 static void gst_sh_video_enc_get_property(GObject * object, guint prop_id,
@@ -342,12 +379,16 @@ gst_sh_video_enc_change_state(GstElement *element, GstStateChange transition);
 static GstFlowReturn
 gst_sh_video_enc_sink_buffer_alloc (GstPad *pad, guint64 offset, guint size,
 	GstCaps * caps, GstBuffer ** buf);
+static gboolean gst_sh_video_enc_read_headers(GstSHVideoEnc *enc);
+static void gst_sh_video_enc_free_headers(GstSHVideoEnc *enc);
 static GstBuffer *gst_sh_video_enc_header_buf(GstSHVideoEnc *enc);
 static void gst_sh_video_enc_init_encoder(GstSHVideoEnc * enc);
 static void gst_sh_video_enc_read_sink_caps(GstSHVideoEnc * enc);
 static void gst_sh_video_enc_read_src_caps(GstSHVideoEnc * enc);
 static gboolean gst_sh_video_enc_set_src_caps(GstSHVideoEnc * enc);
 static gboolean gst_sh_video_enc_set_encoding_properties(GstSHVideoEnc *enc);
+static void gst_sh_video_enc_vpu_acquire(GstSHVideoEnc *enc);
+static GstFlowReturn gst_sh_video_enc_push_encoded(GstSHVideoEnc *enc);
 
 
 /**
@@ -411,6 +452,17 @@ gst_sh_video_enc_base_init(gpointer klass)
 	gst_element_class_set_details(element_class, &plugin_details);
 }
 
+/**
+ * Drop the input buffers held for the encoder
+ * @param enc Gstreamer SH video encoder
+ */
+static void
+gst_sh_video_enc_release_inputs(GstSHVideoEnc *enc)
+{
+	while (!g_queue_is_empty(enc->in_use))
+		gst_buffer_unref(g_queue_pop_head(enc->in_use));
+}
+
 /**
  * finalizes the encoder
  * @param object Gstreamer element class
@@ -425,13 +477,35 @@ gst_sh_video_enc_finalize(GObject * object)
 		enc->encoder = NULL;
 	}
 
+	/* Anything still holding uiomux memory has to go before the uiomux */
+	gst_sh_video_enc_stop_reader(enc);
+	g_queue_free(enc->prefetched);
+	g_cond_free(enc->prefetch_cond);
+	g_mutex_free(enc->prefetch_lock);
+
+	gst_sh_video_enc_release_inputs(enc);
+	g_queue_free(enc->in_use);
+	enc->in_use = NULL;
+
+	gst_sh_video_buffer_pool_free(enc->input_pool);
+	enc->input_pool = NULL;
+
 	if (enc->uiomux) {
 		uiomux_close(enc->uiomux);
 		enc->uiomux = NULL;
 	}
 
-	g_queue_free (enc->delay);
-	enc->delay = NULL;
+	if (enc->vpu) {
+		vpu_client_close(enc->vpu);
+		enc->vpu = NULL;
+	}
+
+	gst_sh_video_enc_free_headers(enc);
+
+	while (!g_queue_is_empty(enc->encoded))
+		gst_buffer_unref(g_queue_pop_head(enc->encoded));
+	g_queue_free(enc->encoded);
+	enc->encoded = NULL;
 
 	G_OBJECT_CLASS(parent_class)->finalize(object);
 }
@@ -1159,6 +1233,48 @@ gst_sh_video_enc_class_init(GstSHVideoEncClass * klass)
 			0, G_MAXULONG, DEFAULT_CONSTRAINED_INTRA_PRED,
 			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+	g_object_class_install_property(g_object_class, PROP_VPU_PRIORITY,
+		g_param_spec_int("vpu-priority",
+			"VPU priority",
+			"Priority of the encoder's jobs on the shared VPU",
+			VPU_PRIORITY_LOW, VPU_PRIORITY_HIGH, VPU_PRIORITY_NORMAL,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property(g_object_class, PROP_VPU_UTILISATION,
+		g_param_spec_double("vpu-utilisation",
+			"VPU utilisation",
+			"Fraction of time the encoder has used the VPU",
+			0.0, 1.0, 0.0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property(g_object_class, PROP_PREFETCH_FRAMES,
+		g_param_spec_int("prefetch-frames",
+			"Prefetch frames",
+			"Number of frames read ahead of the encoder in pull mode",
+			0, 16, DEFAULT_PREFETCH_FRAMES,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property(g_object_class, PROP_ZERO_COPY_FRAMES,
+		g_param_spec_uint64("zero-copy-frames",
+			"Zero copy frames",
+			"Number of input frames read straight from the upstream buffer",
+			0, G_MAXUINT64, 0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property(g_object_class, PROP_COPIED_FRAMES,
+		g_param_spec_uint64("copied-frames",
+			"Copied frames",
+			"Number of input frames copied into contiguous memory first",
+			0, G_MAXUINT64, 0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property(g_object_class, PROP_REPEAT_HEADERS,
+		g_param_spec_boolean("repeat-headers",
+			"Repeat headers",
+			"Put the H.264 SPS & PPS in front of every IDR frame",
+			DEFAULT_REPEAT_HEADERS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
 	gst_element_class->change_state = gst_sh_video_enc_change_state;
 }
 
@@ -1201,12 +1317,36 @@ gst_sh_video_enc_init(GstSHVideoEnc * enc,
 	enc->height = 0;
 	enc->fps_numerator = 0;
 	enc->fps_denominator = 0;
+	enc->fourcc = GST_MAKE_FOURCC('N', 'V', '1', '2');
+	enc->input_pool = NULL;
+	enc->prefetch_frames = DEFAULT_PREFETCH_FRAMES;
+	enc->reader = NULL;
+	enc->prefetch_lock = g_mutex_new();
+	enc->prefetch_cond = g_cond_new();
+	enc->prefetched = g_queue_new();
+	enc->reader_stop = FALSE;
+	enc->reader_ret = GST_FLOW_OK;
+	enc->in_use = g_queue_new();
+	enc->frames_zero_copy = 0;
+	enc->frames_copied = 0;
 	enc->frame_number = 0;
 	enc->stream_stopped = FALSE;
 	enc->eos = FALSE;
 	enc->buffered_output = NULL;
+	enc->encoded = g_queue_new();
+	enc->sps = NULL;
+	enc->pps = NULL;
+	enc->headers = NULL;
+	enc->repeat_headers = DEFAULT_REPEAT_HEADERS;
+	enc->headers_in_frame = FALSE;
+
+	enc->frames_in = 0;
+	enc->frames_out = 0;
+	enc->last_anchor = -1;
+	enc->next_b = 0;
 
-	enc->delay = g_queue_new ();
+	enc->vpu = NULL;
+	enc->vpu_priority = VPU_PRIORITY_NORMAL;
 
 	/* PROPERTIES */
 	/* common */
@@ -1842,6 +1982,23 @@ gst_sh_video_enc_set_property(GObject * object, guint prop_id,
 			enc->constrained_intra_pred = g_value_get_ulong(value);
 			break;
 		}
+		case PROP_VPU_PRIORITY:
+		{
+			enc->vpu_priority = g_value_get_int(value);
+			if (enc->vpu)
+				vpu_client_set_priority(enc->vpu, enc->vpu_priority);
+			break;
+		}
+		case PROP_PREFETCH_FRAMES:
+		{
+			enc->prefetch_frames = g_value_get_int(value);
+			break;
+		}
+		case PROP_REPEAT_HEADERS:
+		{
+			enc->repeat_headers = g_value_get_boolean(value);
+			break;
+		}
 		default:
 		{
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id,
@@ -2390,6 +2547,37 @@ gst_sh_video_enc_get_property(GObject * object, guint prop_id,
 			g_value_set_ulong(value, enc->constrained_intra_pred);
 			break;
 		}
+		case PROP_VPU_PRIORITY:
+		{
+			g_value_set_int(value, enc->vpu_priority);
+			break;
+		}
+		case PROP_VPU_UTILISATION:
+		{
+			g_value_set_double(value,
+				enc->vpu ? vpu_client_get_utilisation(enc->vpu) : 0.0);
+			break;
+		}
+		case PROP_PREFETCH_FRAMES:
+		{
+			g_value_set_int(value, enc->prefetch_frames);
+			break;
+		}
+		case PROP_ZERO_COPY_FRAMES:
+		{
+			g_value_set_uint64(value, enc->frames_zero_copy);
+			break;
+		}
+		case PROP_COPIED_FRAMES:
+		{
+			g_value_set_uint64(value, enc->frames_copied);
+			break;
+		}
+		case PROP_REPEAT_HEADERS:
+		{
+			g_value_set_boolean(value, enc->repeat_headers);
+			break;
+		}
 		default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 	}
@@ -2449,6 +2637,8 @@ gst_sh_video_enc_set_caps(GstPad * pad, GstCaps * caps)
 		return ret;
 	}
 
+	gst_structure_get_fourcc(structure, "format", &enc->fourcc);
+
 	gst_sh_video_enc_read_src_caps(enc);
 	gst_sh_video_enc_init_encoder(enc);
 
@@ -2491,6 +2681,7 @@ gst_sh_video_enc_read_sink_caps(GstSHVideoEnc * enc)
 										 &enc->fps_numerator,
 										 &enc->fps_denominator);
 		}
+		gst_structure_get_fourcc(structure, "format", &enc->fourcc);
 	}
 }
 
@@ -2634,6 +2825,9 @@ gst_sh_video_enc_init_encoder(GstSHVideoEnc * enc)
 			 enc->fps_numerator, enc->fps_denominator));
 	}
 
+	/* The headers of a previous encoder don't apply */
+	gst_sh_video_enc_free_headers(enc);
+
 	enc->encoder = shcodecs_encoder_init(enc->width, enc->height, enc->format);
 	if (!enc->encoder) {
 		GST_ELEMENT_ERROR((GstElement*)enc, CORE, FAILED,
@@ -2643,6 +2837,9 @@ gst_sh_video_enc_init_encoder(GstSHVideoEnc * enc)
 			 enc->fps_numerator, enc->fps_denominator));
 	}
 
+	if (!enc->vpu)
+		enc->vpu = vpu_client_open(GST_ELEMENT_NAME(enc), enc->vpu_priority);
+
 	shcodecs_encoder_set_frame_rate(enc->encoder,
 	 	(enc->fps_numerator / enc->fps_denominator) * 10);
 
@@ -2681,6 +2878,11 @@ gst_sh_video_enc_init_encoder(GstSHVideoEnc * enc)
 		}
 	}
 
+	/* The SPS & PPS depend on the properties, read them before the first
+	   frame so that the output callback never has to call the encoder */
+	if (enc->format == SHCodecs_Format_H264)
+		gst_sh_video_enc_read_headers(enc);
+
 	GST_DEBUG_OBJECT(enc, "Encoder init: %ldx%ld %ldfps format:%ld",
 			 shcodecs_encoder_get_xpic_size(enc->encoder),
 			 shcodecs_encoder_get_ypic_size(enc->encoder),
@@ -2739,6 +2941,8 @@ gst_sh_video_enc_change_state(GstElement *element, GstStateChange transition)
 		{
 			GST_DEBUG_OBJECT(enc, "Stopping encoding.");
 			enc->stream_stopped = TRUE;
+			/* Don't keep upstream's buffers until finalize */
+			gst_sh_video_enc_release_inputs(enc);
 			break;
 		}
 		default:
@@ -2771,11 +2975,14 @@ gst_sh_video_enc_sink_buffer_alloc (GstPad *pad, guint64 offset, guint size,
 
 	gst_structure_get_fourcc(structure, "format", &fourcc);
 	if (fourcc != GST_MAKE_FOURCC('N', 'V', '1', '2')) {
-		GST_ERROR("Requested format isn't NV12");
-		return GST_FLOW_ERROR;
+		/* Converted by the encoder, so normal memory is fine */
+		GST_LOG("Requested format isn't NV12, using a normal buffer");
+		*buf = NULL;
+		return GST_FLOW_OK;
 	}
 
-	if (size != (width * height * 3)/2) {
+	/* Padded frames are larger */
+	if (size < (width * height * 3)/2) {
 		GST_ERROR("Requested buffer size (%u) does not match encoder format", size);
 		return GST_FLOW_ERROR;
 	}
@@ -2790,7 +2997,8 @@ gst_sh_video_enc_sink_buffer_alloc (GstPad *pad, guint64 offset, guint size,
 		return GST_FLOW_ERROR;
 	}
 
-	gst_buffer_set_caps(outBuf, GST_PAD_CAPS(enc->srcpad));
+	/* This is an input buffer, so it has the input caps */
+	gst_buffer_set_caps(outBuf, caps);
 
 	*buf = outBuf;
 
@@ -2798,51 +3006,111 @@ gst_sh_video_enc_sink_buffer_alloc (GstPad *pad, guint64 offset, guint size,
 }
 
 /*
- * Returns: Buffer with the stream headers.
+ * Read the H.264 SPS & PPS from the encoder, once per encoder, and frame
+ * them for the output so they can be put in front of IDR frames as is.
+ * Not to be called from the encoder callbacks.
+ * Returns: TRUE if the headers are available.
  */
-static GstBuffer *
-gst_sh_video_enc_header_buf(GstSHVideoEnc *enc)
+static gboolean
+gst_sh_video_enc_read_headers(GstSHVideoEnc *enc)
 {
-	GstBuffer *buf;
+	GstBuffer *nals[2];
+	guint8 *data;
 	int header_return;
-	int i_size;
-	int nal_size;
-	guint8 *buffer, *sps;
-	gulong buffer_size;
-	gint sps_ni = 0, pps_ni = 1;
 	int nr_nals;
 	int *nal_sizes;
 	unsigned char **nal_data;
+	gint i;
 
-	if (G_UNLIKELY (enc->encoder == NULL))
-		return NULL;
+	if (enc->sps != NULL)
+		return TRUE;
 
-	/* Create avcC header. */
+	if (G_UNLIKELY (enc->encoder == NULL))
+		return FALSE;
 
 	header_return = shcodecs_encoder_get_h264_headers(enc->encoder, &nr_nals, &nal_sizes, &nal_data);
 	if (header_return < 0) {
 		GST_ELEMENT_ERROR (enc, STREAM, ENCODE, ("Encode h264 header failed."),
 				("shcodecs_encoder_get_h264_headers return code=%d", header_return));
-		return NULL;
+		return FALSE;
 	}
 
 	/* h264 is expected to return an SPS and PPS */
-	if (nr_nals != 2 || nal_sizes[sps_ni] < 4 || nal_sizes[pps_ni] < 1) {
+	if (nr_nals != 2 || nal_sizes[0] < 8 || nal_sizes[1] < 5) {
 		GST_ELEMENT_ERROR (enc, STREAM, ENCODE, (NULL), ("Unexpected h264 header."));
-		return NULL;
+		return FALSE;
+	}
+
+	GST_MEMDUMP ("SPS", nal_data[0], nal_sizes[0]);
+	GST_MEMDUMP ("PPS", nal_data[1], nal_sizes[1]);
+
+	/* nal's are encapsulated, and have a 4-byte start code */
+	for (i = 0; i < 2; i++) {
+		nals[i] = gst_buffer_new_and_alloc (nal_sizes[i] - 4);
+		memcpy (GST_BUFFER_DATA (nals[i]), nal_data[i] + 4, nal_sizes[i] - 4);
+	}
+	enc->sps = nals[0];
+	enc->pps = nals[1];
+
+	/* Both NALs as they appear in the output stream */
+	enc->headers = gst_buffer_new_and_alloc (
+		GST_BUFFER_SIZE (enc->sps) + GST_BUFFER_SIZE (enc->pps) + 8);
+	data = GST_BUFFER_DATA (enc->headers);
+	for (i = 0; i < 2; i++) {
+		if (enc->bytestream)
+			GST_WRITE_UINT32_BE (data, 1);
+		else
+			GST_WRITE_UINT32_BE (data, GST_BUFFER_SIZE (nals[i]));
+		memcpy (data + 4, GST_BUFFER_DATA (nals[i]), GST_BUFFER_SIZE (nals[i]));
+		data += GST_BUFFER_SIZE (nals[i]) + 4;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Drop the headers read from the encoder
+ */
+static void
+gst_sh_video_enc_free_headers(GstSHVideoEnc *enc)
+{
+	if (enc->sps) {
+		gst_buffer_unref (enc->sps);
+		enc->sps = NULL;
+	}
+	if (enc->pps) {
+		gst_buffer_unref (enc->pps);
+		enc->pps = NULL;
 	}
+	if (enc->headers) {
+		gst_buffer_unref (enc->headers);
+		enc->headers = NULL;
+	}
+}
+
+/*
+ * Returns: Buffer with the stream headers.
+ */
+static GstBuffer *
+gst_sh_video_enc_header_buf(GstSHVideoEnc *enc)
+{
+	GstBuffer *buf;
+	int i_size;
+	int nal_size;
+	guint8 *buffer, *sps;
+	gulong buffer_size;
 
-	GST_MEMDUMP ("SPS", nal_data[sps_ni], nal_sizes[sps_ni]);
-	GST_MEMDUMP ("PPS", nal_data[pps_ni], nal_sizes[pps_ni]);
+	/* Create avcC header. */
+
+	if (!gst_sh_video_enc_read_headers(enc))
+		return NULL;
 
 	/* nal payloads with emulation_prevention_three_byte, and some header data */
-	buffer_size = (nal_sizes[sps_ni] + nal_sizes[pps_ni]) * 4 + 100;
+	buffer_size = (GST_BUFFER_SIZE (enc->sps) + GST_BUFFER_SIZE (enc->pps)) * 4 + 100;
 	buffer = g_malloc (buffer_size);
 
-	/* nal's are encapsulated, and have 4-byte size prefix */
-	sps = nal_data[sps_ni] + 4;
 	/* skip NAL unit type */
-	sps++;
+	sps = GST_BUFFER_DATA (enc->sps) + 1;
 
 	buffer[0] = 1;                /* AVC Decoder Configuration Record ver. 1 */
 	buffer[1] = sps[0];           /* profile_idc                             */
@@ -2854,15 +3122,15 @@ gst_sh_video_enc_header_buf(GstSHVideoEnc *enc)
 
 	buffer[i_size++] = 0xe0 | 1;	/* number of SPSs */
 
-	nal_size = nal_sizes[sps_ni] - 4;
-	memcpy (buffer + i_size + 2, nal_data[sps_ni] + 4, nal_size);
+	nal_size = GST_BUFFER_SIZE (enc->sps);
+	memcpy (buffer + i_size + 2, GST_BUFFER_DATA (enc->sps), nal_size);
 	GST_WRITE_UINT16_BE (buffer + i_size, nal_size);
 	i_size += nal_size + 2;
 
 	buffer[i_size++] = 1;	/* number of PPSs */
 
-	nal_size = nal_sizes[pps_ni] - 4;
-	memcpy (buffer + i_size + 2, nal_data[pps_ni] + 4, nal_size);
+	nal_size = GST_BUFFER_SIZE (enc->pps);
+	memcpy (buffer + i_size + 2, GST_BUFFER_DATA (enc->pps), nal_size);
 	GST_WRITE_UINT16_BE (buffer + i_size, nal_size);
 	i_size += nal_size + 2;
 
@@ -2875,6 +3143,338 @@ gst_sh_video_enc_header_buf(GstSHVideoEnc *enc)
 	return buf;
 }
 
+/**
+ * Get the number of B frames between I/P frames
+ * @param enc Gstreamer SH video encoder
+ * @return The number of B-VOPs, 0 for H.264
+ */
+static guint
+gst_sh_video_enc_b_frames(GstSHVideoEnc *enc)
+{
+	if (enc->format != SHCodecs_Format_MPEG4)
+		return 0;
+	return enc->b_vop_num;
+}
+
+/**
+ * Record the timestamps of an input frame, by its frame number
+ * @param enc Gstreamer SH video encoder
+ * @param buffer Input buffer
+ */
+static void
+gst_sh_video_enc_record_input(GstSHVideoEnc *enc, GstBuffer *buffer)
+{
+	GstSHVideoEncTimestamp *ts;
+
+	ts = &enc->timestamps[enc->frames_in % GST_SH_VIDEO_ENC_TIMESTAMPS];
+	ts->timestamp = GST_BUFFER_TIMESTAMP(buffer);
+	ts->duration = GST_BUFFER_DURATION(buffer);
+	ts->offset = GST_BUFFER_OFFSET(buffer);
+	enc->frames_in++;
+}
+
+/**
+ * Check if encoded MPEG-4 data holds a B-VOP
+ * @param buf Encoded data
+ * @return TRUE if the first VOP is a B-VOP
+ */
+static gboolean
+gst_sh_video_enc_is_b_vop(GstBuffer *buf)
+{
+	guint8 *data = GST_BUFFER_DATA(buf);
+	guint i;
+
+	/* vop_coding_type is the top 2 bits after the VOP start code */
+	for (i = 0; i + 4 < GST_BUFFER_SIZE(buf); i++) {
+		if (data[i] == 0 && data[i+1] == 0 && data[i+2] == 1 && data[i+3] == 0xB6)
+			return (data[i+4] >> 6) == 2;
+	}
+
+	return FALSE;
+}
+
+/**
+ * Get the time that frames are held back for B frames
+ * @param enc Gstreamer SH video encoder
+ * @return The delay, 0 without B frames or a known framerate
+ */
+static GstClockTime
+gst_sh_video_enc_b_frame_delay(GstSHVideoEnc *enc)
+{
+	if (enc->fps_numerator <= 0)
+		return 0;
+
+	return gst_util_uint64_scale(gst_sh_video_enc_b_frames(enc) * GST_SECOND,
+		enc->fps_denominator, enc->fps_numerator);
+}
+
+/**
+ * Set the timestamps of an encoded frame. Frames are output in coding order,
+ * so with B frames each I/P frame is output before the B frames that are
+ * displayed before it. The presentation timestamp is taken from the input
+ * frame in display order, the decode timestamp from the frame in coding order.
+ * Rather than moving the decode timestamps back, which would go below zero
+ * for the first frames, the presentation timestamps are moved forward by the
+ * B frame delay.
+ * @param enc Gstreamer SH video encoder
+ * @param buf Encoded frame
+ * @param frm_delta Number of input frames used, more than 1 if frames were skipped
+ */
+static void
+gst_sh_video_enc_set_timestamps(GstSHVideoEnc *enc, GstBuffer *buf, gint frm_delta)
+{
+	guint b_frames = gst_sh_video_enc_b_frames(enc);
+	GstSHVideoEncTimestamp *pts, *dts;
+	GstClockTime delay = 0;
+	guint64 display;
+
+	/* Never past the inputs recorded */
+	if (enc->frames_out + frm_delta > enc->frames_in)
+		frm_delta = enc->frames_in - enc->frames_out;
+
+	if (b_frames && gst_sh_video_enc_is_b_vop(buf)) {
+		display = enc->next_b++;
+	} else {
+		if (enc->last_anchor < 0)
+			display = frm_delta - 1;
+		else
+			display = enc->last_anchor + b_frames + frm_delta;
+
+		/* There are fewer B frames at the end of the stream */
+		if (display >= enc->frames_in)
+			display = enc->frames_in - 1;
+
+		enc->next_b = enc->last_anchor + 1;
+		enc->last_anchor = display;
+	}
+
+	if (b_frames)
+		delay = gst_sh_video_enc_b_frame_delay(enc);
+
+	pts = &enc->timestamps[display % GST_SH_VIDEO_ENC_TIMESTAMPS];
+	GST_BUFFER_TIMESTAMP(buf) = pts->timestamp;
+	if (GST_CLOCK_TIME_IS_VALID(pts->timestamp))
+		GST_BUFFER_TIMESTAMP(buf) += delay;
+	GST_BUFFER_DURATION(buf) = pts->duration;
+	GST_BUFFER_OFFSET(buf) = pts->offset;
+
+	/* The decode timestamp goes in OFFSET_END, as 0.10 buffers have no DTS.
+	   It follows the last input the encoder has used, past skipped frames */
+	if (b_frames) {
+		dts = &enc->timestamps[(enc->frames_out + frm_delta - 1) % GST_SH_VIDEO_ENC_TIMESTAMPS];
+		GST_BUFFER_OFFSET_END(buf) = dts->timestamp;
+	}
+
+	GST_LOG_OBJECT(enc, "Frame %" G_GUINT64_FORMAT " displayed as %" G_GUINT64_FORMAT,
+		enc->frames_out + frm_delta - 1, display);
+
+	enc->frames_out += frm_delta;
+}
+
+/**
+ * Get the size of an input frame, as packed by the upstream element
+ * @param enc Gstreamer SH video encoder
+ * @return The size in bytes
+ */
+static guint
+gst_sh_video_enc_input_size(GstSHVideoEnc *enc)
+{
+	if (enc->fourcc == GST_MAKE_FOURCC('N', 'V', '1', '2'))
+		return (enc->width * enc->height * 3) / 2;
+
+	return gst_video_format_get_size(gst_video_format_from_fourcc(enc->fourcc),
+		enc->width, enc->height);
+}
+
+/**
+ * Describe the frame in an input buffer, which may be padded
+ * @param enc Gstreamer SH video encoder
+ * @param buffer Input buffer
+ * @param frame The frame is returned here
+ * @return TRUE if the buffer holds a whole frame
+ */
+static gboolean
+gst_sh_video_enc_get_frame(GstSHVideoEnc *enc, GstBuffer *buffer,
+			   struct ren_vid_surface *frame)
+{
+	GstCaps *caps;
+	gint pitch = 0;
+	gint c_offset = 0;
+
+	/* Other formats are described when converted */
+	if (enc->fourcc != GST_MAKE_FOURCC('N', 'V', '1', '2'))
+		return GST_BUFFER_SIZE(buffer) >= gst_sh_video_enc_input_size(enc);
+
+	caps = GST_BUFFER_CAPS(buffer) ? GST_BUFFER_CAPS(buffer) : GST_PAD_CAPS(enc->sinkpad);
+	if (caps)
+		gst_sh_video_format_parse_layout(caps, &pitch, &c_offset);
+
+	gst_sh_video_buffer_get_surface(buffer, REN_NV12, enc->width, enc->height,
+		pitch, c_offset, frame);
+
+	return GST_BUFFER_SIZE(buffer) >= (guint)((guchar *)frame->pc - (guchar *)frame->py)
+		+ size_c(REN_NV12, frame->pitch * frame->h);
+}
+
+/**
+ * Check if the VPU can read a buffer directly, i.e. the memory is physically
+ * contiguous. This covers our own buffers, and uiomux memory from other
+ * elements such as v4l2src USERPTR buffers & the decoder output.
+ * @param buffer Input buffer
+ * @return TRUE if the encoder doesn't need a copy
+ */
+static gboolean
+gst_sh_video_enc_is_contiguous(GstBuffer *buffer)
+{
+	if (GST_IS_SH_VIDEO_BUFFER(buffer))
+		return TRUE;
+
+	return uiomux_all_virt_to_phys(GST_BUFFER_DATA(buffer)) != 0;
+}
+
+/**
+ * Get an NV12 frame in uiomux memory, to copy or convert input into
+ * @param enc Gstreamer SH video encoder
+ * @return A buffer from the input pool, or NULL on failure
+ */
+static GstBuffer *
+gst_sh_video_enc_get_input_buffer(GstSHVideoEnc *enc)
+{
+	if (enc->input_pool
+	    && !gst_sh_video_buffer_pool_matches(enc->input_pool,
+			enc->width, enc->height, REN_NV12)) {
+		gst_sh_video_buffer_pool_free(enc->input_pool);
+		enc->input_pool = NULL;
+	}
+	if (!enc->input_pool)
+		enc->input_pool = gst_sh_video_buffer_pool_new(enc->uiomux,
+			enc->width, enc->height, REN_NV12);
+
+	return gst_sh_video_buffer_pool_get(enc->input_pool);
+}
+
+/**
+ * The encoder reads packed frames from contiguous memory, so copy a padded
+ * frame or one in normal memory
+ * @param enc Gstreamer SH video encoder
+ * @param buffer Input buffer, the reference is taken over
+ * @param frame Frame in the input buffer, returned for the packed frame
+ * @return The packed buffer, or NULL on failure
+ */
+static GstBuffer *
+gst_sh_video_enc_repack(GstSHVideoEnc *enc, GstBuffer *buffer,
+			struct ren_vid_surface *frame)
+{
+	GstBuffer *packed;
+	guchar *dst;
+	gint line;
+
+	packed = gst_sh_video_enc_get_input_buffer(enc);
+	if (!packed) {
+		gst_buffer_unref(buffer);
+		return NULL;
+	}
+
+	GST_LOG_OBJECT(enc, "Repacking frame with pitch %d", frame->pitch);
+
+	dst = GST_BUFFER_DATA(packed);
+	for (line = 0; line < enc->height; line++, dst += enc->width)
+		memcpy(dst, (guchar *)frame->py + line * frame->pitch, enc->width);
+
+	dst = (guchar *)GST_BUFFER_DATA(packed) + GST_SH_VIDEO_BUFFER(packed)->c_offset;
+	for (line = 0; line < enc->height / 2; line++, dst += enc->width)
+		memcpy(dst, (guchar *)frame->pc + line * frame->pitch, enc->width);
+
+	gst_buffer_copy_metadata(packed, buffer,
+		GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS);
+	gst_buffer_unref(buffer);
+
+	gst_sh_video_buffer_get_surface(packed, REN_NV12, enc->width, enc->height,
+		0, 0, frame);
+
+	return packed;
+}
+
+/**
+ * Convert an I420, YV12 or YUY2 frame into an NV12 frame in uiomux memory,
+ * which is what the encoder reads
+ * @param enc Gstreamer SH video encoder
+ * @param buffer Input buffer, the reference is taken over
+ * @param frame The NV12 frame is returned here
+ * @return The converted buffer, or NULL on failure
+ */
+static GstBuffer *
+gst_sh_video_enc_convert(GstSHVideoEnc *enc, GstBuffer *buffer,
+			 struct ren_vid_surface *frame)
+{
+	GstVideoFormat fmt = gst_video_format_from_fourcc(enc->fourcc);
+	guchar *data = GST_BUFFER_DATA(buffer);
+	GstBuffer *converted;
+
+	converted = gst_sh_video_enc_get_input_buffer(enc);
+	if (!converted) {
+		gst_buffer_unref(buffer);
+		return NULL;
+	}
+
+	gst_sh_video_buffer_get_surface(converted, REN_NV12, enc->width, enc->height,
+		0, 0, frame);
+
+	if (fmt == GST_VIDEO_FORMAT_YUY2) {
+		convert_yuy2_to_nv12(data,
+			gst_video_format_get_row_stride(fmt, 0, enc->width), frame);
+	} else {
+		convert_planar_to_nv12(
+			data + gst_video_format_get_component_offset(fmt, 0, enc->width, enc->height),
+			gst_video_format_get_row_stride(fmt, 0, enc->width),
+			data + gst_video_format_get_component_offset(fmt, 1, enc->width, enc->height),
+			data + gst_video_format_get_component_offset(fmt, 2, enc->width, enc->height),
+			gst_video_format_get_row_stride(fmt, 1, enc->width),
+			frame);
+	}
+
+	gst_buffer_copy_metadata(converted, buffer,
+		GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS);
+	gst_buffer_unref(buffer);
+
+	return converted;
+}
+
+/**
+ * Get the input into a form the encoder can read directly: NV12, with a pitch
+ * of the width, in physically contiguous memory. Anything else is copied.
+ * @param enc Gstreamer SH video encoder
+ * @param buffer Input buffer, the reference is taken over
+ * @param frame Frame in the input buffer, returned for the buffer to encode
+ * @return The buffer to encode, or NULL on failure
+ */
+static GstBuffer *
+gst_sh_video_enc_prepare_input(GstSHVideoEnc *enc, GstBuffer *buffer,
+			       struct ren_vid_surface *frame)
+{
+	gboolean copied = TRUE;
+
+	if (enc->fourcc != GST_MAKE_FOURCC('N', 'V', '1', '2')) {
+		buffer = gst_sh_video_enc_convert(enc, buffer, frame);
+	} else if (frame->pitch != enc->width
+		   || !gst_sh_video_enc_is_contiguous(buffer)) {
+		/* The chroma plane can be anywhere, but the pitch must be the width */
+		buffer = gst_sh_video_enc_repack(enc, buffer, frame);
+	} else {
+		copied = FALSE;
+	}
+
+	if (!buffer)
+		return NULL;
+
+	if (copied)
+		enc->frames_copied++;
+	else
+		enc->frames_zero_copy++;
+
+	return buffer;
+}
+
 /**
  * The encoder function and launches the thread if needed
  * @param pad Gstreamer sink pad
@@ -2885,9 +3485,10 @@ static GstFlowReturn
 gst_sh_video_enc_chain(GstPad * pad, GstBuffer * buffer)
 {
 	GstSHVideoEnc *enc = (GstSHVideoEnc *)(GST_OBJECT_PARENT(pad));
+	struct ren_vid_surface frame;
 	unsigned char *py, *pc;
+	GstFlowReturn ret;
 	int rc;
-	gint luma_size, chroma_size;
 
 	GST_LOG_OBJECT(enc, "%s called", __func__);
 
@@ -2908,11 +3509,8 @@ gst_sh_video_enc_chain(GstPad * pad, GstBuffer * buffer)
 		enc->caps_set = TRUE;
 	}
 
-	luma_size = enc->width * enc->height;
-	chroma_size = luma_size / 2;
-
 	// Check that we have got enough data
-	if (GST_BUFFER_SIZE(buffer) < luma_size + chroma_size)
+	if (!gst_sh_video_enc_get_frame(enc, buffer, &frame))
 	{
 		GST_DEBUG_OBJECT(enc, "Not enough data");
 		// If we can't continue we can issue EOS
@@ -2921,21 +3519,74 @@ gst_sh_video_enc_chain(GstPad * pad, GstBuffer * buffer)
 		return GST_FLOW_OK;
 	}
 
-	/* remember the timestamp and duration */
-	g_queue_push_tail (enc->delay, buffer);
+	buffer = gst_sh_video_enc_prepare_input(enc, buffer, &frame);
+	if (!buffer) {
+		GST_ELEMENT_ERROR(enc, RESOURCE, NO_SPACE_LEFT,
+			("failed to allocate input buffer"), (NULL));
+		return GST_FLOW_ERROR;
+	}
+
+	gst_sh_video_enc_record_input(enc, buffer);
 
-	py = GST_BUFFER_DATA(buffer);
-	pc = py + luma_size;
+	/* The encoder reads the frame until it calls input_release */
+	g_queue_push_tail(enc->in_use, buffer);
 
-	/* Encode the frame */
+	py = frame.py;
+	pc = frame.pc;
+
+	/* Encode the frame, and push what it output once the VPU is free */
+	gst_sh_video_enc_vpu_acquire(enc);
 	rc = shcodecs_encoder_encode_1frame(enc->encoder, py, pc, buffer);
+	vpu_release(enc->vpu);
+	ret = gst_sh_video_enc_push_encoded(enc);
 	if (rc != 0) {
 		GST_ELEMENT_ERROR((GstElement *) enc, CORE, FAILED,
 				  ("Encode error"), ("%s failed (Error on shcodecs_encode)", __func__));
 		return GST_FLOW_ERROR;
 	}
 
-	return GST_FLOW_OK;
+	return ret;
+}
+
+/**
+ * Waits for the encoder's turn on the shared VPU
+ * @param enc Gstreamer SH video encoder
+ */
+static void
+gst_sh_video_enc_vpu_acquire(GstSHVideoEnc *enc)
+{
+	unsigned long budget = 0;
+
+	/* Aim to finish the frame within one frame period */
+	if (enc->fps_numerator > 0)
+		budget = 1000000 * enc->fps_denominator / enc->fps_numerator;
+
+	vpu_acquire(enc->vpu, budget);
+}
+
+/**
+ * Pushes the frames output by the last encode call
+ * @param enc Gstreamer SH video encoder
+ * @return GST_FLOW_OK, or the result of the failed push
+ */
+static GstFlowReturn
+gst_sh_video_enc_push_encoded(GstSHVideoEnc *enc)
+{
+	GstFlowReturn ret = GST_FLOW_OK;
+	GstBuffer *buf;
+
+	while ((buf = g_queue_pop_head(enc->encoded))) {
+		if (ret != GST_FLOW_OK) {
+			gst_buffer_unref(buf);
+			continue;
+		}
+
+		ret = gst_pad_push(enc->srcpad, buf);
+		if (ret != GST_FLOW_OK)
+			GST_DEBUG_OBJECT(enc, "pad_push failed: %s", gst_flow_get_name(ret));
+	}
+
+	return ret;
 }
 
 /**
@@ -2957,10 +3608,179 @@ gst_sh_video_enc_activate_pull(GstPad  *pad,
 		return gst_pad_start_task(pad,
 				(GstTaskFunction)gst_sh_video_enc_loop, enc);
 	} else {
-		return gst_pad_stop_task(pad);
+		gboolean ret;
+
+		/* Wake the task if it is waiting for the reader */
+		g_mutex_lock(enc->prefetch_lock);
+		enc->reader_stop = TRUE;
+		g_cond_broadcast(enc->prefetch_cond);
+		g_mutex_unlock(enc->prefetch_lock);
+
+		ret = gst_pad_stop_task(pad);
+		gst_sh_video_enc_stop_reader(enc);
+		return ret;
 	}
 }
 
+/**
+ * Read the next frame from upstream, and get it ready for the encoder
+ * @param enc Gstreamer SH video encoder
+ * @param buffer The buffer to encode is returned here
+ * @param frame The frame in the buffer is returned here
+ * @return GST_FLOW_OK, or the reason there is no frame
+ */
+static GstFlowReturn
+gst_sh_video_enc_read_frame(GstSHVideoEnc *enc, GstBuffer **buffer,
+			    struct ren_vid_surface *frame)
+{
+	GstFlowReturn ret;
+	guint frame_size;
+
+	frame_size = gst_sh_video_enc_input_size(enc);
+
+	ret = gst_pad_pull_range(enc->sinkpad, enc->offset, frame_size, buffer);
+	if (ret != GST_FLOW_OK) {
+		GST_DEBUG_OBJECT(enc, "pull_range failed: %s", gst_flow_get_name(ret));
+		return ret;
+	}
+
+	if (GST_BUFFER_SIZE(*buffer) != frame_size) {
+		GST_DEBUG_OBJECT(enc, "Not enough data");
+		gst_buffer_unref(*buffer);
+		return GST_FLOW_UNEXPECTED;
+	}
+
+	enc->offset += frame_size;
+
+	gst_sh_video_enc_get_frame(enc, *buffer, frame);
+	*buffer = gst_sh_video_enc_prepare_input(enc, *buffer, frame);
+	if (!*buffer) {
+		GST_ELEMENT_ERROR(enc, RESOURCE, NO_SPACE_LEFT,
+			("failed to allocate input buffer"), (NULL));
+		return GST_FLOW_ERROR;
+	}
+
+	return GST_FLOW_OK;
+}
+
+/* A frame read ahead of the encoder */
+struct enc_prefetch {
+	GstBuffer *buffer;
+	struct ren_vid_surface frame;
+};
+
+/**
+ * The reader thread. Keeps up to prefetch-frames frames read & copied into
+ * uiomux memory, while the pad task encodes.
+ * @param data Gstreamer SH video encoder
+ */
+static gpointer
+gst_sh_video_enc_reader(gpointer data)
+{
+	GstSHVideoEnc *enc = (GstSHVideoEnc *) data;
+	struct enc_prefetch *item;
+	GstFlowReturn ret;
+
+	do {
+		g_mutex_lock(enc->prefetch_lock);
+		while (!enc->reader_stop
+		       && g_queue_get_length(enc->prefetched) >= (guint)enc->prefetch_frames)
+			g_cond_wait(enc->prefetch_cond, enc->prefetch_lock);
+		if (enc->reader_stop) {
+			g_mutex_unlock(enc->prefetch_lock);
+			break;
+		}
+		g_mutex_unlock(enc->prefetch_lock);
+
+		item = g_slice_new(struct enc_prefetch);
+		ret = gst_sh_video_enc_read_frame(enc, &item->buffer, &item->frame);
+
+		g_mutex_lock(enc->prefetch_lock);
+		if (ret == GST_FLOW_OK) {
+			g_queue_push_tail(enc->prefetched, item);
+		} else {
+			g_slice_free(struct enc_prefetch, item);
+			enc->reader_ret = ret;
+		}
+		g_cond_broadcast(enc->prefetch_cond);
+		g_mutex_unlock(enc->prefetch_lock);
+	} while (ret == GST_FLOW_OK);
+
+	return NULL;
+}
+
+/**
+ * Get the next frame from the reader thread, starting it if needed
+ * @param enc Gstreamer SH video encoder
+ * @param buffer The buffer to encode is returned here
+ * @param frame The frame in the buffer is returned here
+ * @return GST_FLOW_OK, or the reason there is no frame
+ */
+static GstFlowReturn
+gst_sh_video_enc_next_prefetched(GstSHVideoEnc *enc, GstBuffer **buffer,
+				 struct ren_vid_surface *frame)
+{
+	struct enc_prefetch *item = NULL;
+	GstFlowReturn ret = GST_FLOW_OK;
+
+	g_mutex_lock(enc->prefetch_lock);
+
+	if (!enc->reader && !enc->reader_stop) {
+		enc->reader_ret = GST_FLOW_OK;
+		enc->reader = g_thread_create(gst_sh_video_enc_reader, enc, TRUE, NULL);
+	}
+
+	while (!enc->reader_stop && enc->reader_ret == GST_FLOW_OK
+	       && g_queue_is_empty(enc->prefetched))
+		g_cond_wait(enc->prefetch_cond, enc->prefetch_lock);
+
+	item = g_queue_pop_head(enc->prefetched);
+	if (item) {
+		/* Let the reader fetch another */
+		g_cond_broadcast(enc->prefetch_cond);
+	} else {
+		ret = enc->reader_stop ? GST_FLOW_WRONG_STATE : enc->reader_ret;
+	}
+
+	g_mutex_unlock(enc->prefetch_lock);
+
+	if (item) {
+		*buffer = item->buffer;
+		*frame = item->frame;
+		g_slice_free(struct enc_prefetch, item);
+	}
+
+	return ret;
+}
+
+/**
+ * Stop the reader thread, and drop the frames it read
+ * @param enc Gstreamer SH video encoder
+ */
+static void
+gst_sh_video_enc_stop_reader(GstSHVideoEnc *enc)
+{
+	struct enc_prefetch *item;
+
+	g_mutex_lock(enc->prefetch_lock);
+	enc->reader_stop = TRUE;
+	g_cond_broadcast(enc->prefetch_cond);
+	g_mutex_unlock(enc->prefetch_lock);
+
+	if (enc->reader) {
+		g_thread_join(enc->reader);
+		enc->reader = NULL;
+	}
+
+	while ((item = g_queue_pop_head(enc->prefetched))) {
+		gst_buffer_unref(item->buffer);
+		g_slice_free(struct enc_prefetch, item);
+	}
+
+	enc->reader_stop = FALSE;
+	enc->reader_ret = GST_FLOW_OK;
+}
+
 /**
  * The encoder sink pad task
  * @param enc Gstreamer SH video encoder
@@ -2969,8 +3789,8 @@ static void
 gst_sh_video_enc_loop(GstSHVideoEnc *enc)
 {
 	GstFlowReturn ret;
-	gint luma_size, chroma_size;
 	GstBuffer *buffer;
+	struct ren_vid_surface frame;
 	unsigned char *py, *pc;
 	int rc;
 
@@ -2990,48 +3810,44 @@ gst_sh_video_enc_loop(GstSHVideoEnc *enc)
 		enc->caps_set = TRUE;
 	}
 
-	luma_size = enc->width * enc->height;
-	chroma_size = enc->width * enc->height / 2;
-
-	ret = gst_pad_pull_range(enc->sinkpad, enc->offset,
-			luma_size+chroma_size, &buffer);
+	if (enc->prefetch_frames > 0)
+		ret = gst_sh_video_enc_next_prefetched(enc, &buffer, &frame);
+	else
+		ret = gst_sh_video_enc_read_frame(enc, &buffer, &frame);
 
 	if (ret != GST_FLOW_OK)
 	{
-		GST_DEBUG_OBJECT(enc, "pull_range failed: %s", gst_flow_get_name(ret));
-		gst_pad_pause_task(enc->sinkpad);
-		enc->eos = TRUE;
-		gst_pad_push_event(enc->srcpad, gst_event_new_eos());
-		return;
-	}
-	else if (GST_BUFFER_SIZE(buffer) != luma_size+chroma_size)
-	{
-		GST_DEBUG_OBJECT(enc, "Not enough data");
 		gst_pad_pause_task(enc->sinkpad);
-		enc->eos = TRUE;
-		gst_pad_push_event(enc->srcpad, gst_event_new_eos());
+		if (ret != GST_FLOW_WRONG_STATE && ret != GST_FLOW_ERROR) {
+			enc->eos = TRUE;
+			gst_pad_push_event(enc->srcpad, gst_event_new_eos());
+		}
 		return;
 	}
 
-	enc->offset += luma_size+chroma_size;
-
-	GST_LOG("Input buffer is not SH type (enc will copy data)");
+	gst_sh_video_enc_record_input(enc, buffer);
 
-	/* remember the timestamp and duration */
-	g_queue_push_tail (enc->delay, buffer);
+	/* The encoder reads the frame until it calls input_release */
+	g_queue_push_tail(enc->in_use, buffer);
 
-	py = GST_BUFFER_DATA(buffer);
-	pc = py + luma_size;
+	py = frame.py;
+	pc = frame.pc;
 
 	GST_DEBUG_OBJECT(enc, "py=%p, pc=%p", py, pc);
 
-	/* Encode the frame */
+	/* Encode the frame, and push what it output once the VPU is free */
+	gst_sh_video_enc_vpu_acquire(enc);
 	rc = shcodecs_encoder_encode_1frame(enc->encoder, py, pc, buffer);
+	vpu_release(enc->vpu);
+	ret = gst_sh_video_enc_push_encoded(enc);
 	if (rc != 0) {
 		GST_ELEMENT_ERROR((GstElement *) enc, CORE, FAILED,
 				  ("Encode error"), ("%s failed (Error on shcodecs_encode)", __func__));
 		return;
 	}
+
+	if (ret != GST_FLOW_OK)
+		gst_pad_pause_task(enc->sinkpad);
 }
 
 /**
@@ -3048,10 +3864,9 @@ gst_sh_video_enc_write_output(SHCodecs_Encoder * encoder,
 {
 	GstSHVideoEnc *enc = (GstSHVideoEnc *) user_data;
 	GstBuffer *buf = NULL;
-	GstBuffer *in_buf = NULL;
 	gint ret = 0;
 	int frm_delta;
-	int frame;
+	int nal_type = 0;
 
 	GST_LOG_OBJECT(enc, "Got %d bytes data frame number: %ld\n",
 				   length, enc->frame_number);
@@ -3065,6 +3880,14 @@ gst_sh_video_enc_write_output(SHCodecs_Encoder * encoder,
 	if (length <= 0)
 		return 0;
 
+	/* The encoder gives one NAL unit at a time, so just look at its type */
+	if (enc->format == SHCodecs_Format_H264 && length > 4
+	    && data[0] == 0 && data[1] == 0 && data[2] == 0 && data[3] == 1) {
+		nal_type = data[4] & 0x1f;
+		if (nal_type == 7)
+			enc->headers_in_frame = TRUE;
+	}
+
 	if (!enc->bytestream) {
 		/* AVC1 encoding - each NALU is prefixed by a 32bit length field */
 		/* Just replace the 4 byte start code */
@@ -3078,9 +3901,17 @@ gst_sh_video_enc_write_output(SHCodecs_Encoder * encoder,
 		}
 	}
 
-	buf = gst_buffer_new();
-	gst_buffer_set_data(buf, data, length);
+	/* Copied, as it is only pushed after the encode call returns */
+	buf = gst_buffer_new_and_alloc(length);
+	memcpy(GST_BUFFER_DATA(buf), data, length);
 
+	/* Repeat the SPS & PPS read in init_encoder before the first slice of
+	   an IDR frame, unless the encoder has already put them in */
+	if (nal_type == 5 && enc->repeat_headers && !enc->headers_in_frame
+	    && enc->headers) {
+		buf = gst_buffer_join(gst_buffer_ref(enc->headers), buf);
+		enc->headers_in_frame = TRUE;
+	}
 
 	if (enc->buffered_output != NULL) {
 		buf = gst_buffer_join(enc->buffered_output, buf);
@@ -3089,32 +3920,21 @@ gst_sh_video_enc_write_output(SHCodecs_Encoder * encoder,
 	frm_delta = shcodecs_encoder_get_frame_num_delta(enc->encoder);
 
 	if (frm_delta > 0) {
-		/* Handle skipped frames */
-		for (frame=0; frame<frm_delta-1; frame++) {
-			in_buf = g_queue_pop_head (enc->delay);
-			gst_buffer_unref (in_buf);
-		}
 		/* Frame(s) have been encoded */
-		in_buf = g_queue_pop_head (enc->delay);
-
-		if (in_buf) {
-			GST_BUFFER_TIMESTAMP (buf) = GST_BUFFER_TIMESTAMP (in_buf);
-			GST_BUFFER_OFFSET (buf)    = GST_BUFFER_OFFSET (in_buf);
-			GST_BUFFER_DURATION (buf)  = GST_BUFFER_DURATION (in_buf);
-			gst_buffer_unref (in_buf);
-		} else {
+		if (enc->frames_out >= enc->frames_in) {
 			GST_ELEMENT_ERROR (enc, STREAM, ENCODE, (NULL),
 				("Timestamp queue empty."));
 			return GST_FLOW_ERROR;
 		}
 
+		gst_sh_video_enc_set_timestamps(enc, buf, frm_delta);
+
 		enc->frame_number += frm_delta;
+		enc->headers_in_frame = FALSE;
 
-		ret = gst_pad_push(enc->srcpad, buf);
-		if (ret != GST_FLOW_OK) {
-			GST_DEBUG_OBJECT(enc, "pad_push failed: %s", gst_flow_get_name(ret));
-			ret = -1;
-		}
+		/* The encoder still has the VPU, e.g. for the B-VOPs that follow
+		   a P-VOP, so push once the encode call returns */
+		g_queue_push_tail(enc->encoded, buf);
 	} else {
 		/* partial data, e.g. AUD, so collect into one buffer */
 		enc->buffered_output = buf;
@@ -3136,7 +3956,21 @@ static int gst_sh_video_enc_input_used (SHCodecs_Encoder * encoder,
 					unsigned char * c_input,
 					void * user_data)
 {
-	/* Nothing to do */
+	GstSHVideoEnc *enc = (GstSHVideoEnc *) user_data;
+	GList *l;
+
+	/* Drop our reference to the buffer holding the frame */
+	for (l = enc->in_use->head; l; l = l->next) {
+		GstBuffer *buf = GST_BUFFER(l->data);
+
+		if (y_input >= GST_BUFFER_DATA(buf)
+		    && y_input < GST_BUFFER_DATA(buf) + GST_BUFFER_SIZE(buf)) {
+			g_queue_delete_link(enc->in_use, l);
+			gst_buffer_unref(buf);
+			break;
+		}
+	}
+
 	return 0;
 }
 
@@ -3150,7 +3984,28 @@ static gboolean
 gst_sh_video_enc_src_query(GstPad * pad, GstQuery * query)
 {
 	GstSHVideoEnc *enc = (GstSHVideoEnc *)(GST_OBJECT_PARENT(pad));
+	GstClockTime min, max, latency;
+	gboolean live;
+
 	GST_LOG_OBJECT(enc, "%s called", __func__);
+
+	if (GST_QUERY_TYPE(query) == GST_QUERY_LATENCY) {
+		if (!gst_pad_peer_query(enc->sinkpad, query))
+			return FALSE;
+
+		/* Frames are held back until the following I/P frame is coded */
+		latency = gst_sh_video_enc_b_frame_delay(enc);
+
+		gst_query_parse_latency(query, &live, &min, &max);
+		min += latency;
+		if (GST_CLOCK_TIME_IS_VALID(max))
+			max += latency;
+		gst_query_set_latency(query, live, min, max);
+
+		GST_DEBUG_OBJECT(enc, "Latency %" GST_TIME_FORMAT, GST_TIME_ARGS(latency));
+		return TRUE;
+	}
+
 	return gst_pad_query_default(pad, query);
 }
 
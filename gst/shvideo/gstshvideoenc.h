@@ -25,6 +25,8 @@
 #include <shcodecs/shcodecs_encoder.h>
 
 #include "ControlFileUtil.h"
+#include "vpusched.h"
+#include "gstshvideobuffer.h"
 
 G_BEGIN_DECLS
 #define GST_TYPE_SH_VIDEO_ENC \
@@ -39,6 +41,20 @@ G_BEGIN_DECLS
 	(G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_SH_VIDEO_ENC))
 typedef struct _GstSHVideoEnc GstSHVideoEnc;
 typedef struct _GstSHVideoEncClass GstSHVideoEncClass;
+typedef struct _GstSHVideoEncTimestamp GstSHVideoEncTimestamp;
+
+/* Size of the input timestamp table, more than the frames in the encoder */
+#define GST_SH_VIDEO_ENC_TIMESTAMPS 64
+
+/**
+ * Timestamps of an input frame
+ */
+struct _GstSHVideoEncTimestamp
+{
+	GstClockTime timestamp;
+	GstClockTime duration;
+	guint64 offset;
+};
 
 /**
  * Define Gstreamer SH Video Encoder structure
@@ -56,8 +72,26 @@ struct _GstSHVideoEnc
 	gint height;
 	gint fps_numerator;
 	gint fps_denominator;
+	guint32 fourcc;
 	gboolean bytestream;
 
+	/* NV12 frames in uiomux memory, for input that has to be copied */
+	GstSHVideoBufferPool *input_pool;
+
+	/* Pull mode read-ahead of the input, prepared by the reader thread */
+	gint prefetch_frames;
+	GThread *reader;
+	GMutex *prefetch_lock;
+	GCond *prefetch_cond;
+	GQueue *prefetched;
+	gboolean reader_stop;
+	GstFlowReturn reader_ret;
+
+	/* Input buffers read by the encoder, held until released */
+	GQueue *in_use;
+	guint64 frames_zero_copy;
+	guint64 frames_copied;
+
 	APPLI_INFO ainfo;
 
 	GstCaps *out_caps;
@@ -69,9 +103,31 @@ struct _GstSHVideoEnc
 	gboolean eos;
 
 	GstBuffer *buffered_output;
-
-	/* for holding timestamp information */
-	GQueue *delay;
+	/* Frames output by the current encode call, pushed once it returns */
+	GQueue *encoded;
+
+	/* H.264 SPS & PPS NAL units (without start code), read once from the
+	   encoder, and the two framed for the output, to repeat before IDRs */
+	GstBuffer *sps;
+	GstBuffer *pps;
+	GstBuffer *headers;
+	gboolean repeat_headers;
+	gboolean headers_in_frame;
+
+	/* Input timestamps in display order, indexed by the frame number modulo
+	   GST_SH_VIDEO_ENC_TIMESTAMPS */
+	GstSHVideoEncTimestamp timestamps[GST_SH_VIDEO_ENC_TIMESTAMPS];
+	guint64 frames_in;
+	/* Input frames used by the encoder, including skipped frames */
+	guint64 frames_out;
+	/* Display number of the last I/P frame output, -1 before the first */
+	gint64 last_anchor;
+	/* Display number of the next B frame output */
+	guint64 next_b;
+
+	/* shared VPU scheduling */
+	VPU_CLIENT *vpu;
+	gint vpu_priority;
 
 	/* PROPERTIES */
 	/* common */
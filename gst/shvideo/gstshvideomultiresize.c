@@ -0,0 +1,644 @@
+/**
+ * "gst-sh-mobile-multiresize" element. Scales each input frame to several
+ * outputs using the VEU hardware resizer (via libshveu).
+ *
+ * Each request src pad is an output with its own caps, set by the element
+ * downstream of it (e.g. a capsfilter). For every input frame, the jobs for
+ * all of the outputs are queued on the shared VEU service back to back, from
+ * the streaming thread, and the outputs are pushed once they have all
+ * completed. Compared to a tee in front of several gst-sh-mobile-resize
+ * elements, there are no extra streaming threads, and on SoCs with more than
+ * one VEU, the outputs are scaled in parallel.
+ *
+ * Example usage, scaling a camera to three sizes for simulcast encoding:
+ * \code
+ *     gst-launch \
+ *       v4l2src ! "video/x-raw-yuv, format=(fourcc)NV12, width=1280, height=720" \
+ *       ! gst-sh-mobile-multiresize name=scale \
+ *       scale. ! "video/x-raw-yuv, format=(fourcc)NV12, width=1280, height=720" ! queue ! gst-sh-mobile-enc cntl-file=hd.ctl ! filesink location=hd.264 \
+ *       scale. ! "video/x-raw-yuv, format=(fourcc)NV12, width=640, height=360" ! queue ! gst-sh-mobile-enc cntl-file=sd.ctl ! filesink location=sd.264 \
+ *       scale. ! "video/x-raw-yuv, format=(fourcc)NV12, width=320, height=180" ! queue ! gst-sh-mobile-enc cntl-file=ld.ctl ! filesink location=ld.264
+ * \endcode
+ *
+ * The element supports the same formats as gst-sh-mobile-resize:
+ *       "video/x-raw-rgb, bpp=16"
+ *       "video/x-raw-rgb, bpp=32"
+ *       "video/x-raw-yuv, format=(fourcc)NV12"
+ *       "video/x-raw-yuv, format=(fourcc)NV16"
+ *
+ * If the input caps carry crop-left/right/top/bottom fields, only the visible
+ * area of the input is scaled. Outputs must be within 16 times the size of
+ * the input, i.e. one VEU pass.
+ *
+ * Output buffers are requested from downstream first, like
+ * gst-sh-mobile-resize, otherwise they come from a pool for each output.
+ *
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include <uiomux/uiomux.h>
+#include <shveu/shveu.h>
+
+#include "gstshvideomultiresize.h"
+#include "gstshvideobuffer.h"
+
+/* Declare variable used to categorize GST_LOG output */
+GST_DEBUG_CATEGORY_STATIC (gst_shvidmultiresize_debug);
+#define GST_CAT_DEFAULT gst_shvidmultiresize_debug
+
+/* Use our size range. This will be expanded in GST_VIDEO_CAPS_* */
+#undef GST_VIDEO_SIZE_RANGE
+#define GST_VIDEO_SIZE_RANGE "(int) [ 16, 4092]"
+
+#define MAX_SCALE_FACTOR 16
+
+static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE(
+	"sink",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS (
+		GST_VIDEO_CAPS_YUV("NV12")";"
+		GST_VIDEO_CAPS_YUV("NV16")";"
+		GST_VIDEO_CAPS_RGB_16";"
+		GST_VIDEO_CAPS_RGBx
+	)
+);
+
+static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE(
+	"src_%d",
+	GST_PAD_SRC,
+	GST_PAD_REQUEST,
+	GST_STATIC_CAPS (
+		GST_VIDEO_CAPS_YUV("NV12")";"
+		GST_VIDEO_CAPS_YUV("NV16")";"
+		GST_VIDEO_CAPS_RGB_16";"
+		GST_VIDEO_CAPS_RGBx
+	)
+);
+
+/* Declare a global pointer to our element base class */
+static GstElementClass *parent_class = NULL;
+
+
+/*
+ * Sink pad setcaps function. Outputs are negotiated again with the next
+ * frame.
+ */
+static gboolean gst_shvidmultiresize_setcaps (GstPad *pad, GstCaps *caps)
+{
+	GstSHVidMultiresize *multiresize = GST_SHVIDMULTIRESIZE(GST_OBJECT_PARENT(pad));
+	GstStructure *structure;
+	GList *walk;
+	gint width, height;
+	ren_vid_format_t format;
+
+	structure = gst_caps_get_structure(caps, 0);
+
+	if (!gst_structure_get_int(structure, "width", &width)
+	    || !gst_structure_get_int(structure, "height", &height)) {
+		GST_ERROR("Failed to get resolution");
+		return FALSE;
+	}
+
+	if (!gst_caps_to_renesas_format(caps, &format))
+		return FALSE;
+
+	g_mutex_lock(multiresize->lock);
+
+	multiresize->srcWidth = width;
+	multiresize->srcHeight = height;
+	multiresize->srcColorSpace = format;
+
+	if (!gst_structure_get_fraction(structure, "framerate",
+		&multiresize->fps_n, &multiresize->fps_d)) {
+		multiresize->fps_n = 0;
+		multiresize->fps_d = 1;
+	}
+
+	gst_sh_video_format_parse_layout(caps, &multiresize->srcPitch, &multiresize->srcCOffset);
+
+	if (!gst_sh_video_format_parse_crop(caps, &multiresize->srcCrop)) {
+		multiresize->srcCrop.x = 0;
+		multiresize->srcCrop.y = 0;
+		multiresize->srcCrop.w = width;
+		multiresize->srcCrop.h = height;
+	}
+
+	for (walk = multiresize->outputs; walk; walk = g_list_next(walk)) {
+		GstSHVidMultiresizeOutput *output = walk->data;
+		output->dstWidth = 0;
+		output->dstHeight = 0;
+	}
+
+	g_mutex_unlock(multiresize->lock);
+
+	GST_LOG("input %dx%d, cropped to %dx%d at %d,%d", width, height,
+		multiresize->srcCrop.w, multiresize->srcCrop.h,
+		multiresize->srcCrop.x, multiresize->srcCrop.y);
+
+	return TRUE;
+}
+
+/*
+ * Pick the caps of an output from what downstream accepts, aiming for the
+ * size of the input. Call with the lock held.
+ */
+static gboolean gst_shvidmultiresize_negotiate (GstSHVidMultiresize *multiresize,
+	GstSHVidMultiresizeOutput *output)
+{
+	GstCaps *peer_caps, *caps;
+	GstStructure *structure;
+	ren_vid_format_t format;
+	gint width, height;
+
+	peer_caps = gst_pad_peer_get_caps(output->srcpad);
+	if (!peer_caps)
+		return FALSE;
+
+	caps = gst_caps_intersect(peer_caps, gst_pad_get_pad_template_caps(output->srcpad));
+	gst_caps_unref(peer_caps);
+
+	if (gst_caps_is_empty(caps)) {
+		gst_caps_unref(caps);
+		return FALSE;
+	}
+
+	gst_caps_truncate(caps);
+	structure = gst_caps_get_structure(caps, 0);
+	gst_structure_fixate_field_nearest_int(structure, "width", multiresize->srcCrop.w);
+	gst_structure_fixate_field_nearest_int(structure, "height", multiresize->srcCrop.h);
+	if (multiresize->fps_n)
+		gst_structure_fixate_field_nearest_fraction(structure, "framerate",
+			multiresize->fps_n, multiresize->fps_d);
+	gst_pad_fixate_caps(output->srcpad, caps);
+
+	if (!gst_caps_is_fixed(caps)
+	    || !gst_structure_get_int(structure, "width", &width)
+	    || !gst_structure_get_int(structure, "height", &height)
+	    || !gst_caps_to_renesas_format(caps, &format)) {
+		gst_caps_unref(caps);
+		return FALSE;
+	}
+
+	/* One VEU pass */
+	if (width * MAX_SCALE_FACTOR < multiresize->srcCrop.w
+	    || width > multiresize->srcCrop.w * MAX_SCALE_FACTOR
+	    || height * MAX_SCALE_FACTOR < multiresize->srcCrop.h
+	    || height > multiresize->srcCrop.h * MAX_SCALE_FACTOR) {
+		GST_WARNING_OBJECT(output->srcpad, "can't scale %dx%d to %dx%d",
+			multiresize->srcCrop.w, multiresize->srcCrop.h, width, height);
+		gst_caps_unref(caps);
+		return FALSE;
+	}
+
+	if (!gst_pad_set_caps(output->srcpad, caps)) {
+		gst_caps_unref(caps);
+		return FALSE;
+	}
+	gst_sh_video_format_parse_layout(caps, &output->dstPitch, &output->dstCOffset);
+	gst_caps_unref(caps);
+
+	output->dstWidth = width;
+	output->dstHeight = height;
+	output->dstColorSpace = format;
+	output->poolOnly = FALSE;
+
+	GST_DEBUG_OBJECT(output->srcpad, "output %dx%d, format=%d", width, height, format);
+
+	return TRUE;
+}
+
+/*
+ * Get a buffer for an output, from downstream if the VEU can use it,
+ * otherwise from the output's pool.
+ */
+static GstFlowReturn gst_shvidmultiresize_get_buffer (GstSHVidMultiresize *multiresize,
+	GstSHVidMultiresizeOutput *output, GstBuffer *inbuf, GstBuffer **outbuf)
+{
+	GstCaps *caps = GST_PAD_CAPS(output->srcpad);
+	GstFlowReturn ret;
+	guint size;
+
+	size = size_y(output->dstColorSpace, output->dstWidth * output->dstHeight)
+		+ size_c(output->dstColorSpace, output->dstWidth * output->dstHeight);
+
+	if (!output->poolOnly) {
+		ret = gst_pad_alloc_buffer_and_set_caps(output->srcpad,
+			GST_BUFFER_OFFSET(inbuf), size, caps, outbuf);
+		if (ret == GST_FLOW_WRONG_STATE || ret == GST_FLOW_NOT_LINKED)
+			return ret;
+		if (ret == GST_FLOW_OK) {
+			if (GST_IS_SH_VIDEO_BUFFER(*outbuf)
+			    && GST_BUFFER_SIZE(*outbuf) >= size
+			    && GST_BUFFER_CAPS(*outbuf)
+			    && gst_caps_is_equal(GST_BUFFER_CAPS(*outbuf), caps))
+				return GST_FLOW_OK;
+			gst_buffer_unref(*outbuf);
+
+			/* Don't have downstream allocate a frame for nothing each time */
+			GST_DEBUG_OBJECT(output->srcpad, "downstream buffers not usable, using the pool");
+			output->poolOnly = TRUE;
+		}
+	}
+
+	if (output->pool
+	    && !gst_sh_video_buffer_pool_matches(output->pool,
+		output->dstWidth, output->dstHeight, output->dstColorSpace)) {
+		gst_sh_video_buffer_pool_free(output->pool);
+		output->pool = NULL;
+	}
+	if (!output->pool)
+		output->pool = gst_sh_video_buffer_pool_new(multiresize->uiomux,
+			output->dstWidth, output->dstHeight, output->dstColorSpace);
+
+	*outbuf = gst_sh_video_buffer_pool_get(output->pool);
+	if (*outbuf == NULL) {
+		GST_ELEMENT_ERROR(multiresize, RESOURCE, NO_SPACE_LEFT,
+			("failed to allocate output buffer"), (NULL));
+		return GST_FLOW_ERROR;
+	}
+
+	gst_buffer_set_caps(*outbuf, caps);
+
+	return GST_FLOW_OK;
+}
+
+/*
+ * Called from a VEU worker thread when an output has been scaled
+ */
+static void gst_shvidmultiresize_job_done (void *user_data, int ret)
+{
+	GstSHVidMultiresize *multiresize = user_data;
+
+	g_mutex_lock(multiresize->jobLock);
+	if (ret < 0)
+		multiresize->jobsFailed++;
+	if (--multiresize->jobsPending == 0)
+		g_cond_signal(multiresize->jobCond);
+	g_mutex_unlock(multiresize->jobLock);
+}
+
+/*
+ * Sink pad chain function. Queues a VEU job for each output, waits for them
+ * all and then pushes the outputs.
+ */
+static GstFlowReturn gst_shvidmultiresize_chain (GstPad *pad, GstBuffer *buf)
+{
+	GstSHVidMultiresize *multiresize = GST_SHVIDMULTIRESIZE(GST_OBJECT_PARENT(pad));
+	struct ren_vid_surface frame;
+	struct ren_vid_surface src;
+	struct ren_vid_surface dst;
+	GstPad **pads;
+	GstBuffer **bufs;
+	GstBuffer *outbuf;
+	GstFlowReturn ret = GST_FLOW_NOT_LINKED;
+	GstFlowReturn push_ret;
+	GList *walk;
+	gint nr_outputs = 0;
+	gint failed;
+	gint i;
+
+	g_mutex_lock(multiresize->lock);
+
+	gst_sh_video_buffer_get_surface(buf, multiresize->srcColorSpace,
+		multiresize->srcWidth, multiresize->srcHeight,
+		multiresize->srcPitch, multiresize->srcCOffset, &frame);
+
+	/* Only scale the visible area of the input */
+	get_sel_surface(&src, &frame, &multiresize->srcCrop);
+
+	pads = g_new0(GstPad *, g_list_length(multiresize->outputs));
+	bufs = g_new0(GstBuffer *, g_list_length(multiresize->outputs));
+
+	for (walk = multiresize->outputs; walk; walk = g_list_next(walk)) {
+		GstSHVidMultiresizeOutput *output = walk->data;
+		GstFlowReturn out_ret;
+
+		if (!gst_pad_is_linked(output->srcpad))
+			continue;
+
+		if (!output->dstWidth && !gst_shvidmultiresize_negotiate(multiresize, output)) {
+			GST_ELEMENT_ERROR(multiresize, CORE, NEGOTIATION,
+				("failed to negotiate output %s", GST_PAD_NAME(output->srcpad)), (NULL));
+			ret = GST_FLOW_NOT_NEGOTIATED;
+			break;
+		}
+
+		out_ret = gst_shvidmultiresize_get_buffer(multiresize, output, buf, &outbuf);
+		if (out_ret != GST_FLOW_OK) {
+			if (out_ret != GST_FLOW_NOT_LINKED)
+				ret = out_ret;
+			if (out_ret == GST_FLOW_WRONG_STATE || out_ret == GST_FLOW_NOT_LINKED)
+				continue;
+			break;
+		}
+
+		gst_sh_video_buffer_get_surface(outbuf, output->dstColorSpace,
+			output->dstWidth, output->dstHeight,
+			output->dstPitch, output->dstCOffset, &dst);
+
+		GST_LOG_OBJECT(output->srcpad, "scaling from %dx%d to %dx%d",
+			src.w, src.h, dst.w, dst.h);
+
+		g_mutex_lock(multiresize->jobLock);
+		multiresize->jobsPending++;
+		g_mutex_unlock(multiresize->jobLock);
+
+		if (veu_service_resize_async(multiresize->veu, &src, &dst, VEU_PRIORITY_NORMAL,
+			gst_shvidmultiresize_job_done, multiresize) < 0) {
+			gst_shvidmultiresize_job_done(multiresize, -1);
+			gst_buffer_unref(outbuf);
+			break;
+		}
+
+		pads[nr_outputs] = gst_object_ref(output->srcpad);
+		bufs[nr_outputs] = outbuf;
+		nr_outputs++;
+	}
+
+	g_mutex_unlock(multiresize->lock);
+
+	/* Wait for all the outputs, the input must stay valid until then */
+	g_mutex_lock(multiresize->jobLock);
+	while (multiresize->jobsPending > 0)
+		g_cond_wait(multiresize->jobCond, multiresize->jobLock);
+	failed = multiresize->jobsFailed;
+	multiresize->jobsFailed = 0;
+	g_mutex_unlock(multiresize->jobLock);
+
+	if (failed) {
+		GST_ELEMENT_ERROR(multiresize, RESOURCE, FAILED,
+			("failed to execute veu resize"), (NULL));
+		ret = GST_FLOW_ERROR;
+	}
+
+	/* Push the outputs, unless something went wrong */
+	for (i = 0; i < nr_outputs; i++) {
+		if (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED && ret != GST_FLOW_WRONG_STATE) {
+			gst_buffer_unref(bufs[i]);
+		} else {
+			gst_buffer_copy_metadata(bufs[i], buf, GST_BUFFER_COPY_TIMESTAMPS);
+			push_ret = gst_pad_push(pads[i], bufs[i]);
+
+			/* Like tee, fine while any output is linked */
+			if (push_ret == GST_FLOW_OK && ret == GST_FLOW_NOT_LINKED)
+				ret = GST_FLOW_OK;
+			else if (push_ret != GST_FLOW_OK && push_ret != GST_FLOW_NOT_LINKED)
+				ret = push_ret;
+		}
+		gst_object_unref(pads[i]);
+	}
+
+	g_free(pads);
+	g_free(bufs);
+	gst_buffer_unref(buf);
+
+	return ret;
+}
+
+static GstPad *gst_shvidmultiresize_request_new_pad (GstElement *element,
+	GstPadTemplate *templ, const gchar *unused)
+{
+	GstSHVidMultiresize *multiresize = GST_SHVIDMULTIRESIZE(element);
+	GstSHVidMultiresizeOutput *output;
+	GstPad *srcpad;
+	gchar *name;
+
+	if (templ->direction != GST_PAD_SRC) {
+		GST_WARNING("request pad that is not a SRC pad");
+		return NULL;
+	}
+
+	g_mutex_lock(multiresize->lock);
+	name = g_strdup_printf("src_%d", multiresize->nextPad++);
+	srcpad = gst_pad_new_from_template(templ, name);
+	g_free(name);
+
+	output = g_new0(GstSHVidMultiresizeOutput, 1);
+	output->srcpad = srcpad;
+	gst_pad_set_element_private(srcpad, output);
+	multiresize->outputs = g_list_append(multiresize->outputs, output);
+	g_mutex_unlock(multiresize->lock);
+
+	if (GST_STATE(element) > GST_STATE_READY)
+		gst_pad_set_active(srcpad, TRUE);
+
+	gst_element_add_pad(element, srcpad);
+
+	return srcpad;
+}
+
+static void gst_shvidmultiresize_free_output (GstSHVidMultiresizeOutput *output)
+{
+	gst_sh_video_buffer_pool_free(output->pool);
+	gst_pad_set_element_private(output->srcpad, NULL);
+	g_free(output);
+}
+
+static void gst_shvidmultiresize_release_pad (GstElement *element, GstPad *pad)
+{
+	GstSHVidMultiresize *multiresize = GST_SHVIDMULTIRESIZE(element);
+	GstSHVidMultiresizeOutput *output;
+
+	g_mutex_lock(multiresize->lock);
+	output = gst_pad_get_element_private(pad);
+	if (output) {
+		multiresize->outputs = g_list_remove(multiresize->outputs, output);
+		gst_shvidmultiresize_free_output(output);
+	}
+	g_mutex_unlock(multiresize->lock);
+
+	gst_element_remove_pad(element, pad);
+}
+
+/*
+ * GstElementClass::change_state
+ *    Opens the uiomux & VEU service when going to READY. The VEU service is
+ *    closed again when going back to NULL, the uiomux is kept for the
+ *    buffer pools.
+ */
+static GstStateChangeReturn gst_shvidmultiresize_change_state (GstElement *element,
+	GstStateChange transition)
+{
+	GstSHVidMultiresize *multiresize = GST_SHVIDMULTIRESIZE(element);
+	GstStateChangeReturn ret;
+
+	switch (transition) {
+	case GST_STATE_CHANGE_NULL_TO_READY:
+		if (!multiresize->uiomux)
+			multiresize->uiomux = uiomux_open();
+		if (!multiresize->uiomux) {
+			GST_ELEMENT_ERROR(multiresize, RESOURCE, OPEN_READ_WRITE,
+				("failed to open uiomux"), (NULL));
+			return GST_STATE_CHANGE_FAILURE;
+		}
+		if (!multiresize->veu)
+			multiresize->veu = veu_service_open();
+		if (!multiresize->veu) {
+			GST_ELEMENT_ERROR(multiresize, RESOURCE, OPEN_READ_WRITE,
+				("failed to open the VEU"), (NULL));
+			return GST_STATE_CHANGE_FAILURE;
+		}
+		break;
+	default:
+		break;
+	}
+
+	ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+	switch (transition) {
+	case GST_STATE_CHANGE_READY_TO_NULL:
+		if (multiresize->veu) {
+			veu_service_close(multiresize->veu);
+			multiresize->veu = NULL;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return ret;
+}
+
+/*
+ * GObjectClass::finalize
+ */
+static void gst_shvidmultiresize_finalize (GObject *object)
+{
+	GstSHVidMultiresize *multiresize = GST_SHVIDMULTIRESIZE(object);
+	GList *walk;
+
+	for (walk = multiresize->outputs; walk; walk = g_list_next(walk))
+		gst_shvidmultiresize_free_output(walk->data);
+	g_list_free(multiresize->outputs);
+	multiresize->outputs = NULL;
+
+	if (multiresize->veu) {
+		veu_service_close(multiresize->veu);
+		multiresize->veu = NULL;
+	}
+
+	if (multiresize->uiomux) {
+		uiomux_close(multiresize->uiomux);
+		multiresize->uiomux = NULL;
+	}
+
+	g_cond_free(multiresize->jobCond);
+	g_mutex_free(multiresize->jobLock);
+	g_mutex_free(multiresize->lock);
+
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+/*
+ * gst_shvidmultiresize_base_init
+ *    Initializes element base class.
+ */
+static void gst_shvidmultiresize_base_init(gpointer gclass)
+{
+	static GstElementDetails element_details = {
+		"SH video multi scale",
+		"Filter/Resize",
+		"Resize video to several sizes using VEU hardware resizer",
+		"Renesas"
+	};
+
+	GstElementClass *element_class = GST_ELEMENT_CLASS(gclass);
+
+	gst_element_class_add_pad_template(element_class,
+		gst_static_pad_template_get (&src_factory));
+	gst_element_class_add_pad_template(element_class,
+		gst_static_pad_template_get (&sink_factory));
+	gst_element_class_set_details(element_class, &element_details);
+}
+
+/*
+ * gst_shvidmultiresize_class_init
+ *    Initializes the SHVidMultiresize class.
+ */
+static void gst_shvidmultiresize_class_init(GstSHVidMultiresizeClass *klass)
+{
+	GObjectClass *gobject_class;
+	GstElementClass *element_class;
+
+	gobject_class    = (GObjectClass*) klass;
+	element_class    = (GstElementClass *) klass;
+
+	parent_class = g_type_class_peek_parent (klass);
+
+	gobject_class->finalize = GST_DEBUG_FUNCPTR(gst_shvidmultiresize_finalize);
+
+	element_class->change_state = GST_DEBUG_FUNCPTR(gst_shvidmultiresize_change_state);
+	element_class->request_new_pad = GST_DEBUG_FUNCPTR(gst_shvidmultiresize_request_new_pad);
+	element_class->release_pad = GST_DEBUG_FUNCPTR(gst_shvidmultiresize_release_pad);
+
+	GST_DEBUG_CATEGORY_INIT(gst_shvidmultiresize_debug,
+		"gst-sh-mobile-multiresize", 0, "SH Video Multi Resize");
+}
+
+/*
+ * gst_shvidmultiresize_init
+ */
+static void gst_shvidmultiresize_init (GstSHVidMultiresize *multiresize)
+{
+	multiresize->sinkpad = gst_pad_new_from_static_template(&sink_factory, "sink");
+	gst_pad_set_setcaps_function(multiresize->sinkpad,
+		GST_DEBUG_FUNCPTR(gst_shvidmultiresize_setcaps));
+	gst_pad_set_chain_function(multiresize->sinkpad,
+		GST_DEBUG_FUNCPTR(gst_shvidmultiresize_chain));
+	gst_element_add_pad(GST_ELEMENT(multiresize), multiresize->sinkpad);
+
+	multiresize->lock = g_mutex_new();
+	multiresize->jobLock = g_mutex_new();
+	multiresize->jobCond = g_cond_new();
+}
+
+/*
+ * gst_shvidmultiresize_get_type
+ *    Defines function pointers for initialization routines for this element.
+ */
+GType gst_shvidmultiresize_get_type(void)
+{
+	static GType object_type = 0;
+
+	if (G_UNLIKELY(object_type == 0)) {
+		static const GTypeInfo object_info = {
+			sizeof(GstSHVidMultiresizeClass),
+			gst_shvidmultiresize_base_init,
+			NULL,
+			(GClassInitFunc) gst_shvidmultiresize_class_init,
+			NULL,
+			NULL,
+			sizeof(GstSHVidMultiresize),
+			0,
+			(GInstanceInitFunc) gst_shvidmultiresize_init
+		};
+
+		object_type = g_type_register_static(GST_TYPE_ELEMENT,
+			"gst-sh-mobile-multiresize", &object_info, (GTypeFlags)0);
+	}
+
+	return object_type;
+}
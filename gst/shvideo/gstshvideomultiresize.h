@@ -0,0 +1,112 @@
+/**
+ * "gst-sh-mobile-multiresize" element. Scales one input to several outputs
+ * using the VEU hardware resizer (via libshveu).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_SHVIDMULTIRESIZE_H__
+#define __GST_SHVIDMULTIRESIZE_H__
+
+#include <gst/gst.h>
+
+#include <uiomux/uiomux.h>
+#include <shveu/shveu.h>
+
+#include "veusched.h"
+#include "gstshvideobuffer.h"
+
+G_BEGIN_DECLS
+
+/* Standard macros for manipulating SHVidMultiresize objects */
+#define GST_TYPE_SHVIDMULTIRESIZE \
+  (gst_shvidmultiresize_get_type())
+#define GST_SHVIDMULTIRESIZE(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_SHVIDMULTIRESIZE,GstSHVidMultiresize))
+#define GST_SHVIDMULTIRESIZE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_SHVIDMULTIRESIZE,GstSHVidMultiresizeClass))
+#define GST_IS_SHVIDMULTIRESIZE(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_SHVIDMULTIRESIZE))
+#define GST_IS_SHVIDMULTIRESIZE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_SHVIDMULTIRESIZE))
+
+typedef struct _GstSHVidMultiresize      GstSHVidMultiresize;
+typedef struct _GstSHVidMultiresizeClass GstSHVidMultiresizeClass;
+typedef struct _GstSHVidMultiresizeOutput GstSHVidMultiresizeOutput;
+
+/* One output, for each request src pad */
+struct _GstSHVidMultiresizeOutput
+{
+	GstPad            *srcpad;
+
+	/* Negotiated output, 0 size until negotiated */
+	gint              dstWidth;
+	gint              dstHeight;
+	int               dstColorSpace;
+	gint              dstPitch;
+	gint              dstCOffset;
+
+	/* Output buffers, when downstream doesn't provide them. Once downstream
+	   has given a buffer the VEU can't use, the pool is used until the
+	   output is negotiated again */
+	GstSHVideoBufferPool *pool;
+	gboolean          poolOnly;
+};
+
+/* _GstSHVidMultiresize object */
+struct _GstSHVidMultiresize
+{
+	/* GStreamer infrastructure */
+	GstElement        element;
+	GstPad            *sinkpad;
+
+	/* Protects the outputs */
+	GMutex            *lock;
+	GList             *outputs;
+	guint             nextPad;
+
+	/* Input */
+	gint              srcWidth;
+	gint              srcHeight;
+	int               srcColorSpace;
+	gint              srcPitch;
+	gint              srcCOffset;
+	struct ren_vid_rect srcCrop;
+	gint              fps_n;
+	gint              fps_d;
+
+	UIOMux           *uiomux;
+	VEU_SERVICE      *veu;
+
+	/* Completion of the jobs queued for a frame */
+	GMutex            *jobLock;
+	GCond             *jobCond;
+	gint              jobsPending;
+	gint              jobsFailed;
+};
+
+/* _GstSHVidMultiresizeClass object */
+struct _GstSHVidMultiresizeClass
+{
+	GstElementClass parent_class;
+};
+
+/* External function declarations */
+GType gst_shvidmultiresize_get_type(void);
+
+G_END_DECLS
+
+#endif /* __GST_SHVIDMULTIRESIZE_H__ */
@@ -15,6 +15,8 @@
  * - \subpage sink "gst-sh-mobile-sink - Image sink"
  * Optional elements:
  * - \subpage resize "gst-sh-mobile-resize - HW video resize/rotate"
+ * - gst-sh-mobile-multiresize - HW video resize to several outputs
+ * - gst-sh-mobile-simulcast-enc - HW encode of one input at several sizes
  * - \subpage mixer "gst-sh-mobile-mixer - HW video blend/overlay"
  *
  * This library is free software; you can redistribute it and/or
@@ -49,6 +51,8 @@
 #include "gstshv4l2src.h"
 #ifdef ENABLE_SCALE
 #include "gstshvideoresize.h"
+#include "gstshvideomultiresize.h"
+#include "gstshvideosimulcastenc.h"
 #endif
 #ifdef ENABLE_BLEND
 #include "shvideomixer.h"
@@ -81,6 +85,14 @@ gst_sh_video_plugin_init (GstPlugin * plugin)
 	if (!gst_element_register (plugin, "gst-sh-mobile-resize", GST_RANK_PRIMARY,
 		GST_TYPE_SHVIDRESIZE))
 	return FALSE;
+
+	if (!gst_element_register (plugin, "gst-sh-mobile-multiresize", GST_RANK_PRIMARY,
+		GST_TYPE_SHVIDMULTIRESIZE))
+	return FALSE;
+
+	if (!gst_element_register (plugin, "gst-sh-mobile-simulcast-enc", GST_RANK_PRIMARY,
+		GST_TYPE_SH_VIDEO_SIMULCAST_ENC))
+	return FALSE;
 #endif
 
 #ifdef ENABLE_BLEND
@@ -21,6 +21,66 @@
  *       "video/x-raw-yuv, format=(fourcc)NV12"
  *       "video/x-raw-yuv, format=(fourcc)NV16"
  *
+ * If the input caps carry crop-left/right/top/bottom fields (as the output of
+ * gst-sh-mobile-dec does), only the visible area of the input is scaled.
+ * Padded frames, described by pitch & chroma-offset fields in the caps or by
+ * the buffers themselves, are read & written in place.
+ *
+ * The crop-left/right/top/bottom properties select a region of the input to
+ * scale, on top of any crop in the caps. The crop & scale are done in one VEU
+ * pass, so there is no need for a videocrop element in front. The properties
+ * can be changed while playing, and are controllable, so a GstController can
+ * be used for smooth pan & zoom, e.g. a 2x digital zoom on the centre:
+ * \code
+ *     gst-launch \
+ *       v4l2src \
+ *       ! "video/x-raw-yuv, format=(fourcc)NV12, width=640, height=480" \
+ *       ! gst-sh-mobile-resize crop-left=160 crop-right=160 crop-top=120 crop-bottom=120 \
+ *       ! "video/x-raw-yuv, width=640, height=480" \
+ *       ! gst-sh-mobile-sink
+ * \endcode
+ * The crop is limited so that the region is at least 16x16.
+ *
+ * The VEU scales by up to 16 times in one pass. Larger changes of size, e.g.
+ * 1080p to a QCIF thumbnail, are done in several passes through intermediate
+ * buffers. To keep memory bandwidth down, the passes shrink as much as they
+ * can first when downscaling, and grow as little as they can first when
+ * upscaling, so the intermediate frames are as small as possible. They use
+ * the smaller of the input & output formats. The plan is shown in the debug
+ * output (GST_DEBUG=gst-sh-mobile-resize:4).
+ *
+ * The rotation (0, 90, 180 or 270 degrees clockwise) & flip (none, horizontal
+ * or vertical) properties turn the picture after it has been scaled, e.g. for
+ * a portrait panel:
+ * \code
+ *     gst-launch \
+ *       filesrc location=test.264 \
+ *       ! "video/x-h264, width=640, height=480, framerate=30/1" \
+ *       ! gst-sh-mobile-dec \
+ *       ! gst-sh-mobile-resize rotation=90 \
+ *       ! "video/x-raw-rgb, bpp=16, width=480, height=800" \
+ *       ! gst-sh-mobile-sink
+ * \endcode
+ * The flip is applied first. The VEU does a plain 90 degree rotation, when
+ * libshveu supports it; everything else is done by the CPU. A rotation can't be
+ * combined with scaling in one VEU pass, so the frame is scaled into an
+ * intermediate buffer first, unless the size & format don't change. NV16
+ * can only be rotated by 180 degrees, or by 90 degrees on the VEU.
+ *
+ * Output buffers are requested from downstream first, so that when the next
+ * element provides memory the VEU can use (e.g. gst-sh-mobile-enc or
+ * gst-sh-mobile-sink), frames are scaled straight into it. Otherwise they come
+ * from a pool that is kept while the output caps stay the same.
+ *
+ * By default each frame is scaled before the next input is accepted, so the
+ * streaming thread waits for the VEU. With async=true, the VEU job is queued
+ * and the element accepts the next input straight away; scaled frames are
+ * pushed in order from a separate thread. Up to max-jobs frames are in
+ * flight, which keeps the VEU busy (or several VEUs, see veusched.h) at the
+ * cost of that many extra buffers. Frames that need several passes or a
+ * rotation are still scaled synchronously, after the queued frames have been
+ * pushed.
+ *
  * Note: You cannot use filesrc to provide the raw yuv/rgb input
  * as filesrc allocates it own buffers containing pagesize bytes.
  *
@@ -50,12 +110,14 @@
 #include <gst/gst.h>
 #include <gst/video/video.h>
 #include <gst/base/gstbasetransform.h>
+#include <gst/controller/gstcontroller.h>
 
 #include <uiomux/uiomux.h>
 #include <shveu/shveu.h>
 
 #include "gstshvideoresize.h"
 #include "gstshvideobuffer.h"
+#include "rotate.h"
 
 /* Declare variable used to categorize GST_LOG output */
 GST_DEBUG_CATEGORY_STATIC (gst_shvidresize_debug);
@@ -66,6 +128,34 @@ GST_DEBUG_CATEGORY_STATIC (gst_shvidresize_debug);
 #define GST_VIDEO_SIZE_RANGE "(int) [ 16, 4092]"
 
 #define MAX_SCALE_FACTOR 16
+#define MIN_SIZE 16
+
+/* Scale factor used when planning passes, with a margin for rounding */
+#define PASS_SCALE_FACTOR (MAX_SCALE_FACTOR - 1)
+
+enum
+{
+	PROP_0,
+	PROP_CROP_LEFT,
+	PROP_CROP_RIGHT,
+	PROP_CROP_TOP,
+	PROP_CROP_BOTTOM,
+	PROP_ROTATION,
+	PROP_FLIP,
+	PROP_ASYNC,
+	PROP_MAX_JOBS
+};
+
+#define DEFAULT_MAX_JOBS 2
+
+/* A frame queued on the VEU in asynchronous mode */
+struct resize_job {
+	GstSHVidresize *vidresize;
+	GstBuffer *in;
+	GstBuffer *out;
+	int done;
+	int ret;
+};
 
 static void dbg(const char *str1, int l, const char *str2, const struct ren_vid_surface *s)
 {
@@ -154,18 +244,50 @@ static GstFlowReturn gst_shvidresize_prepare_output_buffer (GstBaseTransform
 	*trans, GstBuffer *inBuf, gint size, GstCaps *caps, GstBuffer **outBuf)
 {
 	GstSHVidresize *vidresize = GST_SHVIDRESIZE(trans);
+	GstFlowReturn ret;
 	gint width, height;
 	int format;
 
 	/* Get the width, height & format from the caps */
 	if (!get_spec(caps, &width, &height, &format)) {
 		GST_ERROR("Failed to get resolution");
-		return FALSE;
+		return GST_FLOW_NOT_NEGOTIATED;
 	}
 
 	GST_LOG("output size = %dx%d, format=%d", width, height, format);
 
-	*outBuf = gst_sh_video_buffer_new(vidresize->uiomux, width, height, format);
+	/* Scale straight into downstream's buffer if the VEU can use it, e.g.
+	   the encoder's input buffers */
+	if (!vidresize->poolOnly) {
+		ret = gst_pad_alloc_buffer_and_set_caps(trans->srcpad,
+			GST_BUFFER_OFFSET(inBuf), size, caps, outBuf);
+		if (ret == GST_FLOW_WRONG_STATE)
+			return ret;
+		if (ret == GST_FLOW_OK) {
+			if (GST_IS_SH_VIDEO_BUFFER(*outBuf)
+			    && GST_BUFFER_SIZE(*outBuf) >= (guint) size
+			    && GST_BUFFER_CAPS(*outBuf)
+			    && gst_caps_is_equal(GST_BUFFER_CAPS(*outBuf), caps)) {
+				GST_LOG("using buffer from downstream");
+				return GST_FLOW_OK;
+			}
+			gst_buffer_unref(*outBuf);
+
+			/* Don't have downstream allocate a frame for nothing each time */
+			GST_DEBUG_OBJECT(vidresize, "downstream buffers not usable, using the pool");
+			vidresize->poolOnly = TRUE;
+		}
+	}
+
+	if (vidresize->pool
+	    && !gst_sh_video_buffer_pool_matches(vidresize->pool, width, height, format)) {
+		gst_sh_video_buffer_pool_free(vidresize->pool);
+		vidresize->pool = NULL;
+	}
+	if (!vidresize->pool)
+		vidresize->pool = gst_sh_video_buffer_pool_new(vidresize->uiomux, width, height, format);
+
+	*outBuf = gst_sh_video_buffer_pool_get(vidresize->pool);
 
 	if (*outBuf == NULL) {
 		GST_ELEMENT_ERROR(vidresize, RESOURCE, NO_SPACE_LEFT,
@@ -182,6 +304,7 @@ static gboolean
 gst_shvidresize_get_unit_size (GstBaseTransform *trans, GstCaps *caps, guint *size)
 {
 	gint height, width;
+	gint pitch, c_offset;
 	int format;
 
 	if (!get_spec(caps, &width, &height, &format)) {
@@ -189,13 +312,402 @@ gst_shvidresize_get_unit_size (GstBaseTransform *trans, GstCaps *caps, guint *si
 		return FALSE;
 	}
 
-	*size = size_y(format, width*height) + size_c(format, width*height);
+	gst_sh_video_format_parse_layout(caps, &pitch, &c_offset);
+	*size = gst_sh_video_layout_get_size(format, height, pitch, c_offset);
 
 	GST_LOG("size=%d", *size);
 
 	return TRUE;
 }
 
+/*
+ * GstBaseTransformClass::transform_size
+ * The output size only depends on the output caps. Input buffers may be
+ * larger than a frame, e.g. when their chroma plane is aligned.
+ */
+static gboolean
+gst_shvidresize_transform_size (GstBaseTransform *trans, GstPadDirection direction,
+	GstCaps *caps, guint size, GstCaps *othercaps, guint *othersize)
+{
+	return gst_shvidresize_get_unit_size(trans, othercaps, othersize);
+}
+
+/*
+ * Get the area of the input to scale, i.e. the crop from the caps made
+ * smaller by the crop properties.
+ */
+static void gst_shvidresize_get_crop (GstSHVidresize *vidresize,
+	struct ren_vid_rect *crop)
+{
+	gint left, right, top, bottom;
+
+	*crop = vidresize->srcCrop;
+
+	GST_OBJECT_LOCK(vidresize);
+	left = vidresize->cropLeft;
+	right = vidresize->cropRight;
+	top = vidresize->cropTop;
+	bottom = vidresize->cropBottom;
+	GST_OBJECT_UNLOCK(vidresize);
+
+	if (!left && !right && !top && !bottom)
+		return;
+
+	/* Keep within the limits of the VEU */
+	left = MIN(left, MAX(crop->w - MIN_SIZE, 0));
+	right = MIN(right, MAX(crop->w - MIN_SIZE - left, 0));
+	top = MIN(top, MAX(crop->h - MIN_SIZE, 0));
+	bottom = MIN(bottom, MAX(crop->h - MIN_SIZE - top, 0));
+
+	/* Chroma is subsampled, so start on an even pixel */
+	left &= ~1;
+	top &= ~1;
+
+	crop->x += left;
+	crop->y += top;
+	crop->w -= left + right;
+	crop->h -= top + bottom;
+}
+
+/*
+ * Size of one side of the frame after a pass, when scaling from src to dst in
+ * nr_passes passes.
+ */
+static gint gst_shvidresize_pass_size (gint src, gint dst, int pass, int nr_passes)
+{
+	gint size = src;
+	int i;
+
+	if (pass == nr_passes - 1)
+		return dst;
+
+	if (dst < src) {
+		/* Shrink as much as possible in the early passes */
+		for (i = 0; i <= pass && size > dst; i++)
+			size = size / PASS_SCALE_FACTOR;
+		size = MAX(size, dst);
+	} else {
+		/* Grow as little as possible in the early passes */
+		size = dst;
+		for (i = pass + 1; i < nr_passes && size > src; i++)
+			size = (size + PASS_SCALE_FACTOR - 1) / PASS_SCALE_FACTOR;
+		size = MAX(size, src);
+	}
+
+	return MAX(GST_ROUND_UP_4(size), MIN_SIZE);
+}
+
+/*
+ * Plan the VEU passes needed to scale from the given input size to the
+ * given output size.
+ */
+static void gst_shvidresize_plan (GstSHVidresize *vidresize, gint width, gint height,
+	gint dst_width, gint dst_height)
+{
+	gint scale, w_scale, h_scale, limit;
+	int pass, nr_passes;
+	int format;
+	GString *plan;
+
+	/* Scale factor, rounded up */
+	w_scale = (MAX(width, dst_width) + MIN(width, dst_width) - 1)
+		/ MIN(width, dst_width);
+	h_scale = (MAX(height, dst_height) + MIN(height, dst_height) - 1)
+		/ MIN(height, dst_height);
+	scale = MAX(w_scale, h_scale);
+
+	nr_passes = 1;
+	for (limit = PASS_SCALE_FACTOR; limit < scale && nr_passes < MAX_PASSES; limit *= PASS_SCALE_FACTOR)
+		nr_passes++;
+
+	/* Intermediate frames use the smaller format */
+	format = vidresize->dstColorSpace;
+	if (size_y(vidresize->srcColorSpace, 16) + size_c(vidresize->srcColorSpace, 16)
+	    < size_y(format, 16) + size_c(format, 16))
+		format = vidresize->srcColorSpace;
+
+	vidresize->planWidth = width;
+	vidresize->planHeight = height;
+	vidresize->planDstWidth = dst_width;
+	vidresize->planDstHeight = dst_height;
+	vidresize->nrPasses = nr_passes;
+
+	plan = g_string_new(NULL);
+	g_string_append_printf(plan, "%dx%d", width, height);
+
+	for (pass = 0; pass < nr_passes; pass++) {
+		vidresize->passWidth[pass] = gst_shvidresize_pass_size(width, dst_width, pass, nr_passes);
+		vidresize->passHeight[pass] = gst_shvidresize_pass_size(height, dst_height, pass, nr_passes);
+		g_string_append_printf(plan, " -> %dx%d",
+			vidresize->passWidth[pass], vidresize->passHeight[pass]);
+
+		if (pass == nr_passes - 1)
+			break;
+
+		/* Pooled intermediate buffer */
+		if (vidresize->passPool[pass]
+		    && !gst_sh_video_buffer_pool_matches(vidresize->passPool[pass],
+			vidresize->passWidth[pass], vidresize->passHeight[pass], format)) {
+			gst_sh_video_buffer_pool_free(vidresize->passPool[pass]);
+			vidresize->passPool[pass] = NULL;
+		}
+		if (!vidresize->passPool[pass])
+			vidresize->passPool[pass] = gst_sh_video_buffer_pool_new(vidresize->uiomux,
+				vidresize->passWidth[pass], vidresize->passHeight[pass], format);
+	}
+
+	/* Drop intermediates that are no longer needed */
+	for (pass = nr_passes - 1; pass < MAX_PASSES - 1; pass++) {
+		if (vidresize->passPool[pass]) {
+			gst_sh_video_buffer_pool_free(vidresize->passPool[pass]);
+			vidresize->passPool[pass] = NULL;
+		}
+	}
+
+	GST_DEBUG_OBJECT(vidresize, "plan: %s in %d pass(es)", plan->str, nr_passes);
+	g_string_free(plan, TRUE);
+}
+
+/*
+ * Replan the passes if the input or output size has changed.
+ */
+static void gst_shvidresize_check_plan (GstSHVidresize *vidresize,
+	const struct ren_vid_surface *src, const struct ren_vid_surface *dst)
+{
+	if (src->w != vidresize->planWidth || src->h != vidresize->planHeight
+	    || dst->w != vidresize->planDstWidth || dst->h != vidresize->planDstHeight)
+		gst_shvidresize_plan(vidresize, src->w, src->h, dst->w, dst->h);
+}
+
+/*
+ * Wait until all queued frames have been pushed.
+ */
+static void gst_shvidresize_drain (GstSHVidresize *vidresize)
+{
+	g_mutex_lock(vidresize->jobLock);
+	while (vidresize->inFlight > 0)
+		g_cond_wait(vidresize->jobCond, vidresize->jobLock);
+	g_mutex_unlock(vidresize->jobLock);
+}
+
+/* Called from a VEU worker thread */
+static void gst_shvidresize_job_done (void *user_data, int ret)
+{
+	struct resize_job *job = user_data;
+	GstSHVidresize *vidresize = job->vidresize;
+
+	g_mutex_lock(vidresize->jobLock);
+	job->ret = ret;
+	job->done = 1;
+	g_cond_broadcast(vidresize->jobCond);
+	g_mutex_unlock(vidresize->jobLock);
+}
+
+/*
+ * Pusher thread. Pushes queued frames downstream in the order they were
+ * queued, as the VEU completes them.
+ */
+static gpointer gst_shvidresize_push_loop (gpointer data)
+{
+	GstSHVidresize *vidresize = data;
+	GstBaseTransform *trans = GST_BASE_TRANSFORM(vidresize);
+	struct resize_job *job;
+	GstFlowReturn ret;
+	gboolean discard;
+
+	g_mutex_lock(vidresize->jobLock);
+
+	while (1) {
+		/* Finish all queued jobs before stopping */
+		job = g_queue_peek_head(vidresize->jobs);
+		if (!job && vidresize->stopPusher)
+			break;
+		if (!job || !job->done) {
+			g_cond_wait(vidresize->jobCond, vidresize->jobLock);
+			continue;
+		}
+		g_queue_pop_head(vidresize->jobs);
+
+		discard = vidresize->flushing || vidresize->stopPusher
+			|| vidresize->pushRet != GST_FLOW_OK;
+		g_mutex_unlock(vidresize->jobLock);
+
+		gst_buffer_unref(job->in);
+		ret = GST_FLOW_OK;
+		if (discard) {
+			gst_buffer_unref(job->out);
+		} else if (job->ret < 0) {
+			GST_ELEMENT_ERROR(vidresize, RESOURCE, FAILED,
+				("failed to execute veu resize"), (NULL));
+			gst_buffer_unref(job->out);
+			ret = GST_FLOW_ERROR;
+		} else {
+			ret = gst_pad_push(trans->srcpad, job->out);
+		}
+		g_slice_free(struct resize_job, job);
+
+		g_mutex_lock(vidresize->jobLock);
+		if (ret != GST_FLOW_OK && !vidresize->flushing && vidresize->pushRet == GST_FLOW_OK)
+			vidresize->pushRet = ret;
+		vidresize->inFlight--;
+		g_cond_broadcast(vidresize->jobCond);
+	}
+
+	g_mutex_unlock(vidresize->jobLock);
+
+	return NULL;
+}
+
+/*
+ * Start the pusher thread, if it isn't running.
+ */
+static gboolean gst_shvidresize_start_pusher (GstSHVidresize *vidresize)
+{
+	if (vidresize->pusher)
+		return TRUE;
+
+	vidresize->stopPusher = FALSE;
+	vidresize->pusher = g_thread_create(gst_shvidresize_push_loop, vidresize, TRUE, NULL);
+	if (!vidresize->pusher) {
+		GST_ELEMENT_ERROR(vidresize, RESOURCE, FAILED,
+			("failed to start pusher thread"), (NULL));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Stop the pusher thread. Frames still queued are dropped once the VEU has
+ * finished with them.
+ */
+static void gst_shvidresize_stop_pusher (GstSHVidresize *vidresize)
+{
+	if (!vidresize->pusher)
+		return;
+
+	g_mutex_lock(vidresize->jobLock);
+	vidresize->stopPusher = TRUE;
+	g_cond_broadcast(vidresize->jobCond);
+	g_mutex_unlock(vidresize->jobLock);
+
+	g_thread_join(vidresize->pusher);
+	vidresize->pusher = NULL;
+}
+
+/*
+ * Queue a single pass scale on the VEU. The output buffer is pushed by the
+ * pusher thread once it is complete.
+ */
+static GstFlowReturn gst_shvidresize_scale_async (GstSHVidresize *vidresize,
+	GstBuffer *srcbuf, GstBuffer *dstbuf,
+	const struct ren_vid_surface *src, const struct ren_vid_surface *dst)
+{
+	struct resize_job *job;
+	GstFlowReturn ret;
+
+	/* async may have been turned on while running */
+	if (!gst_shvidresize_start_pusher(vidresize))
+		return GST_FLOW_ERROR;
+
+	g_mutex_lock(vidresize->jobLock);
+	while (vidresize->inFlight >= vidresize->maxJobs
+	       && !vidresize->flushing && vidresize->pushRet == GST_FLOW_OK)
+		g_cond_wait(vidresize->jobCond, vidresize->jobLock);
+
+	ret = vidresize->flushing ? GST_FLOW_WRONG_STATE : vidresize->pushRet;
+	if (ret != GST_FLOW_OK) {
+		g_mutex_unlock(vidresize->jobLock);
+		return ret;
+	}
+
+	job = g_slice_new0(struct resize_job);
+	job->vidresize = vidresize;
+	job->in = gst_buffer_ref(srcbuf);
+	job->out = gst_buffer_ref(dstbuf);
+	g_queue_push_tail(vidresize->jobs, job);
+	vidresize->inFlight++;
+	g_mutex_unlock(vidresize->jobLock);
+
+	if (veu_service_resize_async(vidresize->veu, src, dst, VEU_PRIORITY_NORMAL,
+	    gst_shvidresize_job_done, job) < 0)
+		gst_shvidresize_job_done(job, -1);
+
+	/* Our reference to the output is pushed later */
+	return GST_BASE_TRANSFORM_FLOW_DROPPED;
+}
+
+/*
+ * Scale a frame using the VEU, through intermediate buffers if the change of
+ * size is too large for one pass.
+ */
+static GstFlowReturn gst_shvidresize_scale (GstSHVidresize *vidresize,
+	const struct ren_vid_surface *src, const struct ren_vid_surface *dst)
+{
+	struct ren_vid_surface in;
+	struct ren_vid_surface out;
+	GstBuffer *inter[MAX_PASSES - 1] = { NULL };
+	GstFlowReturn ret = GST_FLOW_OK;
+	int pass;
+
+	in = *src;
+	for (pass = 0; pass < vidresize->nrPasses; pass++) {
+		if (pass == vidresize->nrPasses - 1) {
+			out = *dst;
+		} else {
+			inter[pass] = gst_sh_video_buffer_pool_get(vidresize->passPool[pass]);
+			if (!inter[pass]) {
+				GST_ELEMENT_ERROR(vidresize, RESOURCE, NO_SPACE_LEFT,
+					("failed to allocate intermediate buffer"), (NULL));
+				ret = GST_FLOW_ERROR;
+				break;
+			}
+
+			gst_sh_video_buffer_get_surface(inter[pass],
+				GST_SH_VIDEO_BUFFER(inter[pass])->format,
+				vidresize->passWidth[pass], vidresize->passHeight[pass],
+				0, 0, &out);
+		}
+
+		if (veu_service_resize(vidresize->veu, &in, &out, VEU_PRIORITY_NORMAL) < 0) {
+			GST_ELEMENT_ERROR(vidresize, RESOURCE, FAILED,
+				("failed to execute veu resize"), (NULL));
+			ret = GST_FLOW_ERROR;
+			break;
+		}
+
+		in = out;
+	}
+
+	for (pass = 0; pass < MAX_PASSES - 1; pass++) {
+		if (inter[pass])
+			gst_buffer_unref(inter[pass]);
+	}
+
+	return ret;
+}
+
+/*
+ * Rotate & flip a scaled frame into the output.
+ */
+static GstFlowReturn gst_shvidresize_rotate (GstSHVidresize *vidresize,
+	const struct ren_vid_surface *src, const struct ren_vid_surface *dst,
+	int rotation, int flip)
+{
+	/* The VEU can only do a plain 90 degree rotation */
+	if (rotation == ROTATE_90 && flip == FLIP_NONE
+	    && veu_service_rotate(vidresize->veu, src, dst, VEU_PRIORITY_NORMAL) == 0)
+		return GST_FLOW_OK;
+
+	if (rotate_surface(src, dst, rotation, flip) < 0) {
+		GST_ELEMENT_ERROR(vidresize, STREAM, FORMAT,
+			("failed to rotate frame"), (NULL));
+		return GST_FLOW_ERROR;
+	}
+
+	return GST_FLOW_OK;
+}
+
 /*
  * GstBaseTransformClass::transform
  * Required if the element does not operate in-place. Transforms one incoming
@@ -206,41 +718,123 @@ static GstFlowReturn gst_shvidresize_transform (GstBaseTransform *trans,
 	GstBuffer *srcbuf, GstBuffer *dstbuf)
 {
 	GstSHVidresize *vidresize = GST_SHVIDRESIZE(trans);
+	struct ren_vid_surface frame;
 	struct ren_vid_surface src;
 	struct ren_vid_surface dst;
+	struct ren_vid_surface scaled;
+	struct ren_vid_rect crop;
+	GstBuffer *rotbuf = NULL;
+	GstFlowReturn ret;
+	gint64 stream_time;
+	int rotation, flip;
+	gboolean async;
+
+	/* Update controlled properties */
+	stream_time = gst_segment_to_stream_time(&trans->segment, GST_FORMAT_TIME,
+		GST_BUFFER_TIMESTAMP(srcbuf));
+	if (GST_CLOCK_TIME_IS_VALID(stream_time))
+		gst_object_sync_values(G_OBJECT(vidresize), stream_time);
+
+	gst_shvidresize_get_crop(vidresize, &crop);
+
+	GST_OBJECT_LOCK(vidresize);
+	rotation = vidresize->rotation;
+	flip = vidresize->flip;
+	async = vidresize->async;
+	GST_OBJECT_UNLOCK(vidresize);
+
+	/* async has been turned off, push the queued frames & stop the pusher */
+	if (!async && vidresize->pusher) {
+		gst_shvidresize_drain(vidresize);
+		gst_shvidresize_stop_pusher(vidresize);
+	}
 
 	/* Create resize handle */
-	GST_LOG("scaling from %dx%d to %dx%d",
-		vidresize->srcWidth, vidresize->srcHeight,
+	GST_LOG("scaling from %dx%d at %d,%d to %dx%d",
+		crop.w, crop.h, crop.x, crop.y,
 		vidresize->dstWidth, vidresize->dstHeight);
 
-	src.format = vidresize->srcColorSpace;
-	src.w = vidresize->srcWidth;
-	src.h = vidresize->srcHeight;
-	src.pitch = src.w;
-	src.py = GST_BUFFER_DATA(srcbuf);
-	src.pc = src.py + size_y(src.format, src.pitch * src.h);
-	src.pa = NULL;
-
-	dst.format = vidresize->dstColorSpace;
-	dst.w = vidresize->dstWidth;
-	dst.h = vidresize->dstHeight;
-	dst.pitch = dst.w;
-	dst.py = GST_BUFFER_DATA(dstbuf);
-	dst.pc = dst.py + size_y(dst.format, dst.pitch * dst.h);
-	dst.pa = NULL;
+	gst_sh_video_buffer_get_surface(srcbuf, vidresize->srcColorSpace,
+		vidresize->srcWidth, vidresize->srcHeight,
+		vidresize->srcPitch, vidresize->srcCOffset, &frame);
+
+	/* Only scale the visible area of the input */
+	get_sel_surface(&src, &frame, &crop);
+
+	gst_sh_video_buffer_get_surface(dstbuf, vidresize->dstColorSpace,
+		vidresize->dstWidth, vidresize->dstHeight,
+		vidresize->dstPitch, vidresize->dstCOffset, &dst);
 
 	dbg(__func__, __LINE__, "src", &src);
 	dbg(__func__, __LINE__, "dst", &dst);
 
-	/* Use VEU to resize buffer */
-	if (shveu_resize(vidresize->veu, &src, &dst) < 0) {
-		GST_ELEMENT_ERROR(vidresize, RESOURCE, FAILED,
-			("failed to execute veu resize"), (NULL));
-		return GST_FLOW_ERROR;
+	if (rotation == ROTATE_0 && flip == FLIP_NONE) {
+		gst_shvidresize_check_plan(vidresize, &src, &dst);
+
+		if (async && vidresize->nrPasses == 1)
+			return gst_shvidresize_scale_async(vidresize, srcbuf, dstbuf, &src, &dst);
+
+		/* Keep the frames in order */
+		gst_shvidresize_drain(vidresize);
+
+		ret = gst_shvidresize_scale(vidresize, &src, &dst);
+		if (ret != GST_FLOW_OK)
+			return ret;
+
+		GST_LOG("scale complete");
+		return GST_FLOW_OK;
+	}
+
+	gst_shvidresize_drain(vidresize);
+
+	/* Size of the frame before it is rotated */
+	scaled = dst;
+	if (ROTATE_SWAPS_SIZE(rotation)) {
+		scaled.w = dst.h;
+		scaled.h = dst.w;
+	}
+
+	if (src.w == scaled.w && src.h == scaled.h && src.format == scaled.format) {
+		/* Nothing to scale, rotate straight from the input */
+		scaled = src;
+	} else {
+		if (vidresize->rotatePool
+		    && !gst_sh_video_buffer_pool_matches(vidresize->rotatePool,
+			scaled.w, scaled.h, scaled.format)) {
+			gst_sh_video_buffer_pool_free(vidresize->rotatePool);
+			vidresize->rotatePool = NULL;
+		}
+		if (!vidresize->rotatePool)
+			vidresize->rotatePool = gst_sh_video_buffer_pool_new(vidresize->uiomux,
+				scaled.w, scaled.h, scaled.format);
+
+		rotbuf = gst_sh_video_buffer_pool_get(vidresize->rotatePool);
+		if (!rotbuf) {
+			GST_ELEMENT_ERROR(vidresize, RESOURCE, NO_SPACE_LEFT,
+				("failed to allocate intermediate buffer"), (NULL));
+			return GST_FLOW_ERROR;
+		}
+
+		gst_sh_video_buffer_get_surface(rotbuf, scaled.format,
+			scaled.w, scaled.h, 0, 0, &scaled);
+
+		gst_shvidresize_check_plan(vidresize, &src, &scaled);
+		ret = gst_shvidresize_scale(vidresize, &src, &scaled);
+		if (ret != GST_FLOW_OK) {
+			gst_buffer_unref(rotbuf);
+			return ret;
+		}
 	}
 
-	GST_LOG("scale complete");
+	ret = gst_shvidresize_rotate(vidresize, &scaled, &dst, rotation, flip);
+
+	if (rotbuf)
+		gst_buffer_unref(rotbuf);
+
+	if (ret != GST_FLOW_OK)
+		return ret;
+
+	GST_LOG("scale & rotate complete");
 
 	return GST_FLOW_OK;
 }
@@ -258,13 +852,8 @@ static GstCaps *gst_shvidresize_transform_caps (GstBaseTransform *trans,
 	const GstCaps *templ;
 	GstStructure *structure;
 	int i, nr_caps;
-	int w, h;
 	int min = 16;
 	int max = 4092;
-	int w_min = min;
-	int w_max = max;
-	int h_min = min;
-	int h_max = max;
 
 	static const GstStaticCaps static_caps = GST_STATIC_CAPS (
 		GST_VIDEO_CAPS_YUV("NV12")";"
@@ -278,17 +867,9 @@ static GstCaps *gst_shvidresize_transform_caps (GstBaseTransform *trans,
 
 	GST_LOG("begin (%s)", direction==GST_PAD_SRC ? "src" : "sink");
 
-	/* Calculate scaling limits */
+	/* Any size can be reached, using several passes if need be */
 	structure = gst_caps_get_structure(caps, 0);
 	GST_LOG("input=%s", gst_structure_to_string(structure));
-	if (gst_structure_get_int(structure, "width", &w)) {
-		w_min = GST_ROUND_UP_4(w / MAX_SCALE_FACTOR);
-		w_max = GST_ROUND_UP_4(w * MAX_SCALE_FACTOR);
-	}
-	if (gst_structure_get_int(structure, "height", &h)) {
-		h_min = GST_ROUND_UP_4(h / MAX_SCALE_FACTOR);
-		h_max = GST_ROUND_UP_4(h * MAX_SCALE_FACTOR);
-	}
 
 	/* output caps */
 	to = gst_caps_copy( (const GstCaps *)gst_static_caps_get(&static_caps));
@@ -297,8 +878,8 @@ static GstCaps *gst_shvidresize_transform_caps (GstBaseTransform *trans,
 		structure = gst_caps_get_structure(to, i);
 
 		gst_structure_set(structure,
-			"width", GST_TYPE_INT_RANGE, w_min, w_max,
-			"height", GST_TYPE_INT_RANGE, h_min, h_max, NULL);
+			"width", GST_TYPE_INT_RANGE, min, max,
+			"height", GST_TYPE_INT_RANGE, min, max, NULL);
 	}
 
 	/* filter against set allowed caps on the pad */
@@ -315,36 +896,108 @@ static GstCaps *gst_shvidresize_transform_caps (GstBaseTransform *trans,
 	return ret;
 }
 
+/*
+ * The output size to aim for: the visible area of the input less the crop
+ * properties, turned by the rotation. Returns FALSE if the input size isn't
+ * fixed.
+ */
+static gboolean gst_shvidresize_target_size (GstCaps *caps, gint crop_w,
+	gint crop_h, int rotation, gint *width, gint *height)
+{
+	GstStructure *ins = gst_caps_get_structure (caps, 0);
+	struct ren_vid_rect crop;
+
+	if (!gst_structure_get_int (ins, "width", width)
+	    || !gst_structure_get_int (ins, "height", height))
+		return FALSE;
+
+	gst_sh_video_format_parse_crop (caps, &crop);
+	if (crop.w > 0 && crop.h > 0) {
+		*width = MAX(crop.w - crop_w, MIN_SIZE);
+		*height = MAX(crop.h - crop_h, MIN_SIZE);
+	}
+
+	/* A quarter turn swaps the sides */
+	if (ROTATE_SWAPS_SIZE(rotation)) {
+		gint tmp = *width;
+		*width = *height;
+		*height = tmp;
+	}
+
+	*width = GST_ROUND_UP_4(*width);
+	*height = GST_ROUND_UP_4(*height);
+
+	return TRUE;
+}
+
 static void
 gst_shvidresize_fixate_caps (GstBaseTransform * base, GstPadDirection direction,
     GstCaps * caps, GstCaps * othercaps)
 {
-	GstStructure *ins, *outs;
+	GstSHVidresize *vidresize = GST_SHVIDRESIZE(base);
+	GstStructure *outs;
+	gint crop_w, crop_h;
 	gint width, height;
+	int rotation;
 
 	g_return_if_fail (gst_caps_is_fixed (caps));
 
-	ins = gst_caps_get_structure (caps, 0);
 	outs = gst_caps_get_structure (othercaps, 0);
 
-	GST_LOG("caps=%s", gst_structure_to_string(ins));
+	GST_LOG("caps=%s", gst_structure_to_string(gst_caps_get_structure (caps, 0)));
 
-	if (gst_structure_get_int (ins, "width", &width)) {
-		if (gst_structure_has_field (outs, "width")) {
-			width = GST_ROUND_UP_4(width);
-			gst_structure_fixate_field_nearest_int (outs, "width", width);
-		}
-	}
-	if (gst_structure_get_int (ins, "height", &height)) {
-		if (gst_structure_has_field (outs, "height")) {
-			height = GST_ROUND_UP_4(height);
-			gst_structure_fixate_field_nearest_int (outs, "height", height);
-		}
+	GST_OBJECT_LOCK(vidresize);
+	crop_w = vidresize->cropLeft + vidresize->cropRight;
+	crop_h = vidresize->cropTop + vidresize->cropBottom;
+	rotation = vidresize->rotation;
+	GST_OBJECT_UNLOCK(vidresize);
+
+	/* Aim for the size of the visible area */
+	if (!gst_shvidresize_target_size(caps, crop_w, crop_h, rotation, &width, &height)) {
+		GST_LOG("input size not fixed");
+		return;
 	}
 
+	if (gst_structure_has_field (outs, "width"))
+		gst_structure_fixate_field_nearest_int (outs, "width", width);
+	if (gst_structure_has_field (outs, "height"))
+		gst_structure_fixate_field_nearest_int (outs, "height", height);
+
 	GST_LOG("othercaps=%s", gst_structure_to_string(outs));
 }
 
+/*
+ * Whether there is a crop, rotation or flip to do. Call with the object
+ * lock held.
+ */
+static gboolean gst_shvidresize_has_transform (GstSHVidresize *vidresize)
+{
+	return vidresize->cropLeft || vidresize->cropRight
+		|| vidresize->cropTop || vidresize->cropBottom
+		|| vidresize->rotation != ROTATE_0 || vidresize->flip != FLIP_NONE;
+}
+
+/*
+ * Pass buffers through only when the caps are the same on both sides and
+ * there is no crop, rotation or flip to do. Call without the object lock
+ * held.
+ */
+static void gst_shvidresize_update_passthrough (GstSHVidresize *vidresize,
+	GstCaps *in, GstCaps *out)
+{
+	gboolean same_caps;
+	gboolean transform;
+
+	GST_OBJECT_LOCK(vidresize);
+	transform = gst_shvidresize_has_transform(vidresize);
+	GST_OBJECT_UNLOCK(vidresize);
+
+	same_caps = in && out && gst_caps_is_equal(in, out);
+
+	gst_base_transform_set_passthrough(GST_BASE_TRANSFORM(vidresize),
+		same_caps && !transform);
+}
+
 /*
  * GstBaseTransformClass::set_caps
  * allows the subclass to be notified of the actual caps set.
@@ -354,6 +1007,9 @@ static gboolean gst_shvidresize_set_caps (GstBaseTransform *trans,
 {
 	GstSHVidresize *vidresize = GST_SHVIDRESIZE(trans);
 
+	/* Queued frames use the current plan & pools */
+	gst_shvidresize_drain(vidresize);
+
 	if (!get_spec(in, &vidresize->srcWidth, &vidresize->srcHeight, &vidresize->srcColorSpace)) {
 		GST_ERROR("Failed to get resolution");
 		return FALSE;
@@ -364,18 +1020,313 @@ static gboolean gst_shvidresize_set_caps (GstBaseTransform *trans,
 		return FALSE;
 	}
 
+	gst_sh_video_format_parse_layout(in, &vidresize->srcPitch, &vidresize->srcCOffset);
+	gst_sh_video_format_parse_layout(out, &vidresize->dstPitch, &vidresize->dstCOffset);
+
+	if (!gst_sh_video_format_parse_crop (in, &vidresize->srcCrop)) {
+		vidresize->srcCrop.x = 0;
+		vidresize->srcCrop.y = 0;
+		vidresize->srcCrop.w = vidresize->srcWidth;
+		vidresize->srcCrop.h = vidresize->srcHeight;
+	}
+
+	GST_LOG("input cropped to %dx%d at %d,%d",
+		vidresize->srcCrop.w, vidresize->srcCrop.h,
+		vidresize->srcCrop.x, vidresize->srcCrop.y);
+
+	/* Planned when the first frame is scaled, as the output size depends on
+	   the rotation */
+	vidresize->planWidth = 0;
+	vidresize->planHeight = 0;
+
+	/* Downstream may provide buffers for the new caps */
+	vidresize->poolOnly = FALSE;
+
+	/* Even with the same caps on both sides, a crop or rotation has to be done */
+	gst_shvidresize_update_passthrough(vidresize, in, out);
+
+	return TRUE;
+}
+
+static void gst_shvidresize_set_property(GObject *object, guint prop_id,
+	const GValue *value, GParamSpec *pspec)
+{
+	GstSHVidresize *vidresize = GST_SHVIDRESIZE(object);
+	GstBaseTransform *trans = GST_BASE_TRANSFORM(object);
+	GstCaps *in, *out;
+	gboolean changed = FALSE;
+	gint crop_w, crop_h, new_crop_w, new_crop_h;
+	int rotation, new_rotation;
+	gboolean transform, new_transform;
+	gint width, height, new_width, new_height;
+	gboolean resized;
+
+	GST_OBJECT_LOCK(vidresize);
+	crop_w = vidresize->cropLeft + vidresize->cropRight;
+	crop_h = vidresize->cropTop + vidresize->cropBottom;
+	rotation = vidresize->rotation;
+	transform = gst_shvidresize_has_transform(vidresize);
+
+	switch (prop_id) {
+	case PROP_CROP_LEFT:
+		changed = vidresize->cropLeft != g_value_get_int(value);
+		vidresize->cropLeft = g_value_get_int(value);
+		break;
+	case PROP_CROP_RIGHT:
+		changed = vidresize->cropRight != g_value_get_int(value);
+		vidresize->cropRight = g_value_get_int(value);
+		break;
+	case PROP_CROP_TOP:
+		changed = vidresize->cropTop != g_value_get_int(value);
+		vidresize->cropTop = g_value_get_int(value);
+		break;
+	case PROP_CROP_BOTTOM:
+		changed = vidresize->cropBottom != g_value_get_int(value);
+		vidresize->cropBottom = g_value_get_int(value);
+		break;
+	case PROP_ROTATION:
+		changed = vidresize->rotation != g_value_get_enum(value);
+		vidresize->rotation = g_value_get_enum(value);
+		break;
+	case PROP_FLIP:
+		changed = vidresize->flip != g_value_get_enum(value);
+		vidresize->flip = g_value_get_enum(value);
+		break;
+	case PROP_ASYNC:
+		vidresize->async = g_value_get_boolean(value);
+		GST_OBJECT_UNLOCK(vidresize);
+		return;
+	case PROP_MAX_JOBS:
+		/* Read by the streaming thread with the job lock held */
+		GST_OBJECT_UNLOCK(vidresize);
+		g_mutex_lock(vidresize->jobLock);
+		vidresize->maxJobs = g_value_get_int(value);
+		g_cond_broadcast(vidresize->jobCond);
+		g_mutex_unlock(vidresize->jobLock);
+		return;
+	default:
+		GST_OBJECT_UNLOCK(vidresize);
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		return;
+	}
+
+	new_crop_w = vidresize->cropLeft + vidresize->cropRight;
+	new_crop_h = vidresize->cropTop + vidresize->cropBottom;
+	new_rotation = vidresize->rotation;
+	new_transform = gst_shvidresize_has_transform(vidresize);
+	GST_OBJECT_UNLOCK(vidresize);
+
+	/* Before negotiation, the new values are picked up by set_caps */
+	if (!changed)
+		return;
+	in = gst_pad_get_negotiated_caps(trans->sinkpad);
+	if (!in)
+		return;
+
+	/* transform reads the crop & rotation for each frame, e.g. a pan under
+	   a controller. Only a new output size, or turning passthrough on or
+	   off, needs the caps to be negotiated again */
+	resized = gst_shvidresize_target_size(in, crop_w, crop_h, rotation, &width, &height)
+		&& gst_shvidresize_target_size(in, new_crop_w, new_crop_h, new_rotation,
+			&new_width, &new_height)
+		&& (width != new_width || height != new_height);
+
+	if (new_transform != transform) {
+		out = gst_pad_get_negotiated_caps(trans->srcpad);
+		gst_shvidresize_update_passthrough(vidresize, in, out);
+		if (out)
+			gst_caps_unref(out);
+	}
+	gst_caps_unref(in);
+
+	if (resized || new_transform != transform)
+		gst_base_transform_reconfigure(trans);
+}
+
+static void gst_shvidresize_get_property(GObject *object, guint prop_id,
+	GValue *value, GParamSpec *pspec)
+{
+	GstSHVidresize *vidresize = GST_SHVIDRESIZE(object);
+
+	GST_OBJECT_LOCK(vidresize);
+	switch (prop_id) {
+	case PROP_CROP_LEFT:
+		g_value_set_int(value, vidresize->cropLeft);
+		break;
+	case PROP_CROP_RIGHT:
+		g_value_set_int(value, vidresize->cropRight);
+		break;
+	case PROP_CROP_TOP:
+		g_value_set_int(value, vidresize->cropTop);
+		break;
+	case PROP_CROP_BOTTOM:
+		g_value_set_int(value, vidresize->cropBottom);
+		break;
+	case PROP_ROTATION:
+		g_value_set_enum(value, vidresize->rotation);
+		break;
+	case PROP_FLIP:
+		g_value_set_enum(value, vidresize->flip);
+		break;
+	case PROP_ASYNC:
+		g_value_set_boolean(value, vidresize->async);
+		break;
+	case PROP_MAX_JOBS:
+		g_value_set_int(value, vidresize->maxJobs);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		break;
+	}
+	GST_OBJECT_UNLOCK(vidresize);
+}
+
+/*
+ * GstBaseTransformClass::event
+ * Frames queued in asynchronous mode are pushed before any serialized event,
+ * and dropped on a flush.
+ */
+static gboolean gst_shvidresize_event (GstBaseTransform *trans, GstEvent *event)
+{
+	GstSHVidresize *vidresize = GST_SHVIDRESIZE(trans);
+
+	switch (GST_EVENT_TYPE(event)) {
+	case GST_EVENT_FLUSH_START:
+		g_mutex_lock(vidresize->jobLock);
+		vidresize->flushing = TRUE;
+		g_cond_broadcast(vidresize->jobCond);
+		g_mutex_unlock(vidresize->jobLock);
+		break;
+	case GST_EVENT_FLUSH_STOP:
+		g_mutex_lock(vidresize->jobLock);
+		while (vidresize->inFlight > 0)
+			g_cond_wait(vidresize->jobCond, vidresize->jobLock);
+		vidresize->flushing = FALSE;
+		vidresize->pushRet = GST_FLOW_OK;
+		g_mutex_unlock(vidresize->jobLock);
+		break;
+	default:
+		if (GST_EVENT_IS_SERIALIZED(event))
+			gst_shvidresize_drain(vidresize);
+		break;
+	}
+
+	return GST_BASE_TRANSFORM_CLASS(parent_class)->event(trans, event);
+}
+
+/*
+ * GstBaseTransformClass::start
+ */
+static gboolean gst_shvidresize_start (GstBaseTransform *trans)
+{
+	GstSHVidresize *vidresize = GST_SHVIDRESIZE(trans);
+	gboolean async;
+
+	vidresize->flushing = FALSE;
+	vidresize->pushRet = GST_FLOW_OK;
+
+	GST_OBJECT_LOCK(vidresize);
+	async = vidresize->async;
+	GST_OBJECT_UNLOCK(vidresize);
+
+	/* Otherwise started when async is turned on */
+	if (async)
+		return gst_shvidresize_start_pusher(vidresize);
+
+	return TRUE;
+}
+
+/*
+ * GstBaseTransformClass::stop
+ *    Drop queued frames once the VEU has finished with them.
+ */
+static gboolean gst_shvidresize_stop (GstBaseTransform *trans)
+{
+	GstSHVidresize *vidresize = GST_SHVIDRESIZE(trans);
+
+	gst_shvidresize_stop_pusher(vidresize);
+	vidresize->poolOnly = FALSE;
+
 	return TRUE;
 }
 
+/*
+ * GstElementClass::change_state
+ *    Opens the uiomux & VEU service when going to READY. The VEU service is
+ *    closed again when going back to NULL, the uiomux is kept for the
+ *    buffer pools.
+ */
+static GstStateChangeReturn gst_shvidresize_change_state (GstElement *element,
+	GstStateChange transition)
+{
+	GstSHVidresize *vidresize = GST_SHVIDRESIZE(element);
+	GstStateChangeReturn ret;
+
+	switch (transition) {
+	case GST_STATE_CHANGE_NULL_TO_READY:
+		if (!vidresize->uiomux)
+			vidresize->uiomux = uiomux_open();
+		if (!vidresize->uiomux) {
+			GST_ELEMENT_ERROR(vidresize, RESOURCE, OPEN_READ_WRITE,
+				("failed to open uiomux"), (NULL));
+			return GST_STATE_CHANGE_FAILURE;
+		}
+		if (!vidresize->veu)
+			vidresize->veu = veu_service_open();
+		if (!vidresize->veu) {
+			GST_ELEMENT_ERROR(vidresize, RESOURCE, OPEN_READ_WRITE,
+				("failed to open the VEU"), (NULL));
+			return GST_STATE_CHANGE_FAILURE;
+		}
+		break;
+	default:
+		break;
+	}
+
+	ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+	switch (transition) {
+	case GST_STATE_CHANGE_READY_TO_NULL:
+		if (vidresize->veu) {
+			veu_service_close(vidresize->veu);
+			vidresize->veu = NULL;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return ret;
+}
+
 /*
  * GObjectClass::finalize
  *    Shut down any running video resize, and reset the element state.
  */
 static gboolean gst_shvidresize_exit_resize(GstSHVidresize *vidresize)
 {
+	int pass;
+
 	/* Shut down remaining items */
+	if (vidresize->pool) {
+		gst_sh_video_buffer_pool_free(vidresize->pool);
+		vidresize->pool = NULL;
+	}
+
+	for (pass = 0; pass < MAX_PASSES - 1; pass++) {
+		if (vidresize->passPool[pass]) {
+			gst_sh_video_buffer_pool_free(vidresize->passPool[pass]);
+			vidresize->passPool[pass] = NULL;
+		}
+	}
+
+	if (vidresize->rotatePool) {
+		gst_sh_video_buffer_pool_free(vidresize->rotatePool);
+		vidresize->rotatePool = NULL;
+	}
+
 	if (vidresize->veu) {
-		shveu_close(vidresize->veu);
+		veu_service_close(vidresize->veu);
 		vidresize->veu = NULL;
 	}
 
@@ -384,6 +1335,19 @@ static gboolean gst_shvidresize_exit_resize(GstSHVidresize *vidresize)
 		vidresize->uiomux = NULL;
 	}
 
+	if (vidresize->jobs) {
+		g_queue_free(vidresize->jobs);
+		vidresize->jobs = NULL;
+	}
+	if (vidresize->jobCond) {
+		g_cond_free(vidresize->jobCond);
+		vidresize->jobCond = NULL;
+	}
+	if (vidresize->jobLock) {
+		g_mutex_free(vidresize->jobLock);
+		vidresize->jobLock = NULL;
+	}
+
 	return TRUE;
 }
 
@@ -416,20 +1380,70 @@ static void gst_shvidresize_base_init(gpointer gclass)
 static void gst_shvidresize_class_init(GstSHVidresizeClass *klass)
 {
 	GObjectClass *gobject_class;
+	GstElementClass *element_class;
 	GstBaseTransformClass *trans_class;
 
 	gobject_class    = (GObjectClass*) klass;
+	element_class    = (GstElementClass *) klass;
 	trans_class      = (GstBaseTransformClass *) klass;
 
 	gobject_class->finalize = (GObjectFinalizeFunc)gst_shvidresize_exit_resize;
+	gobject_class->set_property = gst_shvidresize_set_property;
+	gobject_class->get_property = gst_shvidresize_get_property;
+
+	g_object_class_install_property(gobject_class, PROP_CROP_LEFT,
+		g_param_spec_int("crop-left", "Crop left",
+			"Pixels to crop from the left of the input",
+			0, G_MAXINT, 0,
+			G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_CROP_RIGHT,
+		g_param_spec_int("crop-right", "Crop right",
+			"Pixels to crop from the right of the input",
+			0, G_MAXINT, 0,
+			G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_CROP_TOP,
+		g_param_spec_int("crop-top", "Crop top",
+			"Pixels to crop from the top of the input",
+			0, G_MAXINT, 0,
+			G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_CROP_BOTTOM,
+		g_param_spec_int("crop-bottom", "Crop bottom",
+			"Pixels to crop from the bottom of the input",
+			0, G_MAXINT, 0,
+			G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_ROTATION,
+		g_param_spec_enum("rotation", "Rotation",
+			"Clockwise rotation of the output",
+			GST_TYPE_SH_VIDEO_ROTATION, ROTATE_0,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_FLIP,
+		g_param_spec_enum("flip", "Flip",
+			"Flip of the output, applied before the rotation",
+			GST_TYPE_SH_VIDEO_FLIP, FLIP_NONE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_ASYNC,
+		g_param_spec_boolean("async", "Asynchronous",
+			"Accept the next frame while the VEU scales the last one",
+			FALSE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_MAX_JOBS,
+		g_param_spec_int("max-jobs", "Maximum jobs",
+			"Most frames being scaled at once in asynchronous mode",
+			1, 16, DEFAULT_MAX_JOBS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
 	trans_class->transform_caps = GST_DEBUG_FUNCPTR(gst_shvidresize_transform_caps);
 	trans_class->fixate_caps    = GST_DEBUG_FUNCPTR(gst_shvidresize_fixate_caps);
 	trans_class->set_caps       = GST_DEBUG_FUNCPTR(gst_shvidresize_set_caps);
 	trans_class->transform      = GST_DEBUG_FUNCPTR(gst_shvidresize_transform);
 	trans_class->get_unit_size  = GST_DEBUG_FUNCPTR(gst_shvidresize_get_unit_size);
+	trans_class->transform_size = GST_DEBUG_FUNCPTR(gst_shvidresize_transform_size);
 	trans_class->prepare_output_buffer = GST_DEBUG_FUNCPTR(gst_shvidresize_prepare_output_buffer);
+	trans_class->event          = GST_DEBUG_FUNCPTR(gst_shvidresize_event);
+	trans_class->start          = GST_DEBUG_FUNCPTR(gst_shvidresize_start);
+	trans_class->stop           = GST_DEBUG_FUNCPTR(gst_shvidresize_stop);
 	trans_class->passthrough_on_same_caps = TRUE;
+	element_class->change_state = GST_DEBUG_FUNCPTR(gst_shvidresize_change_state);
 	parent_class = g_type_class_peek_parent (klass);
 
 	GST_DEBUG_CATEGORY_INIT(gst_shvidresize_debug,
@@ -441,9 +1455,10 @@ static void gst_shvidresize_class_init(GstSHVidresizeClass *klass)
  */
 static void gst_shvidresize_init (GstSHVidresize *vidresize)
 {
-	// TODO add fail checks
-	vidresize->uiomux = uiomux_open();
-	vidresize->veu = shveu_open_named("VEU");
+	vidresize->maxJobs = DEFAULT_MAX_JOBS;
+	vidresize->jobLock = g_mutex_new();
+	vidresize->jobCond = g_cond_new();
+	vidresize->jobs = g_queue_new();
 }
 
 /*
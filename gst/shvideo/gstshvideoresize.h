@@ -27,8 +27,14 @@
 #include <uiomux/uiomux.h>
 #include <shveu/shveu.h>
 
+#include "veusched.h"
+#include "gstshvideobuffer.h"
+
 G_BEGIN_DECLS
 
+/* Most VEU passes used for one frame */
+#define MAX_PASSES 3
+
 /* Standard macros for manipulating SHVidresize objects */
 #define GST_TYPE_SHVIDRESIZE \
   (gst_shvidresize_get_type())
@@ -59,8 +65,58 @@ struct _GstSHVidresize
 	gint              dstHeight;
 	int               srcColorSpace;
 	int               dstColorSpace;
+	struct ren_vid_rect srcCrop;
 	UIOMux           *uiomux;
-	SHVEU            *veu;
+
+	/* Plane layout from the caps */
+	gint              srcPitch;
+	gint              srcCOffset;
+	gint              dstPitch;
+	gint              dstCOffset;
+
+	/* Crop properties, applied inside the crop from the caps */
+	gint              cropLeft;
+	gint              cropRight;
+	gint              cropTop;
+	gint              cropBottom;
+
+	/* Rotation & flip properties, see rotate.h */
+	int               rotation;
+	int               flip;
+
+	VEU_SERVICE      *veu;
+
+	/* Output buffers, when downstream doesn't provide them. Once downstream
+	   has given a buffer the VEU can't use, the pool is used until the caps
+	   change */
+	GstSHVideoBufferPool *pool;
+	gboolean          poolOnly;
+
+	/* Passes planned for an input & output size, & their intermediate buffers */
+	gint              planWidth;
+	gint              planHeight;
+	gint              planDstWidth;
+	gint              planDstHeight;
+	int               nrPasses;
+	gint              passWidth[MAX_PASSES];
+	gint              passHeight[MAX_PASSES];
+	GstSHVideoBufferPool *passPool[MAX_PASSES - 1];
+
+	/* Scaled frame, before it is rotated into the output */
+	GstSHVideoBufferPool *rotatePool;
+
+	/* Asynchronous mode. Frames being scaled are queued in order, and
+	   pushed by the pusher thread as they complete */
+	gboolean          async;
+	gint              maxJobs;
+	GMutex            *jobLock;
+	GCond             *jobCond;
+	GQueue            *jobs;
+	gint              inFlight;
+	gboolean          flushing;
+	gboolean          stopPusher;
+	GstFlowReturn     pushRet;
+	GThread           *pusher;
 };
 
 /* _GstSHVidresizeClass object */
@@ -0,0 +1,1065 @@
+/**
+ * "gst-sh-mobile-simulcast-enc" element. Encodes one input at several sizes,
+ * e.g. for adaptive bitrate streaming.
+ *
+ * Each request src pad is a rendition. Its size and stream type (H.264 or
+ * MPEG-4) are set by the element downstream of it (e.g. a capsfilter). For
+ * every input frame, the input is scaled once for each rendition by the VEU
+ * into a pooled encoder input, with the jobs for all renditions queued on the
+ * shared VEU service back to back. Each rendition then encodes its frame with
+ * its own libshcodecs encoder. The encoders take turns on the VPU, frame by
+ * frame, through the shared VPU scheduler, so other encoders & decoders can
+ * run in between. The encoded data is pushed once the VPU has been released.
+ *
+ * A rendition the same size as the input encodes the input buffer directly,
+ * when the VPU can read it.
+ *
+ * All renditions use the same I frame interval, and frame skipping is turned
+ * off, so the I frames of all renditions are on the same input frames, and
+ * the outputs can be segmented at the same points. Frames that are not I
+ * frames (IDR or I slices) are marked with GST_BUFFER_FLAG_DELTA_UNIT.
+ *
+ * The bitrate of each rendition is the "bitrate" field of its caps, if set,
+ * otherwise the "bitrate" property scaled by the number of pixels in the
+ * rendition relative to the input.
+ *
+ * Example usage, encoding a camera at three sizes:
+ * \code
+ *     gst-launch \
+ *       v4l2src ! "video/x-raw-yuv, format=(fourcc)NV12, width=1280, height=720, framerate=30/1" \
+ *       ! gst-sh-mobile-simulcast-enc name=enc bitrate=4000000 i-vop-interval=60 \
+ *       enc. ! "video/x-h264, width=1280, height=720" ! queue ! filesink location=hd.264 \
+ *       enc. ! "video/x-h264, width=640, height=360, bitrate=(int)800000" ! queue ! filesink location=sd.264 \
+ *       enc. ! "video/x-h264, width=320, height=180, bitrate=(int)250000" ! queue ! filesink location=ld.264
+ * \endcode
+ *
+ * H.264 is output as an Annex B byte stream, with the SPS and PPS in the
+ * stream.
+ *
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include <uiomux/uiomux.h>
+#include <shveu/shveu.h>
+#include <shcodecs/shcodecs_encoder.h>
+
+#include "gstshvideosimulcastenc.h"
+#include "gstshvideobuffer.h"
+#include "gstshencdefaults.h"
+
+/* Declare variable used to categorize GST_LOG output */
+GST_DEBUG_CATEGORY_STATIC (gst_sh_video_simulcast_enc_debug);
+#define GST_CAT_DEFAULT gst_sh_video_simulcast_enc_debug
+
+/* Use our size range. This will be expanded in GST_VIDEO_CAPS_* */
+#undef GST_VIDEO_SIZE_RANGE
+#define GST_VIDEO_SIZE_RANGE "(int) [ 16, 4092]"
+
+#define MAX_SCALE_FACTOR 16
+
+/* Smallest bitrate given to a rendition, when scaled from the property */
+#define MIN_BITRATE 64000
+
+enum
+{
+	PROP_0,
+	PROP_BITRATE,
+	PROP_I_VOP_INTERVAL,
+	PROP_VPU_PRIORITY
+};
+
+static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE(
+	"sink",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS (
+		GST_VIDEO_CAPS_YUV("NV12")
+	)
+);
+
+static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE(
+	"src_%d",
+	GST_PAD_SRC,
+	GST_PAD_REQUEST,
+	GST_STATIC_CAPS (
+		"video/x-h264,"
+		"width  = (int) [48, 1280],"
+		"height = (int) [48, 720],"
+		"framerate = (fraction) [0, 30]"
+		"; "
+		"video/mpeg,"
+		"width  = (int) [48, 1280],"
+		"height = (int) [48, 720],"
+		"framerate = (fraction) [0, 30],"
+		"mpegversion = (int) 4"
+	)
+);
+
+/* Declare a global pointer to our element base class */
+static GstElementClass *parent_class = NULL;
+
+
+/*
+ * Sink pad setcaps function. Renditions are negotiated again with the next
+ * frame.
+ */
+static gboolean gst_sh_video_simulcast_enc_setcaps (GstPad *pad, GstCaps *caps)
+{
+	GstSHVideoSimulcastEnc *simulcast = GST_SH_VIDEO_SIMULCAST_ENC(GST_OBJECT_PARENT(pad));
+	GstStructure *structure;
+	GList *walk;
+	gint width, height;
+
+	structure = gst_caps_get_structure(caps, 0);
+
+	if (!gst_structure_get_int(structure, "width", &width)
+	    || !gst_structure_get_int(structure, "height", &height)) {
+		GST_ERROR("Failed to get resolution");
+		return FALSE;
+	}
+
+	if (!gst_structure_get_fraction(structure, "framerate",
+		&simulcast->fps_n, &simulcast->fps_d) || simulcast->fps_n == 0) {
+		GST_ERROR("Failed to get framerate");
+		return FALSE;
+	}
+
+	g_mutex_lock(simulcast->lock);
+
+	simulcast->srcWidth = width;
+	simulcast->srcHeight = height;
+	gst_sh_video_format_parse_layout(caps, &simulcast->srcPitch, &simulcast->srcCOffset);
+
+	for (walk = simulcast->renditions; walk; walk = g_list_next(walk)) {
+		GstSHVideoSimulcastRendition *rendition = walk->data;
+		rendition->width = 0;
+		rendition->height = 0;
+	}
+
+	g_mutex_unlock(simulcast->lock);
+
+	GST_LOG("input %dx%d, %d/%d fps", width, height, simulcast->fps_n, simulcast->fps_d);
+
+	return TRUE;
+}
+
+/*
+ * Called by libshcodecs with encoded data. Collects the data for a frame,
+ * which is pushed once the VPU has been released.
+ */
+static int gst_sh_video_simulcast_enc_write_output (SHCodecs_Encoder *encoder,
+	unsigned char *data, int length, void *user_data)
+{
+	GstSHVideoSimulcastRendition *rendition = user_data;
+	GstBuffer *buf;
+
+	if (length <= 0)
+		return 0;
+
+	buf = gst_buffer_new_and_alloc(length);
+	memcpy(GST_BUFFER_DATA(buf), data, length);
+
+	if (rendition->partial)
+		buf = gst_buffer_join(rendition->partial, buf);
+	rendition->partial = NULL;
+
+	if (shcodecs_encoder_get_frame_num_delta(encoder) > 0) {
+		/* Frame skipping is off, so this is the frame being encoded */
+		gst_buffer_copy_metadata(buf, rendition->input, GST_BUFFER_COPY_TIMESTAMPS);
+		g_queue_push_tail(rendition->encoded, buf);
+	} else {
+		/* partial data, e.g. AUD, so collect into one buffer */
+		rendition->partial = buf;
+	}
+
+	return 0;
+}
+
+/*
+ * Called by libshcodecs when it has finished reading an input frame
+ */
+static int gst_sh_video_simulcast_enc_input_release (SHCodecs_Encoder *encoder,
+	unsigned char *y_input, unsigned char *c_input, void *user_data)
+{
+	GstSHVideoSimulcastRendition *rendition = user_data;
+	GList *l;
+
+	for (l = rendition->inUse->head; l; l = l->next) {
+		GstBuffer *buf = GST_BUFFER(l->data);
+
+		if (y_input >= GST_BUFFER_DATA(buf)
+		    && y_input < GST_BUFFER_DATA(buf) + GST_BUFFER_SIZE(buf)) {
+			g_queue_delete_link(rendition->inUse, l);
+			gst_buffer_unref(buf);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Read an unsigned Exp-Golomb code from a slice header, returns -1 if it runs
+ * past the end. Emulation prevention bytes can't occur this early.
+ */
+static gint gst_sh_video_simulcast_enc_read_ue (const guint8 *data, guint size,
+	guint *bit)
+{
+	gint zeros = 0;
+	gint value = 1;
+
+	while (*bit < size * 8 && !(data[*bit / 8] & (0x80 >> (*bit % 8)))) {
+		zeros++;
+		(*bit)++;
+	}
+	if (zeros > 16 || *bit + zeros >= size * 8)
+		return -1;
+	(*bit)++;
+
+	while (zeros--) {
+		value = (value << 1) | !!(data[*bit / 8] & (0x80 >> (*bit % 8)));
+		(*bit)++;
+	}
+
+	return value - 1;
+}
+
+/*
+ * Check if an encoded frame is an I frame. For H.264 that is an IDR, or a
+ * non-IDR picture of I (or SI) slices, as the regularly inserted I pictures
+ * may be either, depending on the encoder setup.
+ */
+static gboolean gst_sh_video_simulcast_enc_is_keyframe (SHCodecs_Format format,
+	GstBuffer *buf)
+{
+	guint8 *data = GST_BUFFER_DATA(buf);
+	guint size = GST_BUFFER_SIZE(buf);
+	guint i;
+
+	for (i = 0; i + 4 < size; i++) {
+		if (data[i] != 0 || data[i+1] != 0 || data[i+2] != 1)
+			continue;
+
+		if (format == SHCodecs_Format_H264) {
+			/* The first slice: IDR, or the type of a non-IDR slice */
+			if ((data[i+3] & 0x1f) == 5)
+				return TRUE;
+			if ((data[i+3] & 0x1f) == 1) {
+				guint bit = 0;
+				gint slice_type;
+
+				/* first_mb_in_slice, then slice_type */
+				if (gst_sh_video_simulcast_enc_read_ue(&data[i+4], size - i - 4, &bit) < 0)
+					return FALSE;
+				slice_type = gst_sh_video_simulcast_enc_read_ue(&data[i+4],
+					size - i - 4, &bit);
+				return slice_type >= 0 && (slice_type % 5 == 2 || slice_type % 5 == 4);
+			}
+		} else if (data[i+3] == 0xB6) {
+			/* vop_coding_type of the first VOP */
+			return (data[i+4] >> 6) == 0;
+		}
+	}
+
+	return FALSE;
+}
+
+static void gst_sh_video_simulcast_enc_close_encoder (GstSHVideoSimulcastRendition *rendition)
+{
+	if (rendition->encoder) {
+		shcodecs_encoder_close(rendition->encoder);
+		rendition->encoder = NULL;
+	}
+
+	while (!g_queue_is_empty(rendition->inUse))
+		gst_buffer_unref(g_queue_pop_head(rendition->inUse));
+	while (!g_queue_is_empty(rendition->encoded))
+		gst_buffer_unref(g_queue_pop_head(rendition->encoded));
+	if (rendition->partial) {
+		gst_buffer_unref(rendition->partial);
+		rendition->partial = NULL;
+	}
+}
+
+/*
+ * Open the encoder of a rendition. Call with the lock held.
+ */
+static gboolean gst_sh_video_simulcast_enc_open_encoder (GstSHVideoSimulcastEnc *simulcast,
+	GstSHVideoSimulcastRendition *rendition)
+{
+	SHCodecs_Encoder *encoder;
+
+	gst_sh_video_simulcast_enc_close_encoder(rendition);
+
+	encoder = shcodecs_encoder_init(rendition->width, rendition->height, rendition->format);
+	if (!encoder)
+		return FALSE;
+
+	shcodecs_encoder_set_frame_rate(encoder,
+		(simulcast->fps_n * 10) / simulcast->fps_d);
+	if (rendition->format == SHCodecs_Format_H264)
+		shcodecs_encoder_set_h264_sps_frame_rate_info(encoder,
+			simulcast->fps_n, simulcast->fps_d);
+	shcodecs_encoder_set_xpic_size(encoder, rendition->width);
+	shcodecs_encoder_set_ypic_size(encoder, rendition->height);
+
+	shcodecs_encoder_set_output_callback(encoder,
+		gst_sh_video_simulcast_enc_write_output, rendition);
+	shcodecs_encoder_set_input_release_callback(encoder,
+		gst_sh_video_simulcast_enc_input_release, rendition);
+
+	/* Aligned I frames: the same interval for all, and no skipped frames */
+	if (shcodecs_encoder_set_bitrate(encoder, rendition->bitrate) == -1
+	    || shcodecs_encoder_set_I_vop_interval(encoder, simulcast->iVopInterval) == -1
+	    || shcodecs_encoder_set_ratecontrol_skip_enable(encoder, 0) == -1) {
+		shcodecs_encoder_close(encoder);
+		return FALSE;
+	}
+	if (rendition->format == SHCodecs_Format_H264)
+		shcodecs_encoder_set_h264_regularly_inserted_I_type(encoder,
+			DEFAULT_REGULARLY_INSERTED_I_TYPE);
+
+	rendition->encoder = encoder;
+
+	GST_DEBUG_OBJECT(rendition->srcpad, "encoding %dx%d at %ld bps",
+		rendition->width, rendition->height, rendition->bitrate);
+
+	return TRUE;
+}
+
+/*
+ * Pick the caps of a rendition from what downstream accepts, aiming for the
+ * size of the input, and open its encoder. Call with the lock held.
+ */
+static gboolean gst_sh_video_simulcast_enc_negotiate (GstSHVideoSimulcastEnc *simulcast,
+	GstSHVideoSimulcastRendition *rendition)
+{
+	GstCaps *peer_caps, *caps;
+	GstStructure *structure;
+	gint width, height, bitrate;
+
+	peer_caps = gst_pad_peer_get_caps(rendition->srcpad);
+	if (!peer_caps)
+		return FALSE;
+
+	caps = gst_caps_intersect(peer_caps, gst_pad_get_pad_template_caps(rendition->srcpad));
+	gst_caps_unref(peer_caps);
+
+	if (gst_caps_is_empty(caps)) {
+		gst_caps_unref(caps);
+		return FALSE;
+	}
+
+	gst_caps_truncate(caps);
+	structure = gst_caps_get_structure(caps, 0);
+	gst_structure_fixate_field_nearest_int(structure, "width", simulcast->srcWidth);
+	gst_structure_fixate_field_nearest_int(structure, "height", simulcast->srcHeight);
+	gst_structure_fixate_field_nearest_fraction(structure, "framerate",
+		simulcast->fps_n, simulcast->fps_d);
+
+	if (!strcmp(gst_structure_get_name(structure), "video/x-h264")) {
+		rendition->format = SHCodecs_Format_H264;
+		gst_structure_set(structure, "stream-format", G_TYPE_STRING, "byte-stream", NULL);
+	} else {
+		rendition->format = SHCodecs_Format_MPEG4;
+	}
+	gst_pad_fixate_caps(rendition->srcpad, caps);
+
+	if (!gst_caps_is_fixed(caps)
+	    || !gst_structure_get_int(structure, "width", &width)
+	    || !gst_structure_get_int(structure, "height", &height)) {
+		gst_caps_unref(caps);
+		return FALSE;
+	}
+
+	/* One VEU pass */
+	if (width * MAX_SCALE_FACTOR < simulcast->srcWidth
+	    || width > simulcast->srcWidth * MAX_SCALE_FACTOR
+	    || height * MAX_SCALE_FACTOR < simulcast->srcHeight
+	    || height > simulcast->srcHeight * MAX_SCALE_FACTOR) {
+		GST_WARNING_OBJECT(rendition->srcpad, "can't scale %dx%d to %dx%d",
+			simulcast->srcWidth, simulcast->srcHeight, width, height);
+		gst_caps_unref(caps);
+		return FALSE;
+	}
+
+	/* The rendition's share of the bitrate, by number of pixels */
+	if (gst_structure_get_int(structure, "bitrate", &bitrate) && bitrate > 0) {
+		rendition->bitrate = bitrate;
+	} else {
+		rendition->bitrate = gst_util_uint64_scale(simulcast->bitrate,
+			width * height, simulcast->srcWidth * simulcast->srcHeight);
+		rendition->bitrate = MAX(rendition->bitrate, MIN_BITRATE);
+	}
+
+	if (!gst_pad_set_caps(rendition->srcpad, caps)) {
+		gst_caps_unref(caps);
+		return FALSE;
+	}
+	gst_caps_unref(caps);
+
+	rendition->width = width;
+	rendition->height = height;
+
+	if (!gst_sh_video_simulcast_enc_open_encoder(simulcast, rendition)) {
+		GST_ERROR_OBJECT(rendition->srcpad, "failed to open encoder");
+		rendition->width = 0;
+		rendition->height = 0;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Called from a VEU worker thread when a rendition has been scaled
+ */
+static void gst_sh_video_simulcast_enc_job_done (void *user_data, int ret)
+{
+	GstSHVideoSimulcastEnc *simulcast = user_data;
+
+	g_mutex_lock(simulcast->jobLock);
+	if (ret < 0)
+		simulcast->jobsFailed++;
+	if (--simulcast->jobsPending == 0)
+		g_cond_signal(simulcast->jobCond);
+	g_mutex_unlock(simulcast->jobLock);
+}
+
+/*
+ * Get the encoder input for a rendition: the input frame itself if the VPU
+ * can read it, otherwise a scaling job is queued into a pooled buffer.
+ * Call with the lock held.
+ */
+static GstFlowReturn gst_sh_video_simulcast_enc_scale (GstSHVideoSimulcastEnc *simulcast,
+	GstSHVideoSimulcastRendition *rendition, GstBuffer *buf,
+	const struct ren_vid_surface *src)
+{
+	struct ren_vid_surface dst;
+
+	if (rendition->width == src->w && rendition->height == src->h
+	    && src->pitch == src->w && (guint8 *)src->pc == (guint8 *)src->py + src->w * src->h
+	    && GST_IS_SH_VIDEO_BUFFER(buf)) {
+		rendition->input = gst_buffer_ref(buf);
+		return GST_FLOW_OK;
+	}
+
+	if (rendition->pool
+	    && !gst_sh_video_buffer_pool_matches(rendition->pool,
+		rendition->width, rendition->height, REN_NV12)) {
+		gst_sh_video_buffer_pool_free(rendition->pool);
+		rendition->pool = NULL;
+	}
+	if (!rendition->pool)
+		rendition->pool = gst_sh_video_buffer_pool_new(simulcast->uiomux,
+			rendition->width, rendition->height, REN_NV12);
+
+	rendition->input = gst_sh_video_buffer_pool_get(rendition->pool);
+	if (!rendition->input) {
+		GST_ELEMENT_ERROR(simulcast, RESOURCE, NO_SPACE_LEFT,
+			("failed to allocate encoder input"), (NULL));
+		return GST_FLOW_ERROR;
+	}
+	gst_buffer_copy_metadata(rendition->input, buf, GST_BUFFER_COPY_TIMESTAMPS);
+
+	gst_sh_video_buffer_get_surface(rendition->input, REN_NV12,
+		rendition->width, rendition->height, 0, 0, &dst);
+
+	GST_LOG_OBJECT(rendition->srcpad, "scaling from %dx%d to %dx%d",
+		src->w, src->h, dst.w, dst.h);
+
+	g_mutex_lock(simulcast->jobLock);
+	simulcast->jobsPending++;
+	g_mutex_unlock(simulcast->jobLock);
+
+	if (veu_service_resize_async(simulcast->veu, src, &dst, VEU_PRIORITY_NORMAL,
+		gst_sh_video_simulcast_enc_job_done, simulcast) < 0) {
+		gst_sh_video_simulcast_enc_job_done(simulcast, -1);
+		gst_buffer_unref(rendition->input);
+		rendition->input = NULL;
+		return GST_FLOW_ERROR;
+	}
+
+	return GST_FLOW_OK;
+}
+
+/*
+ * Encode the scaled frame of a rendition. Called without the lock, with a
+ * reference to the rendition.
+ */
+static GstFlowReturn gst_sh_video_simulcast_enc_encode (GstSHVideoSimulcastEnc *simulcast,
+	GstSHVideoSimulcastRendition *rendition)
+{
+	struct ren_vid_surface frame;
+	unsigned long budget;
+	int rc;
+
+	gst_sh_video_buffer_get_surface(rendition->input, REN_NV12,
+		rendition->width, rendition->height, 0, 0, &frame);
+
+	/* The encoder reads the frame until it calls input_release */
+	g_queue_push_tail(rendition->inUse, gst_buffer_ref(rendition->input));
+
+	/* Each rendition has its turn on the VPU within one frame period */
+	budget = 1000000 * simulcast->fps_d / simulcast->fps_n;
+
+	vpu_acquire(rendition->vpu, budget);
+	rc = shcodecs_encoder_encode_1frame(rendition->encoder, frame.py, frame.pc,
+		rendition->input);
+	vpu_release(rendition->vpu);
+
+	gst_buffer_unref(rendition->input);
+	rendition->input = NULL;
+
+	if (rc != 0) {
+		GST_ELEMENT_ERROR(simulcast, STREAM, ENCODE,
+			("Encode error"), ("%s failed on %s", __func__, GST_PAD_NAME(rendition->srcpad)));
+		return GST_FLOW_ERROR;
+	}
+
+	return GST_FLOW_OK;
+}
+
+static void gst_sh_video_simulcast_enc_free_rendition (GstSHVideoSimulcastRendition *rendition)
+{
+	gst_sh_video_simulcast_enc_close_encoder(rendition);
+	g_queue_free(rendition->inUse);
+	g_queue_free(rendition->encoded);
+	gst_sh_video_buffer_pool_free(rendition->pool);
+	if (rendition->vpu)
+		vpu_client_close(rendition->vpu);
+	gst_object_unref(rendition->srcpad);
+	g_free(rendition);
+}
+
+static GstSHVideoSimulcastRendition *gst_sh_video_simulcast_enc_ref_rendition (
+	GstSHVideoSimulcastRendition *rendition)
+{
+	g_atomic_int_inc(&rendition->refCount);
+	return rendition;
+}
+
+/*
+ * The last reference frees the rendition, which may be after its pad has been
+ * released, if it was being encoded at the time.
+ */
+static void gst_sh_video_simulcast_enc_unref_rendition (GstSHVideoSimulcastRendition *rendition)
+{
+	if (g_atomic_int_dec_and_test(&rendition->refCount))
+		gst_sh_video_simulcast_enc_free_rendition(rendition);
+}
+
+/*
+ * Sink pad event function. The newsegment event is kept for request pads
+ * added later, and each rendition that didn't get it is marked to get it
+ * before its first buffer.
+ */
+static gboolean gst_sh_video_simulcast_enc_sink_event (GstPad *pad, GstEvent *event)
+{
+	GstSHVideoSimulcastEnc *simulcast = GST_SH_VIDEO_SIMULCAST_ENC(GST_OBJECT_PARENT(pad));
+	GList *renditions, *walk;
+
+	if (GST_EVENT_TYPE(event) != GST_EVENT_NEWSEGMENT)
+		return gst_pad_event_default(pad, event);
+
+	g_mutex_lock(simulcast->lock);
+	if (simulcast->segment)
+		gst_event_unref(simulcast->segment);
+	simulcast->segment = gst_event_ref(event);
+
+	renditions = g_list_copy(simulcast->renditions);
+	for (walk = renditions; walk; walk = g_list_next(walk))
+		gst_sh_video_simulcast_enc_ref_rendition(walk->data);
+	g_mutex_unlock(simulcast->lock);
+
+	for (walk = renditions; walk; walk = g_list_next(walk)) {
+		GstSHVideoSimulcastRendition *rendition = walk->data;
+		gboolean pushed;
+
+		pushed = gst_pad_push_event(rendition->srcpad, gst_event_ref(event));
+
+		g_mutex_lock(simulcast->lock);
+		rendition->needSegment = !pushed;
+		g_mutex_unlock(simulcast->lock);
+
+		gst_sh_video_simulcast_enc_unref_rendition(rendition);
+	}
+	g_list_free(renditions);
+
+	gst_event_unref(event);
+
+	return TRUE;
+}
+
+/*
+ * Sink pad chain function. Scales the input for each rendition, and then
+ * encodes and pushes them one after the other. The lock is only held to pick
+ * the renditions and queue the scaling, so pads can be requested and released
+ * while encoding.
+ */
+static GstFlowReturn gst_sh_video_simulcast_enc_chain (GstPad *pad, GstBuffer *buf)
+{
+	GstSHVideoSimulcastEnc *simulcast = GST_SH_VIDEO_SIMULCAST_ENC(GST_OBJECT_PARENT(pad));
+	GstSHVideoSimulcastRendition **active;
+	GstEvent **segments;
+	struct ren_vid_surface src;
+	GstFlowReturn ret = GST_FLOW_NOT_LINKED;
+	GstFlowReturn push_ret;
+	GList *walk;
+	gint nr_active = 0;
+	gint failed;
+	gint i;
+
+	g_mutex_lock(simulcast->lock);
+
+	gst_sh_video_buffer_get_surface(buf, REN_NV12,
+		simulcast->srcWidth, simulcast->srcHeight,
+		simulcast->srcPitch, simulcast->srcCOffset, &src);
+
+	active = g_new0(GstSHVideoSimulcastRendition *, g_list_length(simulcast->renditions));
+	segments = g_new0(GstEvent *, g_list_length(simulcast->renditions));
+
+	/* Queue the scaling for all renditions first, so they run in parallel */
+	for (walk = simulcast->renditions; walk; walk = g_list_next(walk)) {
+		GstSHVideoSimulcastRendition *rendition = walk->data;
+
+		if (!gst_pad_is_linked(rendition->srcpad))
+			continue;
+
+		if (!rendition->width && !gst_sh_video_simulcast_enc_negotiate(simulcast, rendition)) {
+			GST_ELEMENT_ERROR(simulcast, CORE, NEGOTIATION,
+				("failed to negotiate output %s", GST_PAD_NAME(rendition->srcpad)), (NULL));
+			ret = GST_FLOW_NOT_NEGOTIATED;
+			break;
+		}
+
+		ret = gst_sh_video_simulcast_enc_scale(simulcast, rendition, buf, &src);
+		if (ret != GST_FLOW_OK)
+			break;
+
+		if (rendition->needSegment && simulcast->segment) {
+			segments[nr_active] = gst_event_ref(simulcast->segment);
+			rendition->needSegment = FALSE;
+		}
+		active[nr_active++] = gst_sh_video_simulcast_enc_ref_rendition(rendition);
+	}
+
+	g_mutex_unlock(simulcast->lock);
+
+	/* Wait for all the scaling, the input must stay valid until then */
+	g_mutex_lock(simulcast->jobLock);
+	while (simulcast->jobsPending > 0)
+		g_cond_wait(simulcast->jobCond, simulcast->jobLock);
+	failed = simulcast->jobsFailed;
+	simulcast->jobsFailed = 0;
+	g_mutex_unlock(simulcast->jobLock);
+
+	if (failed) {
+		GST_ELEMENT_ERROR(simulcast, RESOURCE, FAILED,
+			("failed to execute veu resize"), (NULL));
+		ret = GST_FLOW_ERROR;
+	}
+
+	/* Encode each rendition, then push it without holding the VPU */
+	for (i = 0; i < nr_active; i++) {
+		GstSHVideoSimulcastRendition *rendition = active[i];
+
+		if (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED && ret != GST_FLOW_WRONG_STATE) {
+			gst_buffer_unref(rendition->input);
+			rendition->input = NULL;
+			goto next;
+		}
+
+		push_ret = gst_sh_video_simulcast_enc_encode(simulcast, rendition);
+		if (push_ret != GST_FLOW_OK)
+			ret = push_ret;
+
+		if (segments[i]) {
+			gst_pad_push_event(rendition->srcpad, segments[i]);
+			segments[i] = NULL;
+		}
+
+		while (!g_queue_is_empty(rendition->encoded)) {
+			GstBuffer *out = g_queue_pop_head(rendition->encoded);
+
+			if (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED && ret != GST_FLOW_WRONG_STATE) {
+				gst_buffer_unref(out);
+				continue;
+			}
+
+			/* Segmenters split at I frames */
+			if (!gst_sh_video_simulcast_enc_is_keyframe(rendition->format, out))
+				GST_BUFFER_FLAG_SET(out, GST_BUFFER_FLAG_DELTA_UNIT);
+			gst_buffer_set_caps(out, GST_PAD_CAPS(rendition->srcpad));
+
+			push_ret = gst_pad_push(rendition->srcpad, out);
+
+			/* Like tee, fine while any output is linked */
+			if (push_ret == GST_FLOW_OK && ret == GST_FLOW_NOT_LINKED)
+				ret = GST_FLOW_OK;
+			else if (push_ret != GST_FLOW_OK && push_ret != GST_FLOW_NOT_LINKED)
+				ret = push_ret;
+		}
+
+next:
+		if (segments[i])
+			gst_event_unref(segments[i]);
+		gst_sh_video_simulcast_enc_unref_rendition(rendition);
+	}
+
+	g_free(active);
+	g_free(segments);
+	gst_buffer_unref(buf);
+
+	return ret;
+}
+
+static GstPad *gst_sh_video_simulcast_enc_request_new_pad (GstElement *element,
+	GstPadTemplate *templ, const gchar *unused)
+{
+	GstSHVideoSimulcastEnc *simulcast = GST_SH_VIDEO_SIMULCAST_ENC(element);
+	GstSHVideoSimulcastRendition *rendition;
+	GstPad *srcpad;
+	gchar *name;
+
+	if (templ->direction != GST_PAD_SRC) {
+		GST_WARNING("request pad that is not a SRC pad");
+		return NULL;
+	}
+
+	g_mutex_lock(simulcast->lock);
+	name = g_strdup_printf("src_%d", simulcast->nextPad++);
+	srcpad = gst_pad_new_from_template(templ, name);
+	g_free(name);
+	gst_pad_use_fixed_caps(srcpad);
+
+	rendition = g_new0(GstSHVideoSimulcastRendition, 1);
+	rendition->refCount = 1;
+	rendition->srcpad = gst_object_ref(srcpad);
+	rendition->simulcast = simulcast;
+	rendition->needSegment = TRUE;
+	rendition->inUse = g_queue_new();
+	rendition->encoded = g_queue_new();
+
+	/* Each rendition is a separate VPU client, so they take turns */
+	name = g_strdup_printf("%s:%s", GST_ELEMENT_NAME(element), GST_PAD_NAME(srcpad));
+	rendition->vpu = vpu_client_open(name, simulcast->vpuPriority);
+	g_free(name);
+
+	gst_pad_set_element_private(srcpad, rendition);
+	simulcast->renditions = g_list_append(simulcast->renditions, rendition);
+	g_mutex_unlock(simulcast->lock);
+
+	if (GST_STATE(element) > GST_STATE_READY)
+		gst_pad_set_active(srcpad, TRUE);
+
+	gst_element_add_pad(element, srcpad);
+
+	return srcpad;
+}
+
+static void gst_sh_video_simulcast_enc_release_pad (GstElement *element, GstPad *pad)
+{
+	GstSHVideoSimulcastEnc *simulcast = GST_SH_VIDEO_SIMULCAST_ENC(element);
+	GstSHVideoSimulcastRendition *rendition;
+
+	g_mutex_lock(simulcast->lock);
+	rendition = gst_pad_get_element_private(pad);
+	if (rendition) {
+		simulcast->renditions = g_list_remove(simulcast->renditions, rendition);
+		gst_pad_set_element_private(pad, NULL);
+	}
+	g_mutex_unlock(simulcast->lock);
+
+	gst_element_remove_pad(element, pad);
+
+	/* Freed now, or by the chain function once it has encoded it */
+	if (rendition)
+		gst_sh_video_simulcast_enc_unref_rendition(rendition);
+}
+
+static void gst_sh_video_simulcast_enc_set_property (GObject *object, guint prop_id,
+	const GValue *value, GParamSpec *pspec)
+{
+	GstSHVideoSimulcastEnc *simulcast = GST_SH_VIDEO_SIMULCAST_ENC(object);
+	GList *walk;
+
+	g_mutex_lock(simulcast->lock);
+	switch (prop_id) {
+	case PROP_BITRATE:
+		simulcast->bitrate = g_value_get_long(value);
+		break;
+	case PROP_I_VOP_INTERVAL:
+		simulcast->iVopInterval = g_value_get_long(value);
+		break;
+	case PROP_VPU_PRIORITY:
+		simulcast->vpuPriority = g_value_get_int(value);
+		for (walk = simulcast->renditions; walk; walk = g_list_next(walk)) {
+			GstSHVideoSimulcastRendition *rendition = walk->data;
+			if (rendition->vpu)
+				vpu_client_set_priority(rendition->vpu, simulcast->vpuPriority);
+		}
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		break;
+	}
+	g_mutex_unlock(simulcast->lock);
+}
+
+static void gst_sh_video_simulcast_enc_get_property (GObject *object, guint prop_id,
+	GValue *value, GParamSpec *pspec)
+{
+	GstSHVideoSimulcastEnc *simulcast = GST_SH_VIDEO_SIMULCAST_ENC(object);
+
+	switch (prop_id) {
+	case PROP_BITRATE:
+		g_value_set_long(value, simulcast->bitrate);
+		break;
+	case PROP_I_VOP_INTERVAL:
+		g_value_set_long(value, simulcast->iVopInterval);
+		break;
+	case PROP_VPU_PRIORITY:
+		g_value_set_int(value, simulcast->vpuPriority);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		break;
+	}
+}
+
+/*
+ * GstElementClass::change_state
+ *    Opens the uiomux & VEU service when going to READY. The VEU service is
+ *    closed again when going back to NULL, the uiomux is kept for the
+ *    buffer pools.
+ */
+static GstStateChangeReturn gst_sh_video_simulcast_enc_change_state (GstElement *element,
+	GstStateChange transition)
+{
+	GstSHVideoSimulcastEnc *simulcast = GST_SH_VIDEO_SIMULCAST_ENC(element);
+	GstStateChangeReturn ret;
+	GList *walk;
+
+	switch (transition) {
+	case GST_STATE_CHANGE_NULL_TO_READY:
+		if (!simulcast->uiomux)
+			simulcast->uiomux = uiomux_open();
+		if (!simulcast->uiomux) {
+			GST_ELEMENT_ERROR(simulcast, RESOURCE, OPEN_READ_WRITE,
+				("failed to open uiomux"), (NULL));
+			return GST_STATE_CHANGE_FAILURE;
+		}
+		if (!simulcast->veu)
+			simulcast->veu = veu_service_open();
+		if (!simulcast->veu) {
+			GST_ELEMENT_ERROR(simulcast, RESOURCE, OPEN_READ_WRITE,
+				("failed to open the VEU"), (NULL));
+			return GST_STATE_CHANGE_FAILURE;
+		}
+		break;
+	default:
+		break;
+	}
+
+	ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+	switch (transition) {
+	case GST_STATE_CHANGE_PAUSED_TO_READY:
+		g_mutex_lock(simulcast->lock);
+		if (simulcast->segment) {
+			gst_event_unref(simulcast->segment);
+			simulcast->segment = NULL;
+		}
+		for (walk = simulcast->renditions; walk; walk = g_list_next(walk)) {
+			GstSHVideoSimulcastRendition *rendition = walk->data;
+			rendition->needSegment = TRUE;
+		}
+		g_mutex_unlock(simulcast->lock);
+		break;
+	case GST_STATE_CHANGE_READY_TO_NULL:
+		if (simulcast->veu) {
+			veu_service_close(simulcast->veu);
+			simulcast->veu = NULL;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return ret;
+}
+
+/*
+ * GObjectClass::finalize
+ */
+static void gst_sh_video_simulcast_enc_finalize (GObject *object)
+{
+	GstSHVideoSimulcastEnc *simulcast = GST_SH_VIDEO_SIMULCAST_ENC(object);
+	GList *walk;
+
+	for (walk = simulcast->renditions; walk; walk = g_list_next(walk))
+		gst_sh_video_simulcast_enc_unref_rendition(walk->data);
+	g_list_free(simulcast->renditions);
+	simulcast->renditions = NULL;
+
+	if (simulcast->segment) {
+		gst_event_unref(simulcast->segment);
+		simulcast->segment = NULL;
+	}
+
+	if (simulcast->veu) {
+		veu_service_close(simulcast->veu);
+		simulcast->veu = NULL;
+	}
+
+	if (simulcast->uiomux) {
+		uiomux_close(simulcast->uiomux);
+		simulcast->uiomux = NULL;
+	}
+
+	g_cond_free(simulcast->jobCond);
+	g_mutex_free(simulcast->jobLock);
+	g_mutex_free(simulcast->lock);
+
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+/*
+ * gst_sh_video_simulcast_enc_base_init
+ *    Initializes element base class.
+ */
+static void gst_sh_video_simulcast_enc_base_init(gpointer gclass)
+{
+	static GstElementDetails element_details = {
+		"SH video simulcast encoder",
+		"Codec/Encoder/Video",
+		"Encode video at several sizes using the VEU & VPU",
+		"Renesas"
+	};
+
+	GstElementClass *element_class = GST_ELEMENT_CLASS(gclass);
+
+	gst_element_class_add_pad_template(element_class,
+		gst_static_pad_template_get (&src_factory));
+	gst_element_class_add_pad_template(element_class,
+		gst_static_pad_template_get (&sink_factory));
+	gst_element_class_set_details(element_class, &element_details);
+}
+
+/*
+ * gst_sh_video_simulcast_enc_class_init
+ *    Initializes the SHVideoSimulcastEnc class.
+ */
+static void gst_sh_video_simulcast_enc_class_init(GstSHVideoSimulcastEncClass *klass)
+{
+	GObjectClass *gobject_class;
+	GstElementClass *element_class;
+
+	gobject_class    = (GObjectClass*) klass;
+	element_class    = (GstElementClass *) klass;
+
+	parent_class = g_type_class_peek_parent (klass);
+
+	gobject_class->finalize = GST_DEBUG_FUNCPTR(gst_sh_video_simulcast_enc_finalize);
+	gobject_class->set_property = gst_sh_video_simulcast_enc_set_property;
+	gobject_class->get_property = gst_sh_video_simulcast_enc_get_property;
+
+	g_object_class_install_property(gobject_class, PROP_BITRATE,
+		g_param_spec_long("bitrate", "Bitrate",
+			"Bitrate of a rendition the size of the input, smaller renditions get a share of it",
+			MIN_BITRATE, 10000000, DEFAULT_BITRATE_H264,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property(gobject_class, PROP_I_VOP_INTERVAL,
+		g_param_spec_long("i-vop-interval", "I frame interval",
+			"Frames between I frames, the same for all renditions",
+			0, G_MAXLONG, DEFAULT_I_VOP_INTERVAL,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property(gobject_class, PROP_VPU_PRIORITY,
+		g_param_spec_int("vpu-priority", "VPU priority",
+			"Priority of the encoders' jobs on the shared VPU",
+			VPU_PRIORITY_LOW, VPU_PRIORITY_HIGH, VPU_PRIORITY_NORMAL,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	element_class->change_state = GST_DEBUG_FUNCPTR(gst_sh_video_simulcast_enc_change_state);
+	element_class->request_new_pad = GST_DEBUG_FUNCPTR(gst_sh_video_simulcast_enc_request_new_pad);
+	element_class->release_pad = GST_DEBUG_FUNCPTR(gst_sh_video_simulcast_enc_release_pad);
+
+	GST_DEBUG_CATEGORY_INIT(gst_sh_video_simulcast_enc_debug,
+		"gst-sh-mobile-simulcast-enc", 0, "SH Video Simulcast Encoder");
+}
+
+/*
+ * gst_sh_video_simulcast_enc_init
+ */
+static void gst_sh_video_simulcast_enc_init (GstSHVideoSimulcastEnc *simulcast)
+{
+	simulcast->sinkpad = gst_pad_new_from_static_template(&sink_factory, "sink");
+	gst_pad_set_setcaps_function(simulcast->sinkpad,
+		GST_DEBUG_FUNCPTR(gst_sh_video_simulcast_enc_setcaps));
+	gst_pad_set_chain_function(simulcast->sinkpad,
+		GST_DEBUG_FUNCPTR(gst_sh_video_simulcast_enc_chain));
+	gst_pad_set_event_function(simulcast->sinkpad,
+		GST_DEBUG_FUNCPTR(gst_sh_video_simulcast_enc_sink_event));
+	gst_element_add_pad(GST_ELEMENT(simulcast), simulcast->sinkpad);
+
+	simulcast->lock = g_mutex_new();
+	simulcast->jobLock = g_mutex_new();
+	simulcast->jobCond = g_cond_new();
+
+	simulcast->bitrate = DEFAULT_BITRATE_H264;
+	simulcast->iVopInterval = DEFAULT_I_VOP_INTERVAL;
+	simulcast->vpuPriority = VPU_PRIORITY_NORMAL;
+}
+
+/*
+ * gst_sh_video_simulcast_enc_get_type
+ *    Defines function pointers for initialization routines for this element.
+ */
+GType gst_sh_video_simulcast_enc_get_type(void)
+{
+	static GType object_type = 0;
+
+	if (G_UNLIKELY(object_type == 0)) {
+		static const GTypeInfo object_info = {
+			sizeof(GstSHVideoSimulcastEncClass),
+			gst_sh_video_simulcast_enc_base_init,
+			NULL,
+			(GClassInitFunc) gst_sh_video_simulcast_enc_class_init,
+			NULL,
+			NULL,
+			sizeof(GstSHVideoSimulcastEnc),
+			0,
+			(GInstanceInitFunc) gst_sh_video_simulcast_enc_init
+		};
+
+		object_type = g_type_register_static(GST_TYPE_ELEMENT,
+			"gst-sh-mobile-simulcast-enc", &object_info, (GTypeFlags)0);
+	}
+
+	return object_type;
+}
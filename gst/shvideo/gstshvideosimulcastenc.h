@@ -0,0 +1,130 @@
+/**
+ * "gst-sh-mobile-simulcast-enc" element. Scales one input to several sizes
+ * using the VEU, and encodes each of them using the VPU (via libshcodecs).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_SH_VIDEO_SIMULCAST_ENC_H__
+#define __GST_SH_VIDEO_SIMULCAST_ENC_H__
+
+#include <gst/gst.h>
+
+#include <uiomux/uiomux.h>
+#include <shveu/shveu.h>
+#include <shcodecs/shcodecs_encoder.h>
+
+#include "veusched.h"
+#include "vpusched.h"
+#include "gstshvideobuffer.h"
+
+G_BEGIN_DECLS
+
+/* Standard macros for manipulating SHVideoSimulcastEnc objects */
+#define GST_TYPE_SH_VIDEO_SIMULCAST_ENC \
+  (gst_sh_video_simulcast_enc_get_type())
+#define GST_SH_VIDEO_SIMULCAST_ENC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_SH_VIDEO_SIMULCAST_ENC,GstSHVideoSimulcastEnc))
+#define GST_SH_VIDEO_SIMULCAST_ENC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_SH_VIDEO_SIMULCAST_ENC,GstSHVideoSimulcastEncClass))
+#define GST_IS_SH_VIDEO_SIMULCAST_ENC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_SH_VIDEO_SIMULCAST_ENC))
+#define GST_IS_SH_VIDEO_SIMULCAST_ENC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_SH_VIDEO_SIMULCAST_ENC))
+
+typedef struct _GstSHVideoSimulcastEnc      GstSHVideoSimulcastEnc;
+typedef struct _GstSHVideoSimulcastEncClass GstSHVideoSimulcastEncClass;
+typedef struct _GstSHVideoSimulcastRendition GstSHVideoSimulcastRendition;
+
+/* One encoded rendition, for each request src pad */
+struct _GstSHVideoSimulcastRendition
+{
+	/* Held by the list of renditions & by the chain function while encoding */
+	gint              refCount;
+
+	GstPad            *srcpad;
+	GstSHVideoSimulcastEnc *simulcast;
+
+	/* Added after the newsegment event, send it before the first buffer */
+	gboolean          needSegment;
+
+	/* Negotiated output, 0 size until negotiated */
+	gint              width;
+	gint              height;
+	SHCodecs_Format   format;
+	glong             bitrate;
+
+	SHCodecs_Encoder  *encoder;
+	VPU_CLIENT        *vpu;
+
+	/* Scaled encoder input, held until the encoder releases it */
+	GstSHVideoBufferPool *pool;
+	GstBuffer         *input;
+	GQueue            *inUse;
+
+	/* Encoded data for the current frame, pushed once the VPU is free */
+	GstBuffer         *partial;
+	GQueue            *encoded;
+};
+
+/* _GstSHVideoSimulcastEnc object */
+struct _GstSHVideoSimulcastEnc
+{
+	/* GStreamer infrastructure */
+	GstElement        element;
+	GstPad            *sinkpad;
+
+	/* Protects the renditions */
+	GMutex            *lock;
+	GList             *renditions;
+	guint             nextPad;
+	GstEvent          *segment;
+
+	/* Input */
+	gint              srcWidth;
+	gint              srcHeight;
+	gint              srcPitch;
+	gint              srcCOffset;
+	gint              fps_n;
+	gint              fps_d;
+
+	/* Properties */
+	glong             bitrate;
+	glong             iVopInterval;
+	gint              vpuPriority;
+
+	UIOMux            *uiomux;
+	VEU_SERVICE       *veu;
+
+	/* Completion of the scaling jobs queued for a frame */
+	GMutex            *jobLock;
+	GCond             *jobCond;
+	gint              jobsPending;
+	gint              jobsFailed;
+};
+
+/* _GstSHVideoSimulcastEncClass object */
+struct _GstSHVideoSimulcastEncClass
+{
+	GstElementClass parent_class;
+};
+
+/* External function declarations */
+GType gst_sh_video_simulcast_enc_get_type(void);
+
+G_END_DECLS
+
+#endif /* __GST_SH_VIDEO_SIMULCAST_ENC_H__ */
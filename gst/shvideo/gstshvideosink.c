@@ -59,6 +59,33 @@
  * gst-sh-mobile-dec and gst-sh-mobile-sink. The gst-sh-mobile-sink is
  * a videosink element for SuperH.
  *
+ * \subsection sink-example-4 Blending straight into the display
+ * \code
+ * gst-launch \
+ *  videotestsrc ! "video/x-raw-yuv, format=(fourcc)NV12, width=800, height=480" ! queue ! mix. \
+ *  videotestsrc pattern=1 ! "video/x-raw-yuv, format=(fourcc)NV12, width=320, height=240" ! queue ! mix. \
+ *  gst-sh-mobile-mixer name=mix sink_1::xpos=40 sink_1::ypos=40 \
+ *  ! "video/x-raw-rgb, bpp=16" \
+ *  ! gst-sh-mobile-sink
+ * \endcode
+ * When an upstream element asks for an RGB565 buffer the size of the display
+ * (here an 800x480 panel), the sink hands out the framebuffer's back buffer.
+ * The mixer blends into it and the sink just flips it onto the screen, so
+ * there is no copy of the frame. Only one such buffer is handed out at a
+ * time, other requests get ordinary VEU memory.
+ *
+ * \subsection sink-example-5 Rotating the output
+ * \code
+ * gst-launch \
+ *  videotestsrc ! "video/x-raw-yuv, format=(fourcc)NV12, width=480, height=320" \
+ *  ! gst-sh-mobile-sink rotation=90
+ * \endcode
+ * Shows the frames turned a quarter turn clockwise, e.g. for a panel mounted
+ * in portrait. A plain 90 degree rotation is done by the VEU when libshveu
+ * supports it, anything else by the CPU. When the frames are scaled anyway,
+ * it is cheaper to rotate in gst-sh-mobile-resize, which can do it as part of
+ * the scaling.
+ *
  * \section sink-properties Properties
  * \copydoc gstshvideosinkproperties
  *
@@ -93,6 +120,7 @@
 #include <linux/videodev2.h> /* For pixel formats */
 #include <uiomux/uiomux.h>
 #include "display.h"
+#include "rotate.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_sh_video_sink_debug);
 #define GST_CAT_DEFAULT gst_sh_video_sink_debug
@@ -108,6 +136,8 @@ GST_DEBUG_CATEGORY_STATIC (gst_sh_video_sink_debug);
  * Caps:
  * - video/x-raw-yuv, format=(fourcc)NV12, width=(int)[16,2560],
  *   height=(int)[16,1920], framerate=(fraction)[1,30]
+ * - video/x-raw-rgb, bpp=(int)16, depth=(int)16, width=(int)[16,2560],
+ *   height=(int)[16,1920], framerate=(fraction)[1,30]
  */
 static GstStaticPadTemplate gst_sh_video_sink_sink_template_factory =
 GST_STATIC_PAD_TEMPLATE ("sink",
@@ -118,6 +148,16 @@ GST_STATIC_PAD_TEMPLATE ("sink",
 				 "format = (fourcc) NV12,"
 				 "framerate = (fraction) [1, 30],"
 				 "width = (int) [16, 2560],"
+				 "height = (int) [16, 1920];"
+				 "video/x-raw-rgb, "
+				 "bpp = (int) 16,"
+				 "depth = (int) 16,"
+				 "endianness = (int) BYTE_ORDER,"
+				 "red_mask = (int) 0xf800,"
+				 "green_mask = (int) 0x07e0,"
+				 "blue_mask = (int) 0x001f,"
+				 "framerate = (fraction) [1, 30],"
+				 "width = (int) [16, 2560],"
 				 "height = (int) [16, 1920]"
 				 )
 		);
@@ -131,6 +171,10 @@ GST_STATIC_PAD_TEMPLATE ("sink",
  * - "y" (int). Y-coordinate of the video output. Default: 0.
  * - "zoom" (string). Zoom factor of the video output. Possible values:
  *   "orig"/"full"/"double"/"half". Default: "orig"
+ * - "rotation" (enum). Clockwise rotation of the video output. Possible
+ *   values: "0"/"90"/"180"/"270". Default: "0"
+ * - "flip" (enum). Flip of the video output, done before the rotation.
+ *   Possible values: "none"/"horizontal"/"vertical". Default: "none"
  */
 enum gstshvideosinkproperties
 {
@@ -139,7 +183,9 @@ enum gstshvideosinkproperties
 	PROP_HEIGHT,
 	PROP_X,
 	PROP_Y,
-	PROP_ZOOM
+	PROP_ZOOM,
+	PROP_ROTATION,
+	PROP_FLIP
 };
 
 enum
@@ -370,6 +416,18 @@ gst_sh_video_sink_class_init (GstSHVideoSinkClass * klass)
 				 "Output zoom level(original(default)/full/double/half)",
 				 NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+	g_object_class_install_property (gobject_class, PROP_ROTATION,
+			g_param_spec_enum ("rotation", "Rotation",
+			"Clockwise rotation of the video frame on the display",
+			GST_TYPE_SH_VIDEO_ROTATION, ROTATE_0,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_FLIP,
+			g_param_spec_enum ("flip", "Flip",
+			"Flip of the video frame on the display, before the rotation",
+			GST_TYPE_SH_VIDEO_FLIP, FLIP_NONE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
 	gstbasesink_class->set_caps = GST_DEBUG_FUNCPTR (gst_sh_video_sink_setcaps);
 	gstbasesink_class->get_caps = GST_DEBUG_FUNCPTR (gst_sh_video_sink_getcaps);
 	gstbasesink_class->get_times =
@@ -396,6 +454,15 @@ gst_sh_video_sink_init (GstSHVideoSink * sink, GstSHVideoSinkClass * gklass)
 	sink->dst_height = 0;
 	sink->dst_x = 0;
 	sink->dst_y = 0;
+
+	sink->format = REN_NV12;
+	sink->back_buffer = NULL;
+	sink->back_buffer_shown = FALSE;
+
+	sink->rotation = ROTATE_0;
+	sink->flip = FLIP_NONE;
+	sink->veu = NULL;
+	sink->rotate_pool = NULL;
 }
 
 
@@ -450,6 +517,16 @@ gst_sh_video_sink_set_property (GObject * object, guint prop_id,
 			}
 			break;
 		}
+		case PROP_ROTATION:
+		{
+			sink->rotation = g_value_get_enum (value);
+			break;
+		}
+		case PROP_FLIP:
+		{
+			sink->flip = g_value_get_enum (value);
+			break;
+		}
 		default:
 		{
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -513,6 +590,16 @@ gst_sh_video_sink_get_property (GObject * object, guint prop_id,
 			}
 			break;
 		}
+		case PROP_ROTATION:
+		{
+			g_value_set_enum (value,sink->rotation);
+			break;
+		}
+		case PROP_FLIP:
+		{
+			g_value_set_enum (value,sink->flip);
+			break;
+		}
 		default:
 		{
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -528,6 +615,9 @@ gst_sh_video_sink_start (GstBaseSink *bsink)
 
 	GST_DEBUG_OBJECT(sink,"START, opening devices.");
 
+	sink->uiomux = uiomux_open();
+	sink->veu = veu_service_open();
+
 	sink->display = display_open();
 	if (!sink->display) {
 		GST_ELEMENT_ERROR((GstElement *) sink, CORE, FAILED,
@@ -543,7 +633,29 @@ gst_sh_video_sink_stop (GstBaseSink *bsink)
 	GstSHVideoSink *sink = GST_SH_VIDEO_SINK (bsink);
 
 	GST_DEBUG_OBJECT(sink,"STOP, closing devices.");
-	display_close(sink->display);
+
+	if (sink->back_buffer) {
+		gst_buffer_unref(sink->back_buffer);
+		sink->back_buffer = NULL;
+	}
+
+	if (sink->rotate_pool) {
+		gst_sh_video_buffer_pool_free(sink->rotate_pool);
+		sink->rotate_pool = NULL;
+	}
+	if (sink->veu) {
+		veu_service_close(sink->veu);
+		sink->veu = NULL;
+	}
+
+	if (sink->display) {
+		display_close(sink->display);
+		sink->display = NULL;
+	}
+	if (sink->uiomux) {
+		uiomux_close(sink->uiomux);
+		sink->uiomux = NULL;
+	}
 
 	return TRUE;
 }
@@ -577,11 +689,37 @@ gst_sh_video_sink_setcaps (GstBaseSink * bsink, GstCaps * caps)
 		return FALSE;
 	}
 
+	if (!gst_caps_to_renesas_format (caps, &sink->format))
+	{
+		GST_DEBUG_OBJECT(sink,"failed (unsupported format)");
+		return FALSE;
+	}
+
 	GST_DEBUG_OBJECT(sink,"Caps set. Framerate: %d/%d width: %d height: %d"
 			 ,sink->fps_numerator,sink->fps_denominator,
 			 sink->video_sink.width,
 			 sink->video_sink.height);
 
+	if (gst_sh_video_format_parse_layout (caps, &sink->pitch, &sink->c_offset))
+	{
+		GST_DEBUG_OBJECT(sink,"Padded frames, pitch %d chroma offset %d",
+				 sink->pitch, sink->c_offset);
+	}
+
+	if (gst_sh_video_format_parse_crop (caps, &sink->crop))
+	{
+		GST_DEBUG_OBJECT(sink,"Cropped to %dx%d at %d,%d",
+				 sink->crop.w, sink->crop.h,
+				 sink->crop.x, sink->crop.y);
+	}
+	else
+	{
+		sink->crop.x = 0;
+		sink->crop.y = 0;
+		sink->crop.w = sink->video_sink.width;
+		sink->crop.h = sink->video_sink.height;
+	}
+
 	if (!sink->dst_width && !sink->dst_height
 	   && sink->zoom_factor != ZOOM_ORIG)
 	{
@@ -589,30 +727,30 @@ gst_sh_video_sink_setcaps (GstBaseSink * bsink, GstCaps * caps)
 		{
 			case ZOOM_FULL:
 			{
-				sink->dst_width = sink->video_sink.width;
-				sink->dst_height = sink->video_sink.height;
+				sink->dst_width = sink->crop.w;
+				sink->dst_height = sink->crop.h;
 				break;
 			}
 			case ZOOM_DOUBLE:
 			{
-				sink->dst_width = sink->video_sink.width / 2;
-				sink->dst_height = sink->video_sink.height / 2;
+				sink->dst_width = sink->crop.w / 2;
+				sink->dst_height = sink->crop.h / 2;
 				break;
 			}
 			case ZOOM_HALF:
 			{
-				sink->dst_width = sink->video_sink.width * 2;
-				sink->dst_height = sink->video_sink.height * 2;
+				sink->dst_width = sink->crop.w * 2;
+				sink->dst_height = sink->crop.h * 2;
 				break;
 			}
 		}
 	}
 
 	if (!sink->dst_width) {
-		sink->dst_width = sink->video_sink.width;
+		sink->dst_width = sink->crop.w;
 	}
 	if (!sink->dst_height) {
-		sink->dst_height = sink->video_sink.height;
+		sink->dst_height = sink->crop.h;
 	}
 
 	if (sink->dst_width < MIN_W_AND_H) {
@@ -673,25 +811,111 @@ gst_sh_video_sink_get_times (GstBaseSink * bsink, GstBuffer * buf,
 	}
 }
 
+/**
+ * Rotate & flip the visible area of a frame into a buffer from the rotate
+ * pool.
+ * \param sink Gstreamer SH video sink
+ * \param src The visible area of the frame
+ * \param dst The rotated frame is returned here
+ * \return The buffer holding the rotated frame, or NULL on failure
+ */
+static GstBuffer *
+gst_sh_video_sink_rotate (GstSHVideoSink *sink,
+			  const struct ren_vid_surface *src,
+			  struct ren_vid_surface *dst)
+{
+	GstBuffer *buf;
+
+	*dst = *src;
+	if (ROTATE_SWAPS_SIZE(sink->rotation))
+	{
+		dst->w = src->h;
+		dst->h = src->w;
+	}
+
+	if (sink->rotate_pool
+	    && !gst_sh_video_buffer_pool_matches(sink->rotate_pool, dst->w, dst->h, dst->format))
+	{
+		gst_sh_video_buffer_pool_free(sink->rotate_pool);
+		sink->rotate_pool = NULL;
+	}
+	if (!sink->rotate_pool)
+	{
+		sink->rotate_pool = gst_sh_video_buffer_pool_new(sink->uiomux,
+						dst->w, dst->h, dst->format);
+	}
+
+	buf = gst_sh_video_buffer_pool_get(sink->rotate_pool);
+	if (!buf)
+	{
+		GST_ELEMENT_ERROR((GstElement*)sink, RESOURCE, NO_SPACE_LEFT,
+			("Failed to allocate rotation buffer"), (NULL));
+		return NULL;
+	}
+
+	gst_sh_video_buffer_get_surface(buf, dst->format, dst->w, dst->h, 0, 0, dst);
+
+	/* The VEU can only do a plain 90 degree rotation */
+	if (sink->rotation == ROTATE_90 && sink->flip == FLIP_NONE
+	    && sink->veu
+	    && veu_service_rotate(sink->veu, src, dst, VEU_PRIORITY_NORMAL) == 0)
+	{
+		return buf;
+	}
+
+	if (rotate_surface(src, dst, sink->rotation, sink->flip) < 0)
+	{
+		GST_ELEMENT_ERROR((GstElement*)sink, STREAM, FORMAT,
+			("Failed to rotate frame"), (NULL));
+		gst_buffer_unref(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
 static GstFlowReturn
 gst_sh_video_sink_show_frame (GstBaseSink * bsink, GstBuffer * buf)
 {
 	GstSHVideoSink *sink = GST_SH_VIDEO_SINK (bsink);
 	struct ren_vid_surface frame;
+	struct ren_vid_surface visible;
+	struct ren_vid_surface rotated;
+	GstBuffer *rotbuf;
 
 	GST_LOG_OBJECT(sink,"called");
 
 	g_return_val_if_fail (buf != NULL, GST_FLOW_ERROR);
 
-	frame.format = REN_NV12;
-	frame.w = sink->video_sink.width;
-	frame.h = sink->video_sink.height;
-	frame.pitch = sink->video_sink.width;
-	frame.py = GST_BUFFER_DATA(buf);
-	frame.pc = frame.py + frame.w * frame.h;
-	frame.pa = NULL;
+	/* The frame is already in the back buffer, so just show it. It is
+	   shown for preroll & again for render, but can only be flipped once */
+	if (buf == sink->back_buffer) {
+		if (!sink->back_buffer_shown) {
+			display_flip(sink->display);
+			sink->back_buffer_shown = TRUE;
+		}
+		return GST_FLOW_OK;
+	}
+
+	gst_sh_video_buffer_get_surface(buf, sink->format,
+		sink->video_sink.width, sink->video_sink.height,
+		sink->pitch, sink->c_offset, &frame);
+
+	/* Only show the picture, not the padding around it */
+	get_sel_surface(&visible, &frame, &sink->crop);
 
-	display_update(sink->display, &frame);
+	if (sink->rotation != ROTATE_0 || sink->flip != FLIP_NONE)
+	{
+		rotbuf = gst_sh_video_sink_rotate(sink, &visible, &rotated);
+		if (!rotbuf)
+			return GST_FLOW_ERROR;
+
+		display_update(sink->display, &rotated);
+		gst_buffer_unref(rotbuf);
+		return GST_FLOW_OK;
+	}
+
+	display_update(sink->display, &visible);
 
 	return GST_FLOW_OK;
 }
@@ -703,6 +927,8 @@ gst_sh_video_sink_buffer_alloc (GstBaseSink *bsink, guint64 offset, guint size,
 {
 	GstStructure *structure = NULL;
 	GstSHVideoSink *sink = GST_SH_VIDEO_SINK (bsink);
+	GstSHVideoBuffer *shbuf;
+	ren_vid_format_t format;
 	gint width, height;
 	void *user;
 
@@ -724,6 +950,42 @@ gst_sh_video_sink_buffer_alloc (GstBaseSink *bsink, guint64 offset, guint size,
 
 	GST_LOG_OBJECT(sink,"Frame width: %d height: %d",width,height);
 
+	/* A frame that fills the display can be drawn straight into the back
+	   buffer, unless it has to be rotated. Only one back buffer is handed
+	   out until it has been shown, or dropped */
+	if (sink->display && sink->back_buffer
+	    && !sink->back_buffer_shown
+	    && GST_MINI_OBJECT_REFCOUNT_VALUE(sink->back_buffer) == 1)
+	{
+		GST_LOG_OBJECT(sink,"back buffer was not shown");
+		sink->back_buffer_shown = TRUE;
+	}
+
+	if (sink->display
+	    && sink->rotation == ROTATE_0 && sink->flip == FLIP_NONE
+	    && (!sink->back_buffer || sink->back_buffer_shown)
+	    && gst_caps_to_renesas_format (caps, &format)
+	    && format == display_get_format(sink->display)
+	    && width == display_get_width(sink->display)
+	    && height == display_get_height(sink->display)
+	    && size <= (guint) gst_sh_video_format_get_size(GST_VIDEO_FORMAT_RGB16, width, height))
+	{
+		shbuf = (GstSHVideoBuffer *) gst_mini_object_new (GST_TYPE_SH_VIDEO_BUFFER);
+		shbuf->format = format;
+		GST_BUFFER_DATA(shbuf) = display_get_back_buff(sink->display);
+		GST_BUFFER_SIZE(shbuf) = size;
+		gst_buffer_set_caps(GST_BUFFER(shbuf), caps);
+
+		if (sink->back_buffer)
+			gst_buffer_unref(sink->back_buffer);
+		sink->back_buffer = gst_buffer_ref(GST_BUFFER(shbuf));
+		sink->back_buffer_shown = FALSE;
+
+		GST_LOG_OBJECT(sink,"Using the display back buffer");
+		*buf = GST_BUFFER(shbuf);
+		return GST_FLOW_OK;
+	}
+
 	/* Using HW buffer */
 	user = uiomux_malloc(sink->uiomux, UIOMUX_SH_VEU, size, getpagesize());
 	if (!user)
@@ -732,9 +994,19 @@ gst_sh_video_sink_buffer_alloc (GstBaseSink *bsink, guint64 offset, guint size,
 		return GST_FLOW_UNEXPECTED;
 	}
 
-	*buf = (GstBuffer *) gst_mini_object_new (GST_TYPE_SH_VIDEO_BUFFER);
-	GST_BUFFER_DATA(*buf) = GST_BUFFER_MALLOCDATA(*buf) = user;
-	GST_BUFFER_SIZE(*buf) = size;
+	shbuf = (GstSHVideoBuffer *) gst_mini_object_new (GST_TYPE_SH_VIDEO_BUFFER);
+	GST_BUFFER_DATA(shbuf) = user;
+	GST_BUFFER_SIZE(shbuf) = size;
+	gst_buffer_set_caps(GST_BUFFER(shbuf), caps);
+
+	/* Freed by the buffer's finalize */
+	shbuf->allocated = 1;
+	shbuf->allocated_size = size;
+	shbuf->uiomux = sink->uiomux;
+	if (gst_caps_to_renesas_format (caps, &format))
+		shbuf->format = format;
+
+	*buf = GST_BUFFER(shbuf);
 
 	return GST_FLOW_OK;
 }
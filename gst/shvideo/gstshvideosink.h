@@ -30,6 +30,8 @@
 #include <gst/gstelement.h>
 #include <uiomux/uiomux.h>
 #include "display.h"
+#include "veusched.h"
+#include "gstshvideobuffer.h"
 
 G_BEGIN_DECLS
 #define GST_TYPE_SH_VIDEO_SINK \
@@ -58,8 +60,18 @@ typedef struct _GstSHVideoSinkClass GstSHVideoSinkClass;
  * \var dst_x X-coordinate of the output
  * \var dst_y Y-coordinate of the output
  * \var zoom_factor Zoom -setting. (See properties)
+ * \var crop Visible area of the incoming frames
+ * \var format Renesas format of the incoming frames
+ * \var pitch Pitch of the incoming frames in pixels, from the caps
+ * \var c_offset Offset of the chroma plane in the incoming frames, from the caps
  * \var display Helper module for display on framebuffer
  * \var uiomux Memory functions that the VEU can use
+ * \var back_buffer Buffer handed upstream that wraps the display back buffer
+ * \var back_buffer_shown Whether back_buffer has been flipped to the screen
+ * \var rotation Rotation of the output (See properties)
+ * \var flip Flip of the output (See properties)
+ * \var veu VEU service, used for rotation
+ * \var rotate_pool Buffers for the rotated frame
  */
 struct _GstSHVideoSink
 {
@@ -76,8 +88,21 @@ struct _GstSHVideoSink
 	gint dst_y;
 	gint zoom_factor;
 
+	struct ren_vid_rect crop;
+	ren_vid_format_t format;
+	gint pitch;
+	gint c_offset;
+
 	DISPLAY *display;
 	UIOMux *uiomux;
+
+	GstBuffer *back_buffer;
+	gboolean back_buffer_shown;
+
+	gint rotation;
+	gint flip;
+	VEU_SERVICE *veu;
+	GstSHVideoBufferPool *rotate_pool;
 };
 
 /**
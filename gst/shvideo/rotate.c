@@ -0,0 +1,157 @@
+/**
+ * Software rotate & flip of video surfaces
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <shveu/shveu.h>
+
+#include "rotate.h"
+
+/* The output is written in tiles, so that the input read for a tile stays
+   in the cache when rotating by 90 or 270 degrees */
+#define TILE 32
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+/* Maps an output position (dx,dy) to the input position
+   (ax*dx + bx*dy + cx, ay*dx + by*dy + cy) */
+struct xform {
+	int ax, bx, cx;
+	int ay, by, cy;
+};
+
+/* w & h are the size of the input plane */
+static void get_xform(int w, int h, int rotation, int flip, struct xform *t)
+{
+	switch (rotation) {
+	case ROTATE_90:
+		t->ax = 0;  t->bx = 1;  t->cx = 0;
+		t->ay = -1; t->by = 0;  t->cy = h - 1;
+		break;
+	case ROTATE_180:
+		t->ax = -1; t->bx = 0;  t->cx = w - 1;
+		t->ay = 0;  t->by = -1; t->cy = h - 1;
+		break;
+	case ROTATE_270:
+		t->ax = 0;  t->bx = -1; t->cx = w - 1;
+		t->ay = 1;  t->by = 0;  t->cy = 0;
+		break;
+	default:
+		t->ax = 1;  t->bx = 0;  t->cx = 0;
+		t->ay = 0;  t->by = 1;  t->cy = 0;
+		break;
+	}
+
+	/* The flip is applied to the input, before rotating */
+	if (flip == FLIP_HORIZONTAL) {
+		t->ax = -t->ax;
+		t->bx = -t->bx;
+		t->cx = w - 1 - t->cx;
+	} else if (flip == FLIP_VERTICAL) {
+		t->ay = -t->ay;
+		t->by = -t->by;
+		t->cy = h - 1 - t->cy;
+	}
+}
+
+/* Pitches are in bytes, bpe is the bytes per element (pixel or UV pair) */
+static void transform_plane(
+	const uint8_t *src, int spitch,
+	uint8_t *dst, int dpitch,
+	int sw, int sh, int dw, int dh,
+	int bpe, int rotation, int flip)
+{
+	struct xform t;
+	const uint8_t *s;
+	ptrdiff_t step;
+	int tx, ty, x, y, n;
+
+	get_xform(sw, sh, rotation, flip, &t);
+	step = t.ax * bpe + (ptrdiff_t)t.ay * spitch;
+
+	for (ty = 0; ty < dh; ty += TILE) {
+		for (tx = 0; tx < dw; tx += TILE) {
+			n = min(TILE, dw - tx);
+
+			for (y = ty; y < min(ty + TILE, dh); y++) {
+				s = src + (t.ax * tx + t.bx * y + t.cx) * bpe
+					+ (ptrdiff_t)(t.ay * tx + t.by * y + t.cy) * spitch;
+
+				switch (bpe) {
+				case 1: {
+					uint8_t *d = dst + (ptrdiff_t)y * dpitch + tx;
+					for (x = 0; x < n; x++, s += step)
+						d[x] = *s;
+					break;
+				}
+				case 2: {
+					uint16_t *d = (uint16_t *)(dst + (ptrdiff_t)y * dpitch) + tx;
+					for (x = 0; x < n; x++, s += step)
+						d[x] = *(const uint16_t *)s;
+					break;
+				}
+				case 4: {
+					uint32_t *d = (uint32_t *)(dst + (ptrdiff_t)y * dpitch) + tx;
+					for (x = 0; x < n; x++, s += step)
+						d[x] = *(const uint32_t *)s;
+					break;
+				}
+				}
+			}
+		}
+	}
+}
+
+int rotate_surface(
+	const struct ren_vid_surface *src,
+	const struct ren_vid_surface *dst,
+	int rotation,
+	int flip)
+{
+	int swap = ROTATE_SWAPS_SIZE(rotation);
+	int bpp;
+
+	if (src->format != dst->format)
+		return -1;
+
+	if (swap && (dst->w != src->h || dst->h != src->w))
+		return -1;
+	if (!swap && (dst->w != src->w || dst->h != src->h))
+		return -1;
+
+	switch (src->format) {
+	case REN_NV12:
+	case REN_NV16:
+		if (src->format == REN_NV16 && swap)
+			return -1;
+
+		transform_plane(src->py, src->pitch, dst->py, dst->pitch,
+			src->w, src->h, dst->w, dst->h, 1, rotation, flip);
+
+		/* Interleaved UV, one pair for every 2 pixels across */
+		if (src->format == REN_NV12)
+			transform_plane(src->pc, src->pitch, dst->pc, dst->pitch,
+				src->w / 2, src->h / 2, dst->w / 2, dst->h / 2, 2, rotation, flip);
+		else
+			transform_plane(src->pc, src->pitch, dst->pc, dst->pitch,
+				src->w / 2, src->h, dst->w / 2, dst->h, 2, rotation, flip);
+		break;
+	case REN_RGB565:
+	case REN_RGB32:
+	case REN_ARGB32:
+		bpp = (src->format == REN_RGB565) ? 2 : 4;
+		transform_plane(src->py, src->pitch * bpp, dst->py, dst->pitch * bpp,
+			src->w, src->h, dst->w, dst->h, bpp, rotation, flip);
+		break;
+	default:
+		return -1;
+	}
+
+	if (src->pa && dst->pa)
+		transform_plane(src->pa, src->pitch, dst->pa, dst->pitch,
+			src->w, src->h, dst->w, dst->h, 1, rotation, flip);
+
+	return 0;
+}
@@ -0,0 +1,46 @@
+/**
+ * Software rotate & flip of video surfaces
+ *
+ * Used where the VEU can't do the job, i.e. anything other than a 90 degree
+ * rotation.
+ */
+
+#ifndef ROTATE_H
+#define ROTATE_H
+
+#include <shveu/shveu.h>
+
+/* Clockwise rotation */
+#define ROTATE_0   0
+#define ROTATE_90  1
+#define ROTATE_180 2
+#define ROTATE_270 3
+
+#define FLIP_NONE       0
+#define FLIP_HORIZONTAL 1
+#define FLIP_VERTICAL   2
+
+/**
+ * Check if a rotation swaps the width & height
+ * \param rotation ROTATE_0, ROTATE_90, ROTATE_180 or ROTATE_270
+ */
+#define ROTATE_SWAPS_SIZE(rotation) ((rotation) == ROTATE_90 || (rotation) == ROTATE_270)
+
+/**
+ * Flip and then rotate a surface. Both surfaces must be the same format, and
+ * the destination must be the size of the rotated source. NV16 can't be
+ * rotated by 90 or 270 degrees, as the chroma would be subsampled vertically.
+ * \param src Input surface
+ * \param dst Output surface
+ * \param rotation ROTATE_0, ROTATE_90, ROTATE_180 or ROTATE_270
+ * \param flip FLIP_NONE, FLIP_HORIZONTAL or FLIP_VERTICAL
+ * \retval 0 Success
+ * \retval -1 Unsupported surfaces
+ */
+int rotate_surface(
+	const struct ren_vid_surface *src,
+	const struct ren_vid_surface *dst,
+	int rotation,
+	int flip);
+
+#endif
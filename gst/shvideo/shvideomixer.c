@@ -17,7 +17,8 @@
  *
  * Overview of changes:
  *  - Replaced blend functions with shbeu library.
- *  - Limited to 3 sink pads.
+ *  - The BEU blends up to 3 layers at a time, so more than 3 sink pads
+ *    are blended in several passes.
  *  - Src format is negotiated as HW can do colorspace conversion.
  *  - Sink formats can be different as HW can do colorspace conversion.
  *  - Size of output buffer is same as background sink buffer.
@@ -56,6 +57,89 @@
  * top of a 320x240 pixels video test source at (40,20). Note that
  * the framerate of the output video is 10 frames per second.
  *
+ * \subsection mixer-examples-2 Picture in picture
+ * \code
+ * gst-launch \
+ *	videotestsrc pattern=1 ! "video/x-raw-yuv, format=(fourcc)NV12, framerate=(fraction)30/1, width=640, height=480" ! queue ! mix. \
+ *	videotestsrc           ! "video/x-raw-yuv, format=(fourcc)NV12, framerate=(fraction)30/1, width=640, height=480" ! queue ! mix. \
+ *	gst-sh-mobile-mixer name=mix sink_1::width=160 sink_1::height=120 sink_1::xpos=460 sink_1::ypos=20 \
+ *	 ! "video/x-raw-yuv, format=(fourcc)NV12" \
+ *	 ! filesink location=tmp.yuv
+ * \endcode
+ *
+ * The "width" & "height" pad properties scale an input with the VEU before
+ * it is blended, so no separate gst-sh-mobile-resize element is needed. The
+ * scaled frame is kept with the pad and reused while the pad's buffer does
+ * not change.
+ *
+ * \section mixer-alpha Per-pixel alpha
+ * Overlays such as rendered UI can carry their own alpha, which the BEU
+ * applies per pixel, on top of the pad's "alpha" property:
+ *  - ARGB inputs ("video/x-raw-rgb, bpp=32, alpha_mask=...") use the alpha
+ *    byte of each pixel.
+ *  - RGB565 inputs with "alpha-plane=(boolean)true" in their caps have an
+ *    8-bit alpha plane, one byte per pixel, after the RGB data.
+ *
+ * Inputs with an alpha plane cannot be scaled, so the "width" & "height"
+ * pad properties must match the input size.
+ *
+ * \section mixer-output Output buffers
+ * The mixer asks downstream for each output buffer first, and blends into it
+ * if it is memory the hardware can use. With gst-sh-mobile-sink and an
+ * RGB565 output the size of the display, the mixer blends straight into the
+ * framebuffer's back buffer, see \ref sink-example-4. Otherwise the mixer
+ * allocates its own buffer.
+ *
+ * \section mixer-live Live mode
+ * By default the mixer waits for a buffer on every input before producing
+ * an output frame, so one stalled input freezes the output. With
+ * live=true, the output is produced at the framerate of the fastest input
+ * (or 30fps if no input has a framerate) on the pipeline clock. Each frame
+ * uses the last buffer received on each input, so late inputs simply show
+ * their previous frame. Like a live source, the mixer produces no data in
+ * PAUSED, and it adds one frame period to the latency reported upstream.
+ *
+ * \section mixer-passes Blending more than three inputs
+ * The BEU hardware blends up to three layers in one pass. With more sink
+ * pads, the first pass blends the bottom three layers (in zorder), and each
+ * following pass blends the result of the previous pass with the next two
+ * layers. This takes 2 passes for 4 or 5 inputs and 4 passes for a 3x3 grid
+ * of 9 inputs.
+ * The passes alternate between the output buffer and a single intermediate
+ * buffer that is kept between frames. The "blend-passes" property reports
+ * the number of passes used for the last frame.
+ *
+ * \section mixer-cache Static layers
+ * Layers such as backgrounds often do not change from one frame to the
+ * next. When the bottom two or more layers (in zorder) are the same as in
+ * the last frame, i.e. the same buffer at the same position and alpha, they
+ * are blended once into a cached buffer. Following frames blend only the
+ * layers above them on top of the cache, until one of the cached layers
+ * changes. Only layers below every changing layer can be cached, e.g. a
+ * static background & logo with live video on top of them.
+ * The "cached-layers" property reports how many layers came from the cache.
+ *
+ * \section mixer-background Backgrounds & fills
+ * The "background" property adds a layer under all of the inputs, either a
+ * solid colour ("background-colour") or a grey checker pattern. With a
+ * background, the inputs need not cover the whole output, so the output
+ * size is taken from the downstream caps if they fix it, e.g.
+ *
+ * \code
+ * gst-launch \
+ *	videotestsrc ! "video/x-raw-yuv, format=(fourcc)NV12, framerate=(fraction)30/1, width=320, height=240" ! queue ! mix. \
+ *	gst-sh-mobile-mixer name=mix background=solid background-colour=0xff0000ff \
+ *	    sink_0::xpos=240 sink_0::ypos=120 sink_0::fill-colour=0x80ffffff \
+ *	 ! "video/x-raw-yuv, format=(fourcc)NV12, width=800, height=480" \
+ *	 ! filesink location=tmp.yuv
+ * \endcode
+ *
+ * The "fill-colour" property of a sink pad fills the area behind its picture,
+ * even when the pad has no buffer yet. Fills are drawn by the CPU once, when
+ * the buffer is allocated, and kept until the size or colour changes, so an
+ * unchanged fill costs only a BEU layer. Fills are cached with the other
+ * static layers, see \ref mixer-cache.
+ *
  * \section mixer-license License
  * This library is free software; you can redistribute it and/or
  * modify it under the terms of the GNU Library General Public
@@ -111,21 +195,34 @@ static void gst_sh_videomixer_pad_set_property (GObject * object, guint prop_id,
 
 static gboolean gst_sh_videomixer_src_event (GstPad * pad, GstEvent * event);
 static gboolean gst_sh_videomixer_sink_event (GstPad * pad, GstEvent * event);
+static GstFlowReturn gst_sh_videomixer_sink_chain (GstPad * pad, GstBuffer * buffer);
 
 static void gst_sh_videomixer_sort_pads (GstSHVideoMixer * mix);
+static void gst_sh_videomixer_set_master_geometry (GstSHVideoMixer * mix);
+static void gst_sh_videomixer_free_intermediates (GstSHVideoMixer * mix);
+static void gst_sh_videomixer_free_last_layers (GstSHVideoMixer * mix);
+
+/* Maximum number of layers the BEU can blend in one pass */
+#define BEU_MAX_LAYERS 3
 
 
 #define DEFAULT_PAD_ZORDER 0
 #define DEFAULT_PAD_XPOS	 0
 #define DEFAULT_PAD_YPOS	 0
 #define DEFAULT_PAD_ALPHA	1.0
+#define DEFAULT_PAD_WIDTH	0
+#define DEFAULT_PAD_HEIGHT	0
+#define DEFAULT_PAD_FILL_COLOUR	0
 enum
 {
 	PROP_PAD_0,
 	PROP_PAD_ZORDER,
 	PROP_PAD_XPOS,
 	PROP_PAD_YPOS,
-	PROP_PAD_ALPHA
+	PROP_PAD_ALPHA,
+	PROP_PAD_WIDTH,
+	PROP_PAD_HEIGHT,
+	PROP_PAD_FILL_COLOUR
 };
 
 G_DEFINE_TYPE (GstSHVideoMixerPad, gst_sh_videomixer_pad, GST_TYPE_PAD);
@@ -154,6 +251,21 @@ gst_sh_videomixer_pad_class_init (GstSHVideoMixerPadClass * klass)
 			g_param_spec_double ("alpha", "Alpha", "Alpha of the picture", 0.0, 1.0,
 					DEFAULT_PAD_ALPHA,
 					G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property (gobject_class, PROP_PAD_WIDTH,
+			g_param_spec_int ("width", "Width",
+					"Width to scale the picture to (0 = input width)",
+					0, G_MAXINT, DEFAULT_PAD_WIDTH,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property (gobject_class, PROP_PAD_HEIGHT,
+			g_param_spec_int ("height", "Height",
+					"Height to scale the picture to (0 = input height)",
+					0, G_MAXINT, DEFAULT_PAD_HEIGHT,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property (gobject_class, PROP_PAD_FILL_COLOUR,
+			g_param_spec_uint ("fill-colour", "Fill colour",
+					"Colour (0xAARRGGBB) to fill the area behind the picture with (alpha 0 = no fill)",
+					0, G_MAXUINT32, DEFAULT_PAD_FILL_COLOUR,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -175,6 +287,15 @@ gst_sh_videomixer_pad_get_property (GObject * object, guint prop_id,
 		case PROP_PAD_ALPHA:
 			g_value_set_double (value, pad->alpha);
 			break;
+		case PROP_PAD_WIDTH:
+			g_value_set_int (value, pad->width);
+			break;
+		case PROP_PAD_HEIGHT:
+			g_value_set_int (value, pad->height);
+			break;
+		case PROP_PAD_FILL_COLOUR:
+			g_value_set_uint (value, pad->fill_colour);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -204,6 +325,27 @@ gst_sh_videomixer_pad_set_property (GObject * object, guint prop_id,
 		case PROP_PAD_ALPHA:
 			pad->alpha = g_value_get_double (value);
 			break;
+		case PROP_PAD_WIDTH:
+			GST_SH_VIDEO_MIXER_STATE_LOCK (mix);
+			pad->width = g_value_get_int (value);
+			gst_sh_videomixer_set_master_geometry (mix);
+			GST_SH_VIDEO_MIXER_STATE_UNLOCK (mix);
+			break;
+		case PROP_PAD_HEIGHT:
+			GST_SH_VIDEO_MIXER_STATE_LOCK (mix);
+			pad->height = g_value_get_int (value);
+			gst_sh_videomixer_set_master_geometry (mix);
+			GST_SH_VIDEO_MIXER_STATE_UNLOCK (mix);
+			break;
+		case PROP_PAD_FILL_COLOUR:
+			GST_SH_VIDEO_MIXER_STATE_LOCK (mix);
+			pad->fill_colour = g_value_get_uint (value);
+			if (pad->fill) {
+				gst_buffer_unref (pad->fill);
+				pad->fill = NULL;
+			}
+			GST_SH_VIDEO_MIXER_STATE_UNLOCK (mix);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -212,6 +354,30 @@ gst_sh_videomixer_pad_set_property (GObject * object, guint prop_id,
 	gst_object_unref (mix);
 }
 
+/* get the output size if it is fixed in the downstream caps */
+static void
+gst_sh_videomixer_get_peer_size (GstSHVideoMixer * mix, gint * width, gint * height)
+{
+	GstCaps *caps;
+	GstStructure *structure;
+	gint w, h;
+
+	caps = gst_pad_peer_get_caps (mix->srcpad);
+	if (!caps)
+		return;
+
+	if (!gst_caps_is_empty (caps) && !gst_caps_is_any (caps)) {
+		structure = gst_caps_get_structure (caps, 0);
+		if (gst_structure_get_int (structure, "width", &w)
+				&& gst_structure_get_int (structure, "height", &h)) {
+			*width = w;
+			*height = h;
+		}
+	}
+
+	gst_caps_unref (caps);
+}
+
 static void
 gst_sh_videomixer_set_master_geometry (GstSHVideoMixer * mix)
 {
@@ -229,8 +395,8 @@ gst_sh_videomixer_set_master_geometry (GstSHVideoMixer * mix)
 		/* Output geometry will be background surface */
 		if (mixpad->zorder < lowest_zorder) {
 			lowest_zorder = mixpad->zorder;
-			width = mixpad->in_width;
-			height = mixpad->in_height;
+			width = mixpad->width ? mixpad->width : mixpad->in_width;
+			height = mixpad->height ? mixpad->height : mixpad->in_height;
 		}
 
 		/* If mix framerate < mixpad framerate, using fractions */
@@ -245,6 +411,11 @@ gst_sh_videomixer_set_master_geometry (GstSHVideoMixer * mix)
 		}
 	}
 
+	/* With a background, the inputs need not cover the output, so
+	   downstream can set the output size */
+	if (mix->background != BACKGROUND_NONE)
+		gst_sh_videomixer_get_peer_size (mix, &width, &height);
+
 	/* set results */
 	if (mix->master != master || mix->in_width != width
 			|| mix->in_height != height || mix->fps_n != fps_n
@@ -266,6 +437,8 @@ gst_sh_videomixer_pad_sink_setcaps (GstPad * pad, GstCaps * vscaps)
 	GstSHVideoMixerPad *mixpad;
 	GstStructure *structure;
 	gint in_width, in_height;
+	ren_vid_format_t format;
+	gboolean alpha_plane;
 	gboolean ret = FALSE;
 	const GValue *framerate;
 
@@ -284,6 +457,9 @@ gst_sh_videomixer_pad_sink_setcaps (GstPad * pad, GstCaps * vscaps)
 			|| (framerate = gst_structure_get_value (structure, "framerate")) == NULL)
 		goto beach;
 
+	if (!gst_caps_to_renesas_format (vscaps, &format))
+		goto beach;
+
 	GST_SH_VIDEO_MIXER_STATE_LOCK (mix);
 	mixpad->fps_n = gst_value_get_fraction_numerator (framerate);
 	mixpad->fps_d = gst_value_get_fraction_denominator (framerate);
@@ -291,6 +467,17 @@ gst_sh_videomixer_pad_sink_setcaps (GstPad * pad, GstCaps * vscaps)
 	mixpad->in_width = in_width;
 	mixpad->in_height = in_height;
 
+	/* Work out the frame layout here rather than for every frame */
+	mixpad->format = format;
+	gst_sh_video_format_parse_layout (vscaps, &mixpad->pitch, &mixpad->c_offset);
+
+	/* RGB565 can carry a separate alpha plane after the colour data */
+	mixpad->a_offset = 0;
+	if (format == REN_RGB565
+			&& gst_structure_get_boolean (structure, "alpha-plane", &alpha_plane)
+			&& alpha_plane)
+		mixpad->a_offset = size_y (format, mixpad->pitch * in_height);
+
 	gst_sh_videomixer_set_master_geometry (mix);
 	GST_SH_VIDEO_MIXER_STATE_UNLOCK (mix);
 
@@ -313,6 +500,9 @@ gst_sh_videomixer_pad_init (GstSHVideoMixerPad * mixerpad)
 	mixerpad->xpos = DEFAULT_PAD_XPOS;
 	mixerpad->ypos = DEFAULT_PAD_YPOS;
 	mixerpad->alpha = DEFAULT_PAD_ALPHA;
+	mixerpad->width = DEFAULT_PAD_WIDTH;
+	mixerpad->height = DEFAULT_PAD_HEIGHT;
+	mixerpad->fill_colour = DEFAULT_PAD_FILL_COLOUR;
 }
 
 /* VideoMixer signals and args */
@@ -322,6 +512,66 @@ enum
 	LAST_SIGNAL
 };
 
+/**
+ * \enum gstshvideomixerproperties
+ * gst-sh-mobile-mixer has following properties:
+ * - "blend-passes" (uint, read-only). Number of BEU passes used to blend
+ *   the last output frame.
+ * - "cache-static" (boolean). Pre-blend the bottom layers that do not change
+ *   between frames. Default: true
+ * - "cached-layers" (uint, read-only). Number of layers taken from the
+ *   static layer cache for the last output frame.
+ * - "live" (boolean). Output frames at a fixed rate on the pipeline clock,
+ *   reusing the last buffer of any input that has no new one, rather than
+ *   waiting for every input. Can only be changed in the NULL or READY
+ *   state. Default: false
+ * - "background" (enum). Fill under all the inputs: "none", "solid" or
+ *   "checker". Default: none
+ * - "background-colour" (uint). Colour (0xAARRGGBB) of a solid background.
+ *   Default: 0xff000000 (black)
+ */
+enum gstshvideomixerproperties
+{
+	PROP_0,
+	PROP_BLEND_PASSES,
+	PROP_CACHE_STATIC,
+	PROP_CACHED_LAYERS,
+	PROP_LIVE,
+	PROP_BACKGROUND,
+	PROP_BACKGROUND_COLOUR
+};
+
+#define DEFAULT_CACHE_STATIC TRUE
+#define DEFAULT_LIVE FALSE
+#define DEFAULT_BACKGROUND BACKGROUND_NONE
+#define DEFAULT_BACKGROUND_COLOUR 0xff000000
+
+/* Size & colours of the checker background squares */
+#define CHECKER_SIZE 16
+#define CHECKER_LIGHT 0xffcccccc
+#define CHECKER_DARK 0xff808080
+
+#define GST_TYPE_SH_VIDEO_MIXER_BACKGROUND (gst_sh_videomixer_background_get_type())
+static GType
+gst_sh_videomixer_background_get_type (void)
+{
+	static GType object_type = 0;
+	static const GEnumValue background[] = {
+		{BACKGROUND_NONE, "No background", "none"},
+		{BACKGROUND_SOLID, "Solid colour", "solid"},
+		{BACKGROUND_CHECKER, "Checker pattern", "checker"},
+		{0, NULL, NULL},
+	};
+
+	if (object_type == 0) {
+		object_type = g_enum_register_static ("GstSHVideoMixerBackground", background);
+	}
+	return object_type;
+}
+
+/* Output framerate in live mode when none of the inputs has a framerate */
+#define DEFAULT_LIVE_FPS 30
+
 static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE("src",
 	GST_PAD_SRC,
 	GST_PAD_ALWAYS,
@@ -446,6 +696,37 @@ gst_sh_videomixer_class_init (GstSHVideoMixerClass * klass)
 	gobject_class->get_property = gst_sh_videomixer_get_property;
 	gobject_class->set_property = gst_sh_videomixer_set_property;
 
+	g_object_class_install_property (gobject_class, PROP_BLEND_PASSES,
+			g_param_spec_uint ("blend-passes", "Blend passes",
+					"Number of BEU passes used for the last frame",
+					0, G_MAXUINT, 0,
+					G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property (gobject_class, PROP_CACHE_STATIC,
+			g_param_spec_boolean ("cache-static", "Cache static layers",
+					"Pre-blend the bottom layers that do not change between frames",
+					DEFAULT_CACHE_STATIC,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property (gobject_class, PROP_CACHED_LAYERS,
+			g_param_spec_uint ("cached-layers", "Cached layers",
+					"Number of layers taken from the static layer cache for the last frame",
+					0, G_MAXUINT, 0,
+					G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property (gobject_class, PROP_LIVE,
+			g_param_spec_boolean ("live", "Live",
+					"Output at a fixed rate without waiting for every input",
+					DEFAULT_LIVE,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property (gobject_class, PROP_BACKGROUND,
+			g_param_spec_enum ("background", "Background",
+					"Fill under all the inputs",
+					GST_TYPE_SH_VIDEO_MIXER_BACKGROUND, DEFAULT_BACKGROUND,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property (gobject_class, PROP_BACKGROUND_COLOUR,
+			g_param_spec_uint ("background-colour", "Background colour",
+					"Colour (0xAARRGGBB) of a solid background",
+					0, G_MAXUINT32, DEFAULT_BACKGROUND_COLOUR,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
 	gstelement_class->request_new_pad =
 			GST_DEBUG_FUNCPTR (gst_sh_videomixer_request_new_pad);
 	gstelement_class->release_pad =
@@ -463,10 +744,25 @@ gst_sh_videomixer_class_init (GstSHVideoMixerClass * klass)
 static void
 gst_sh_videomixer_collect_free (GstSHVideoMixerCollect * mixcol)
 {
+	GstSHVideoMixerPad *mixpad = mixcol->mixpad;
+
 	if (mixcol->buffer) {
 		gst_buffer_unref (mixcol->buffer);
 		mixcol->buffer = NULL;
 	}
+
+	if (mixpad->scaled) {
+		gst_buffer_unref (mixpad->scaled);
+		mixpad->scaled = NULL;
+	}
+	if (mixpad->scaled_from) {
+		gst_buffer_unref (mixpad->scaled_from);
+		mixpad->scaled_from = NULL;
+	}
+	if (mixpad->fill) {
+		gst_buffer_unref (mixpad->fill);
+		mixpad->fill = NULL;
+	}
 }
 
 static void
@@ -480,11 +776,20 @@ gst_sh_videomixer_reset (GstSHVideoMixer * mix)
 	mix->out_height = 0;
 	mix->fps_n = mix->fps_d = 0;
 	mix->setcaps = FALSE;
+	mix->out_own_buffers = FALSE;
 	mix->sendseg = FALSE;
 	mix->segment_position = 0;
 	mix->segment_rate = 1.0;
 
 	mix->last_ts = 0;
+	mix->blend_passes = 0;
+	mix->cached_layers = 0;
+	mix->live_eos = FALSE;
+	mix->live_time = 0;
+	mix->upstream_latency = 0;
+
+	gst_sh_videomixer_free_intermediates (mix);
+	gst_sh_videomixer_free_last_layers (mix);
 
 	/* clean up collect data */
 	walk = mix->collect->data;
@@ -519,11 +824,11 @@ gst_sh_videomixer_init (GstSHVideoMixer * mix, GstSHVideoMixerClass * g_class)
 			(GstCollectPadsFunction) GST_DEBUG_FUNCPTR (gst_sh_videomixer_collected),
 			mix);
 
-	// TODO add fail checks
-	mix->uiomux = uiomux_open();
-	mix->beu = shbeu_open();
-
 	mix->state_lock = g_mutex_new ();
+	mix->cache_static = DEFAULT_CACHE_STATIC;
+	mix->live = DEFAULT_LIVE;
+	mix->background = DEFAULT_BACKGROUND;
+	mix->background_colour = DEFAULT_BACKGROUND_COLOUR;
 	/* initialize variables */
 	gst_sh_videomixer_reset (mix);
 }
@@ -536,8 +841,17 @@ gst_sh_videomixer_finalize (GObject * object)
 	gst_object_unref (mix->collect);
 	g_mutex_free (mix->state_lock);
 
-	shbeu_close(mix->beu);
-	uiomux_close(mix->uiomux);
+	gst_sh_videomixer_free_intermediates (mix);
+	gst_sh_videomixer_free_last_layers (mix);
+	g_free (mix->layers);
+	g_free (mix->last_layers);
+
+	if (mix->beu)
+		shbeu_close (mix->beu);
+	if (mix->veu)
+		veu_service_close (mix->veu);
+	if (mix->uiomux)
+		uiomux_close (mix->uiomux);
 
 	G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -688,6 +1002,24 @@ gst_sh_videomixer_query_latency (GstSHVideoMixer * mix, GstQuery * query)
 	}
 	gst_iterator_free (it);
 
+	if (res && mix->live) {
+		GstClockTime duration;
+
+		/* The output waits for the upstream latency, and each frame holds the
+		   inputs received over one frame period */
+		mix->upstream_latency = min;
+
+		if (mix->fps_n > 0 && mix->fps_d > 0)
+			duration = gst_util_uint64_scale_int (GST_SECOND, mix->fps_d, mix->fps_n);
+		else
+			duration = gst_util_uint64_scale_int (GST_SECOND, 1, DEFAULT_LIVE_FPS);
+
+		live = TRUE;
+		min += duration;
+		if (max != GST_CLOCK_TIME_NONE)
+			max += duration;
+	}
+
 	if (res) {
 		/* store the results */
 		GST_DEBUG_OBJECT (mix, "Calculated total latency: live %s, min %"
@@ -797,6 +1129,13 @@ gst_sh_videomixer_request_new_pad (GstElement * element,
 		gst_pad_set_event_function (GST_PAD (mixpad),
 				GST_DEBUG_FUNCPTR (gst_sh_videomixer_sink_event));
 
+		/* Likewise for the chain function, so that buffers can bypass
+		 * GstCollectPads in live mode */
+		mix->collect_chain =
+				(GstPadChainFunction) GST_PAD_CHAINFUNC (GST_PAD (mixpad));
+		gst_pad_set_chain_function (GST_PAD (mixpad),
+				GST_DEBUG_FUNCPTR (gst_sh_videomixer_sink_chain));
+
 		/* Keep track of each other */
 		mixcol->mixpad = mixpad;
 		mixpad->mixcol = mixcol;
@@ -954,30 +1293,395 @@ gst_sh_videomixer_fill_queues (GstSHVideoMixer * mix)
 	return eos;
 }
 
+/* drop the intermediate buffers, e.g. when the output size changes */
+static void
+gst_sh_videomixer_free_intermediates (GstSHVideoMixer * mix)
+{
+	if (mix->scratch) {
+		gst_buffer_unref (mix->scratch);
+		mix->scratch = NULL;
+	}
+	if (mix->cache) {
+		gst_buffer_unref (mix->cache);
+		mix->cache = NULL;
+	}
+	mix->nr_cached = 0;
+	if (mix->background_buf) {
+		gst_buffer_unref (mix->background_buf);
+		mix->background_buf = NULL;
+	}
+}
+
+/* forget the layers blended in the last output frame */
+static void
+gst_sh_videomixer_free_last_layers (GstSHVideoMixer * mix)
+{
+	int i;
+
+	for (i = 0; i < mix->nr_last_layers; i++)
+		gst_buffer_unref (mix->last_layers[i].buffer);
+	mix->nr_last_layers = 0;
+}
+
+/* describe an output sized intermediate buffer as a BEU layer */
+static gboolean
+gst_sh_videomixer_get_intermediate (GstSHVideoMixer * mix, GstBuffer ** buf,
+		struct shbeu_surface *surface)
+{
+	if (!*buf) {
+		*buf = gst_sh_video_buffer_new(mix->uiomux,
+				mix->out_width, mix->out_height, mix->out_format);
+		if (!*buf)
+			return FALSE;
+	}
+
+	gst_sh_video_buffer_get_surface (*buf, mix->out_format,
+			mix->out_width, mix->out_height, 0, 0, &surface->s);
+	surface->alpha = 255;
+	surface->x = 0;
+	surface->y = 0;
+
+	return TRUE;
+}
+
+/* blend layers, bottom first, into dst. Returns the number of BEU passes
+   used, or -1 on failure */
+static int
+gst_sh_videomixer_blend_layers (GstSHVideoMixer * mix,
+		struct shbeu_surface *layers, int nr_layers, struct shbeu_surface *dst)
+{
+	int layer, pass, passes;
+	struct shbeu_surface scratch;
+	struct shbeu_surface prev;
+	struct shbeu_surface *target;
+
+	/* The first pass blends up to 3 layers, every other pass blends the
+	   previous result with up to 2 more layers */
+	passes = 1;
+	if (nr_layers > BEU_MAX_LAYERS)
+		passes += (nr_layers - 2) / (BEU_MAX_LAYERS - 1);
+
+	if (passes > 1 && !gst_sh_videomixer_get_intermediate (mix, &mix->scratch, &scratch)) {
+		GST_ELEMENT_ERROR(mix, RESOURCE, NO_SPACE_LEFT,
+			("failed to allocate intermediate buffer"), (NULL));
+		return -1;
+	}
+
+	/* Hardware blend. Alternate between the scratch & output buffers so that
+	   the last pass writes to the output buffer */
+	layer = 0;
+	for (pass = passes; pass > 0; pass--) {
+		struct shbeu_surface *src[BEU_MAX_LAYERS] = { NULL };
+		int i = 0;
+
+		if (layer > 0) {
+			src[i++] = &prev;
+		}
+		while (i < BEU_MAX_LAYERS && layer < nr_layers) {
+			src[i++] = &layers[layer++];
+		}
+
+		target = (pass & 1) ? dst : &scratch;
+
+		GST_LOG("Calling HW blend, pass %d of %d...", passes - pass + 1, passes);
+		if (shbeu_blend(mix->beu, src[0], src[1], src[2], target)) {
+			GST_ELEMENT_ERROR(mix, RESOURCE, FAILED, ("shbeu_blend failed!"), (NULL));
+			return -1;
+		}
+
+		prev = *target;
+		prev.alpha = 255;
+		prev.x = 0;
+		prev.y = 0;
+	}
+
+	return passes;
+}
+
+/* scale the input of a pad to the size set on the pad. The scaled frame is
+   reused until the pad gets a new buffer */
+static gboolean
+gst_sh_videomixer_scale_input (GstSHVideoMixer * mix, GstSHVideoMixerPad * pad,
+		GstBuffer * in_buf, struct shbeu_surface *layer)
+{
+	struct ren_vid_surface dst;
+	gint width, height;
+
+	width = pad->width ? pad->width : (gint) pad->in_width;
+	height = pad->height ? pad->height : (gint) pad->in_height;
+
+	if (width == (gint) pad->in_width && height == (gint) pad->in_height)
+		return TRUE;
+
+	/* The VEU cannot scale a separate alpha plane */
+	if (layer->s.pa) {
+		GST_WARNING_OBJECT (pad, "cannot scale an input with an alpha plane");
+		return FALSE;
+	}
+
+	if (pad->scaled && (pad->scaled_width != width || pad->scaled_height != height
+			|| GST_SH_VIDEO_BUFFER (pad->scaled)->format != pad->format)) {
+		gst_buffer_unref (pad->scaled);
+		pad->scaled = NULL;
+	}
+
+	if (!pad->scaled) {
+		pad->scaled = gst_sh_video_buffer_new(mix->uiomux, width, height, pad->format);
+		if (!pad->scaled)
+			return FALSE;
+		pad->scaled_width = width;
+		pad->scaled_height = height;
+
+		if (pad->scaled_from) {
+			gst_buffer_unref (pad->scaled_from);
+			pad->scaled_from = NULL;
+		}
+	}
+
+	gst_sh_video_buffer_get_surface (pad->scaled, pad->format, width, height, 0, 0, &dst);
+
+	if (pad->scaled_from != in_buf) {
+		GST_LOG_OBJECT (pad, "scaling from %dx%d to %dx%d",
+				layer->s.w, layer->s.h, width, height);
+
+		if (veu_service_resize(mix->veu, &layer->s, &dst, VEU_PRIORITY_NORMAL) < 0)
+			return FALSE;
+
+		if (pad->scaled_from)
+			gst_buffer_unref (pad->scaled_from);
+		pad->scaled_from = gst_buffer_ref (in_buf);
+	}
+
+	layer->s = dst;
+
+	return TRUE;
+}
+
+/* convert an ARGB colour to BT.601 video range YUV */
+static void
+gst_sh_videomixer_rgb_to_yuv (guint32 argb, guint8 * y, guint8 * u, guint8 * v)
+{
+	gint r = (argb >> 16) & 0xff;
+	gint g = (argb >> 8) & 0xff;
+	gint b = argb & 0xff;
+
+	*y = 16 + ((66 * r + 129 * g + 25 * b + 128) >> 8);
+	*u = 128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8);
+	*v = 128 + ((112 * r - 94 * g - 18 * b + 128) >> 8);
+}
+
+/* fill part of a line of a surface with a colour */
+static void
+gst_sh_videomixer_fill_span (struct ren_vid_surface *s, gint x, gint line,
+		gint width, guint32 argb)
+{
+	guint8 y, u, v;
+	guint8 *p;
+	guint16 *p16;
+	guint16 rgb565;
+	gint i;
+
+	switch (s->format) {
+		case REN_NV12:
+		case REN_NV16:
+			gst_sh_videomixer_rgb_to_yuv (argb, &y, &u, &v);
+			memset ((guint8 *) s->py + line * s->pitch + x, y, width);
+
+			/* NV12 chroma is subsampled vertically, NV16 is not */
+			if (s->format == REN_NV12) {
+				if (line & 1)
+					break;
+				line /= 2;
+			}
+			p = (guint8 *) s->pc + line * s->pitch + (x & ~1);
+			for (i = 0; i < width; i += 2) {
+				*p++ = u;
+				*p++ = v;
+			}
+			break;
+		case REN_RGB565:
+			rgb565 = ((argb >> 8) & 0xf800) | ((argb >> 5) & 0x07e0) | ((argb >> 3) & 0x001f);
+			p16 = (guint16 *) s->py + line * s->pitch + x;
+			for (i = 0; i < width; i++)
+				*p16++ = rgb565;
+			break;
+		case REN_RGB32:
+			p = (guint8 *) s->py + (line * s->pitch + x) * 4;
+			for (i = 0; i < width; i++) {
+				*p++ = (argb >> 16) & 0xff;
+				*p++ = (argb >> 8) & 0xff;
+				*p++ = argb & 0xff;
+				*p++ = 0xff;
+			}
+			break;
+		case REN_ARGB32:
+			p = (guint8 *) s->py + (line * s->pitch + x) * 4;
+			for (i = 0; i < width; i++) {
+				*p++ = (argb >> 24) & 0xff;
+				*p++ = (argb >> 16) & 0xff;
+				*p++ = (argb >> 8) & 0xff;
+				*p++ = argb & 0xff;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/* fill a surface with a colour, or with a checker pattern */
+static void
+gst_sh_videomixer_fill (struct ren_vid_surface *s, guint32 argb, gboolean checker)
+{
+	gint x, line, width;
+	guint32 colour;
+
+	for (line = 0; line < s->h; line++) {
+		if (!checker) {
+			gst_sh_videomixer_fill_span (s, 0, line, s->w, argb);
+			continue;
+		}
+
+		for (x = 0; x < s->w; x += CHECKER_SIZE) {
+			width = MIN (CHECKER_SIZE, s->w - x);
+			colour = ((x / CHECKER_SIZE + line / CHECKER_SIZE) & 1) ?
+					CHECKER_DARK : CHECKER_LIGHT;
+			gst_sh_videomixer_fill_span (s, x, line, width, colour);
+		}
+	}
+}
+
+/* describe the fill behind a pad's picture as a BEU layer. The fill is
+   drawn once and reused until the pad's size or fill colour changes */
+static gboolean
+gst_sh_videomixer_get_pad_fill (GstSHVideoMixer * mix, GstSHVideoMixerPad * pad,
+		struct shbeu_surface *surface)
+{
+	gint width, height;
+
+	width = pad->width ? pad->width : (gint) pad->in_width;
+	height = pad->height ? pad->height : (gint) pad->in_height;
+
+	if (pad->fill && (pad->fill_width != width || pad->fill_height != height
+			|| GST_SH_VIDEO_BUFFER (pad->fill)->format != mix->out_format)) {
+		gst_buffer_unref (pad->fill);
+		pad->fill = NULL;
+	}
+
+	surface->alpha = (gint) (((pad->fill_colour >> 24) & 0xff) * pad->alpha);
+	surface->x = pad->xpos;
+	surface->y = pad->ypos;
+
+	if (pad->fill) {
+		gst_sh_video_buffer_get_surface (pad->fill, mix->out_format,
+				width, height, 0, 0, &surface->s);
+		return TRUE;
+	}
+
+	pad->fill = gst_sh_video_buffer_new(mix->uiomux, width, height, mix->out_format);
+	if (!pad->fill)
+		return FALSE;
+	pad->fill_width = width;
+	pad->fill_height = height;
+
+	gst_sh_video_buffer_get_surface (pad->fill, mix->out_format,
+			width, height, 0, 0, &surface->s);
+	gst_sh_videomixer_fill (&surface->s, pad->fill_colour, FALSE);
+
+	return TRUE;
+}
+
+/* check if a layer is the same as in the last output frame */
+static gboolean
+gst_sh_videomixer_layer_unchanged (GstSHVideoMixerLayer * last,
+		GstSHVideoMixerPad * pad, GstBuffer * buf, struct shbeu_surface *curr)
+{
+	return (last->pad == pad
+		&& last->buffer == buf
+		&& last->surface.s.format == curr->s.format
+		&& last->surface.s.w == curr->s.w
+		&& last->surface.s.h == curr->s.h
+		&& last->surface.x == curr->x
+		&& last->surface.y == curr->y
+		&& last->surface.alpha == curr->alpha);
+}
+
+/* add the last described layer, checking if the bottom layers are the same
+   as in the last frame & remembering it for the next frame */
+static void
+gst_sh_videomixer_add_layer (GstSHVideoMixer * mix, GstSHVideoMixerPad * pad,
+		GstBuffer * buf, gint * nr_layers, gint * nr_static)
+{
+	gint n = *nr_layers;
+	struct shbeu_surface *curr = &mix->layers[n];
+
+	if (*nr_static == n && n < mix->nr_last_layers
+			&& gst_sh_videomixer_layer_unchanged (&mix->last_layers[n], pad, buf, curr))
+		(*nr_static)++;
+
+	if (n < mix->nr_last_layers)
+		gst_buffer_unref (mix->last_layers[n].buffer);
+	else
+		mix->nr_last_layers = n + 1;
+	mix->last_layers[n].pad = pad;
+	mix->last_layers[n].buffer = gst_buffer_ref (buf);
+	mix->last_layers[n].surface = *curr;
+
+	*nr_layers = n + 1;
+}
+
 /* blend all buffers present on the pads */
 static void
 gst_sh_videomixer_blend_buffers (GstSHVideoMixer * mix, GstBuffer * outbuf)
 {
 	GSList *walk;
-	int sink_index = 0;
+	gint nr_layers = 0;
+	gint nr_static;
+	gint max_layers;
+	int passes, ret;
 	struct shbeu_surface dst;
-	struct shbeu_surface src[3];
-	struct shbeu_surface *psrc[3] = { NULL };
+	struct shbeu_surface cache;
 	struct shbeu_surface *curr;
 
 	GST_LOG("***** Start *****");
 
+	/* A picture & a fill for each pad, and the background */
+	max_layers = 2 * mix->numpads + 1;
+	if (mix->nr_layers_alloc < max_layers) {
+		mix->layers = g_renew (struct shbeu_surface, mix->layers, max_layers);
+		mix->last_layers = g_renew (GstSHVideoMixerLayer, mix->last_layers, max_layers);
+		mix->nr_layers_alloc = max_layers;
+	}
+
 	/* Output buffer is always SH video buffer */
-	dst.s.format = mix->out_format;
-	dst.s.w = mix->out_width;
-	dst.s.h = mix->out_height;
-	dst.s.pitch = mix->out_width;
-	dst.s.py = GST_BUFFER_DATA(outbuf);
-	dst.s.pc = get_c_addr(dst.s.py, dst.s.format, mix->out_width, mix->out_height);
-	dst.s.pa = NULL;
+	gst_sh_video_buffer_get_surface (outbuf, mix->out_format,
+			mix->out_width, mix->out_height, 0, 0, &dst.s);
+	dst.alpha = 255;
+	dst.x = 0;
+	dst.y = 0;
 
 	GST_LOG("output buffer=%p (%dx%d)", dst.s.py, dst.s.w, dst.s.h);
 
+	/* Count the bottom layers that are the same as in the last frame */
+	nr_static = 0;
+
+	if (mix->background != BACKGROUND_NONE) {
+		gboolean new_fill = (mix->background_buf == NULL);
+
+		curr = &mix->layers[nr_layers];
+		if (!gst_sh_videomixer_get_intermediate (mix, &mix->background_buf, curr)) {
+			GST_ELEMENT_ERROR(mix, RESOURCE, NO_SPACE_LEFT,
+				("failed to allocate background buffer"), (NULL));
+			return;
+		}
+		if (new_fill)
+			gst_sh_videomixer_fill (&curr->s, mix->background_colour,
+					mix->background == BACKGROUND_CHECKER);
+		if (mix->background == BACKGROUND_SOLID)
+			curr->alpha = (mix->background_colour >> 24) & 0xff;
+
+		gst_sh_videomixer_add_layer (mix, NULL, mix->background_buf, &nr_layers, &nr_static);
+	}
+
 	walk = mix->sinkpads;
 	while (walk) {								/* We walk with this list because it's ordered */
 		GstSHVideoMixerPad *pad = GST_SH_VIDEO_MIXER_PAD (walk->data);
@@ -986,6 +1690,18 @@ gst_sh_videomixer_blend_buffers (GstSHVideoMixer * mix, GstBuffer * outbuf)
 
 		walk = g_slist_next (walk);
 
+		/* The fill is shown whether or not the pad has a buffer */
+		if ((pad->fill_colour >> 24) && (pad->width || pad->in_width)
+				&& (pad->height || pad->in_height)) {
+			curr = &mix->layers[nr_layers];
+			if (!gst_sh_videomixer_get_pad_fill (mix, pad, curr)) {
+				GST_ELEMENT_ERROR(mix, RESOURCE, NO_SPACE_LEFT,
+					("failed to allocate fill buffer"), (NULL));
+				return;
+			}
+			gst_sh_videomixer_add_layer (mix, pad, pad->fill, &nr_layers, &nr_static);
+		}
+
 		if (in_buf != NULL) {
 			GstClockTime timestamp;
 			gint64 stream_time;
@@ -1003,22 +1719,25 @@ gst_sh_videomixer_blend_buffers (GstSHVideoMixer * mix, GstBuffer * outbuf)
 
 			GST_LOG("Input buffer=%p (%dx%d) alpha=%f", GST_BUFFER_DATA (in_buf), pad->in_width, pad->in_height, pad->alpha);
 
-			psrc[sink_index] = &src[sink_index];
-			curr = psrc[sink_index];
+			curr = &mix->layers[nr_layers];
 
-			gst_caps_to_renesas_format(gst_pad_get_negotiated_caps (GST_PAD (pad)), &curr->s.format);
-			curr->s.w = pad->in_width;
-			curr->s.h = pad->in_height;
-			curr->s.pitch = pad->in_width;
-
-			curr->s.py = GST_BUFFER_DATA(in_buf);
-			curr->s.pc = get_c_addr(curr->s.py, curr->s.format, pad->in_width, pad->in_height);
-			curr->s.pa = NULL;
+			gst_sh_video_buffer_get_surface (in_buf, pad->format,
+					pad->in_width, pad->in_height,
+					pad->pitch, pad->c_offset, &curr->s);
+			curr->s.pa = pad->a_offset ? curr->s.py + pad->a_offset : NULL;
 
 			curr->alpha = (int)(pad->alpha * 255.0);
 			curr->x = pad->xpos;
 			curr->y = pad->ypos;
 
+			if (!gst_sh_videomixer_scale_input (mix, pad, in_buf, curr)) {
+				GST_ELEMENT_ERROR(mix, RESOURCE, FAILED,
+					("failed to scale input"), (NULL));
+				return;
+			}
+
+			gst_sh_videomixer_add_layer (mix, pad, in_buf, &nr_layers, &nr_static);
+
 			/* Timestamp & duration is based on fastest sink */
 			if (pad == mix->master) {
 				gint64 running_time;
@@ -1034,34 +1753,58 @@ gst_sh_videomixer_blend_buffers (GstSHVideoMixer * mix, GstBuffer * outbuf)
 					mix->last_ts += GST_BUFFER_DURATION (outbuf);
 				}
 			}
-
-			sink_index++;
 		}
 	}
 
+	/* Drop the rest of the remembered layers */
+	while (mix->nr_last_layers > nr_layers)
+		gst_buffer_unref (mix->last_layers[--mix->nr_last_layers].buffer);
 
-	/* Hardware blend */
-	GST_LOG("Calling HW blend...");
-	if (shbeu_blend(mix->beu, psrc[0], psrc[1], psrc[2], &dst)) {
-		GST_ELEMENT_ERROR(mix, RESOURCE, FAILED, ("shbeu_blend failed!"), (NULL));
+	if (nr_layers == 0)
 		return;
+
+	/* The cache is only valid while all of the layers in it are unchanged */
+	if (mix->nr_cached > nr_static) {
+		GST_LOG("%d of %d cached layers have changed", mix->nr_cached - nr_static, mix->nr_cached);
+		mix->nr_cached = 0;
 	}
 
+	passes = 0;
 
-	/* Clean up after blend */
-	sink_index=0;
-	walk = mix->sinkpads;
-	while (walk) {
-		GstSHVideoMixerPad *pad = GST_SH_VIDEO_MIXER_PAD (walk->data);
-		GstSHVideoMixerCollect *mixcol = pad->mixcol;
-		GstBuffer *in_buf = mixcol->buffer;
+	/* Pre-blend the unchanged bottom layers once they have been static for a
+	   frame. There is nothing to gain from caching a single layer. */
+	if (mix->cache_static && nr_static >= 2 && nr_static > mix->nr_cached) {
+		if (!gst_sh_videomixer_get_intermediate (mix, &mix->cache, &cache)) {
+			GST_ELEMENT_ERROR(mix, RESOURCE, NO_SPACE_LEFT,
+				("failed to allocate cache buffer"), (NULL));
+			return;
+		}
 
-		walk = g_slist_next (walk);
+		ret = gst_sh_videomixer_blend_layers (mix, mix->layers, nr_static, &cache);
+		if (ret < 0)
+			return;
+		passes += ret;
 
-		if (in_buf != NULL) {
-			sink_index++;
-		}
+		GST_DEBUG_OBJECT (mix, "cached %d static layers", nr_static);
+		mix->nr_cached = nr_static;
+	}
+
+	if (mix->nr_cached > 0) {
+		/* Use the cache in place of the layers it contains */
+		gst_sh_videomixer_get_intermediate (mix, &mix->cache, &cache);
+		mix->layers[mix->nr_cached - 1] = cache;
+		ret = gst_sh_videomixer_blend_layers (mix, &mix->layers[mix->nr_cached - 1],
+				nr_layers - mix->nr_cached + 1, &dst);
+	} else {
+		ret = gst_sh_videomixer_blend_layers (mix, mix->layers, nr_layers, &dst);
 	}
+	if (ret < 0)
+		return;
+	passes += ret;
+
+	mix->blend_passes = passes;
+	mix->cached_layers = mix->nr_cached;
+	GST_LOG("Blended %d layers (%d cached) in %d passes", nr_layers, mix->nr_cached, passes);
 
 	GST_LOG("***** End *****");
 }
@@ -1105,17 +1848,118 @@ gst_sh_videomixer_update_queues (GstSHVideoMixer * mix)
 	}
 }
 
+/* set new src caps if the geometry has changed & allocate an output
+   buffer. Call with the state lock held */
+static GstBuffer *
+gst_sh_videomixer_new_output (GstSHVideoMixer * mix)
+{
+	GstBuffer *outbuf;
+	ren_vid_format_t renfmt;
+	GstCaps *peer_caps, *src_caps;
+	GstFlowReturn ret;
+	guint size;
+
+	/* If geometry has changed we need to set new caps on the buffer */
+	if (mix->in_width != mix->out_width || mix->in_height != mix->out_height
+			|| mix->setcaps)
+	{
+		mix->out_width = mix->in_width;
+		mix->out_height = mix->in_height;
+		mix->setcaps = FALSE;
+
+		gst_sh_videomixer_free_intermediates (mix);
+
+		/* Set SRC caps, using the first format downstream prefers that we
+		   can output */
+		peer_caps = gst_pad_peer_get_caps(GST_PAD(mix->srcpad));
+		if (!peer_caps)
+			return NULL;
+		src_caps = gst_caps_intersect(peer_caps,
+				gst_pad_get_pad_template_caps(GST_PAD(mix->srcpad)));
+		gst_caps_unref(peer_caps);
+		if (gst_caps_is_empty(src_caps)) {
+			GST_ELEMENT_ERROR(mix, CORE, NEGOTIATION,
+				("downstream accepts none of the output formats"), (NULL));
+			gst_caps_unref(src_caps);
+			/* try again with the next frame */
+			mix->setcaps = TRUE;
+			mix->out_format = REN_UNKNOWN;
+			return NULL;
+		}
+		gst_caps_truncate(src_caps);
+		gst_caps_set_simple (src_caps,
+						"width", G_TYPE_INT, mix->out_width,
+						"height", G_TYPE_INT, mix->out_height,
+						"framerate", GST_TYPE_FRACTION, mix->fps_n, mix->fps_d,
+						NULL);
+		gst_pad_set_caps(mix->srcpad,src_caps);
+		gst_caps_unref(src_caps);
+
+		/* Work out the output format here rather than for every frame */
+		mix->out_own_buffers = FALSE;
+		mix->out_format = REN_UNKNOWN;
+		if (GST_PAD_CAPS(mix->srcpad)
+				&& gst_caps_to_renesas_format(GST_PAD_CAPS(mix->srcpad), &renfmt))
+			mix->out_format = renfmt;
+	}
+
+	if (mix->out_format == REN_UNKNOWN) {
+		GST_LOG("Can't get ren format from src caps");
+		return NULL;
+	}
+
+	/* Downstream can provide memory the BEU can use, e.g. the display's
+	   back buffer, saving a copy of the frame */
+	size = size_y(mix->out_format, mix->out_width * mix->out_height)
+			+ size_c(mix->out_format, mix->out_width * mix->out_height);
+	if (!mix->out_own_buffers) {
+		ret = gst_pad_alloc_buffer_and_set_caps(mix->srcpad, GST_BUFFER_OFFSET_NONE,
+				size, GST_PAD_CAPS(mix->srcpad), &outbuf);
+		if (ret == GST_FLOW_OK) {
+			if (GST_IS_SH_VIDEO_BUFFER(outbuf) && GST_BUFFER_SIZE(outbuf) >= size
+					&& GST_BUFFER_CAPS(outbuf)
+					&& gst_caps_is_equal(GST_BUFFER_CAPS(outbuf), GST_PAD_CAPS(mix->srcpad))) {
+				GST_LOG("Using buffer from downstream");
+				GST_BUFFER_OFFSET(outbuf) = GST_BUFFER_OFFSET_NONE;
+				return outbuf;
+			}
+			gst_buffer_unref(outbuf);
+
+			/* Don't have downstream allocate a frame for nothing each time */
+			GST_DEBUG_OBJECT(mix, "Downstream buffers not usable, allocating our own");
+			mix->out_own_buffers = TRUE;
+		}
+	}
+
+	outbuf = gst_sh_video_buffer_new(mix->uiomux, mix->out_width, mix->out_height, mix->out_format);
+	if (!outbuf) {
+		GST_LOG("Failed to allocate SH buffer");
+		return NULL;
+	}
+
+	GST_BUFFER_OFFSET(outbuf) = GST_BUFFER_OFFSET_NONE;
+	gst_buffer_set_caps(outbuf, GST_PAD_CAPS(mix->srcpad));
+
+	return outbuf;
+}
+
 static GstFlowReturn
 gst_sh_videomixer_collected (GstCollectPads * pads, GstSHVideoMixer * mix)
 {
 	GstFlowReturn ret = GST_FLOW_OK;
 	GstBuffer *outbuf = NULL;
 	gboolean eos = FALSE;
-	int renfmt;
-	GstCaps *src_caps;
 
 	g_return_val_if_fail (GST_IS_VIDEO_MIXER (mix), GST_FLOW_ERROR);
 
+	/* In live mode, buffers bypass collectpads, so we only get here once all
+	   the sink pads are EOS. The output task sends EOS downstream. */
+	if (mix->live) {
+		GST_LOG_OBJECT (mix, "all our sinkpads are EOS");
+		mix->live_eos = TRUE;
+		return GST_FLOW_UNEXPECTED;
+	}
+
 	/* This must be set, otherwise we have no caps */
 	if (G_UNLIKELY (mix->in_width == 0))
 		return GST_FLOW_NOT_NEGOTIATED;
@@ -1133,41 +1977,13 @@ gst_sh_videomixer_collected (GstCollectPads * pads, GstSHVideoMixer * mix)
 		goto error;
 	}
 
-
-	/* If geometry has changed we need to set new caps on the buffer */
-	if (mix->in_width != mix->out_width || mix->in_height != mix->out_height
-			|| mix->setcaps)
-	{
-		mix->out_width = mix->in_width;
-		mix->out_height = mix->in_height;
-		mix->setcaps = FALSE;
-
-		/* Set SRC caps */
-		src_caps = gst_pad_peer_get_caps(GST_PAD(mix->srcpad));
-		gst_caps_set_simple (gst_caps_make_writable(src_caps),
-						"width", G_TYPE_INT, mix->out_width,
-						"height", G_TYPE_INT, mix->out_height,
-						"framerate", GST_TYPE_FRACTION, mix->fps_n, mix->fps_d,
-						NULL);
-		gst_pad_set_caps(mix->srcpad,src_caps);
-	}
-
-	if (!gst_caps_to_renesas_format(gst_pad_get_negotiated_caps (GST_PAD (mix->srcpad)),
-		(void *)&renfmt)) {
-		GST_LOG("Can't get ren format from src caps");
-		goto error;
-	}
-	mix->out_format = renfmt;
-
-	outbuf = gst_sh_video_buffer_new(mix->uiomux, mix->out_width, mix->out_height, renfmt);
+	outbuf = gst_sh_videomixer_new_output (mix);
 	if (!outbuf) {
-		GST_LOG("Failed to allocate SH buffer");
+		ret = (mix->out_format == REN_UNKNOWN) ?
+				GST_FLOW_NOT_NEGOTIATED : GST_FLOW_ERROR;
 		goto error;
 	}
 
-	GST_BUFFER_OFFSET(outbuf) = GST_BUFFER_OFFSET_NONE;
-	GST_BUFFER_CAPS(outbuf) = gst_pad_get_negotiated_caps (GST_PAD (mix->srcpad));
-
 	gst_sh_videomixer_blend_buffers (mix, outbuf);
 
 	gst_sh_videomixer_update_queues (mix);
@@ -1181,13 +1997,187 @@ beach:
 	/* ERRORS */
 error:
 	GST_LOG("Error");
-	if (outbuf)
-		gst_buffer_unref (outbuf);
-
 	GST_SH_VIDEO_MIXER_STATE_UNLOCK (mix);
 	goto beach;
 }
 
+/* In live mode, buffers arriving on the sink pads replace the pad's last
+   buffer rather than being queued, so a late or stalled input never holds
+   up the output */
+static GstFlowReturn
+gst_sh_videomixer_sink_chain (GstPad * pad, GstBuffer * buffer)
+{
+	GstSHVideoMixer *mix = GST_SH_VIDEO_MIXER (GST_PAD_PARENT (pad));
+	GstSHVideoMixerPad *mixpad = GST_SH_VIDEO_MIXER_PAD (pad);
+	GstSHVideoMixerCollect *mixcol = mixpad->mixcol;
+
+	if (!mix->live)
+		return mix->collect_chain (pad, buffer);
+
+	GST_LOG_OBJECT (pad, "got buffer %p", buffer);
+
+	GST_SH_VIDEO_MIXER_STATE_LOCK (mix);
+	if (mixcol->buffer)
+		gst_buffer_unref (mixcol->buffer);
+	mixcol->buffer = buffer;
+	GST_SH_VIDEO_MIXER_STATE_UNLOCK (mix);
+
+	return GST_FLOW_OK;
+}
+
+/* check if any sink pad has a buffer to blend. Call with the state lock held */
+static gboolean
+gst_sh_videomixer_have_input (GstSHVideoMixer * mix)
+{
+	GSList *walk;
+
+	for (walk = mix->sinkpads; walk; walk = g_slist_next (walk)) {
+		GstSHVideoMixerPad *pad = GST_SH_VIDEO_MIXER_PAD (walk->data);
+		if (pad->mixcol->buffer)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void gst_sh_videomixer_live_loop (GstPad * pad);
+
+/* In live mode, start the output again from running time 0 with a new
+   segment, e.g. after a flush. Wakes the output task if it is waiting */
+static void
+gst_sh_videomixer_reset_live (GstSHVideoMixer * mix)
+{
+	GST_OBJECT_LOCK (mix);
+	mix->live_time = 0;
+	mix->live_eos = FALSE;
+	mix->sendseg = TRUE;
+	if (mix->clock_id)
+		gst_clock_id_unschedule (mix->clock_id);
+	GST_OBJECT_UNLOCK (mix);
+
+	/* the task pauses itself at EOS */
+	if (GST_STATE (mix) == GST_STATE_PLAYING)
+		gst_pad_start_task (mix->srcpad,
+				(GstTaskFunction) gst_sh_videomixer_live_loop, mix->srcpad);
+}
+
+/* In live mode, this task produces one output frame per frame period on the
+   pipeline clock, from the last buffer received on each sink pad */
+static void
+gst_sh_videomixer_live_loop (GstPad * pad)
+{
+	GstSHVideoMixer *mix = GST_SH_VIDEO_MIXER (GST_PAD_PARENT (pad));
+	GstClock *clock;
+	GstClockID id;
+	GstClockReturn cret;
+	GstClockTime base_time, running_time, frame_time, duration, deadline, now;
+	GstBuffer *outbuf = NULL;
+	GstFlowReturn ret;
+
+	if (mix->live_eos) {
+		GST_LOG_OBJECT (mix, "all our sinkpads are EOS, pushing downstream");
+		gst_pad_push_event (mix->srcpad, gst_event_new_eos ());
+		gst_pad_pause_task (mix->srcpad);
+		return;
+	}
+
+	if (mix->fps_n > 0 && mix->fps_d > 0)
+		duration = gst_util_uint64_scale_int (GST_SECOND, mix->fps_d, mix->fps_n);
+	else
+		duration = gst_util_uint64_scale_int (GST_SECOND, 1, DEFAULT_LIVE_FPS);
+
+	/* Wait until the end of the frame period, plus the upstream latency so
+	   that the inputs captured within the period have arrived */
+	GST_OBJECT_LOCK (mix);
+	running_time = frame_time = mix->live_time;
+	clock = GST_ELEMENT_CLOCK (mix);
+	if (clock == NULL) {
+		GST_OBJECT_UNLOCK (mix);
+		GST_DEBUG_OBJECT (mix, "no clock, pausing");
+		gst_pad_pause_task (mix->srcpad);
+		return;
+	}
+	gst_object_ref (clock);
+	base_time = GST_ELEMENT_CAST (mix)->base_time;
+	deadline = base_time + running_time + mix->upstream_latency;
+	id = gst_clock_new_single_shot_id (clock, deadline);
+	mix->clock_id = id;
+	GST_OBJECT_UNLOCK (mix);
+
+	cret = gst_clock_id_wait (id, NULL);
+
+	GST_OBJECT_LOCK (mix);
+	mix->clock_id = NULL;
+	GST_OBJECT_UNLOCK (mix);
+	gst_clock_id_unref (id);
+
+	now = gst_clock_get_time (clock);
+	gst_object_unref (clock);
+
+	if (cret == GST_CLOCK_UNSCHEDULED) {
+		/* We are going to PAUSED, or have been flushed */
+		return;
+	}
+
+	/* Rather than falling further behind, skip the frames we have missed */
+	if (now > deadline + duration) {
+		guint64 missed = (now - deadline) / duration;
+		GST_DEBUG_OBJECT (mix, "late, skipping %" G_GUINT64_FORMAT " frames", missed);
+		running_time += missed * duration;
+	}
+
+	GST_OBJECT_LOCK (mix);
+	if (mix->live_time != frame_time) {
+		/* flushed while waiting, start again */
+		GST_OBJECT_UNLOCK (mix);
+		return;
+	}
+	mix->live_time = running_time + duration;
+	GST_OBJECT_UNLOCK (mix);
+
+	GST_SH_VIDEO_MIXER_STATE_LOCK (mix);
+
+	/* Nothing to show until the caps are set & an input has a buffer */
+	if (mix->in_width == 0 || !gst_sh_videomixer_have_input (mix)) {
+		GST_SH_VIDEO_MIXER_STATE_UNLOCK (mix);
+		return;
+	}
+
+	outbuf = gst_sh_videomixer_new_output (mix);
+	if (!outbuf) {
+		GST_SH_VIDEO_MIXER_STATE_UNLOCK (mix);
+		GST_ELEMENT_ERROR(mix, RESOURCE, NO_SPACE_LEFT,
+			("failed to allocate output buffer"), (NULL));
+		gst_pad_pause_task (mix->srcpad);
+		return;
+	}
+
+	gst_sh_videomixer_blend_buffers (mix, outbuf);
+	GST_SH_VIDEO_MIXER_STATE_UNLOCK (mix);
+
+	GST_BUFFER_TIMESTAMP (outbuf) = running_time;
+	GST_BUFFER_DURATION (outbuf) = duration;
+	mix->last_ts = running_time + duration;
+
+	if (mix->sendseg) {
+		gst_pad_push_event (mix->srcpad,
+				gst_event_new_new_segment (FALSE, 1.0, GST_FORMAT_TIME, 0, -1, 0));
+		mix->sendseg = FALSE;
+	}
+
+	ret = gst_pad_push (mix->srcpad, outbuf);
+	if (ret != GST_FLOW_OK) {
+		GST_DEBUG_OBJECT (mix, "pausing task, reason %s", gst_flow_get_name (ret));
+		gst_pad_pause_task (mix->srcpad);
+		if (GST_FLOW_IS_FATAL (ret) || ret == GST_FLOW_NOT_LINKED) {
+			GST_ELEMENT_ERROR (mix, STREAM, FAILED,
+					("Internal data flow error."),
+					("streaming task paused, reason %s (%d)", gst_flow_get_name (ret), ret));
+			gst_pad_push_event (mix->srcpad, gst_event_new_eos ());
+		}
+	}
+}
+
 static gboolean
 forward_event_func (GstPad * pad, GValue * ret, GstEvent * event)
 {
@@ -1272,6 +2262,9 @@ gst_sh_videomixer_src_event (GstPad * pad, GstEvent * event)
 			mix->sendseg = TRUE;
 			GST_OBJECT_UNLOCK (mix->collect);
 
+			if (mix->live && (flags & GST_SEEK_FLAG_FLUSH))
+				gst_sh_videomixer_reset_live (mix);
+
 			result = forward_event (mix, event);
 			break;
 		}
@@ -1307,6 +2300,9 @@ gst_sh_videomixer_sink_event (GstPad * pad, GstEvent * event)
 			 * and downstream (using our source pad, the bastard!).
 			 */
 			videomixer->sendseg = TRUE;
+			/* the running time starts again from 0 after a flush */
+			if (videomixer->live)
+				gst_sh_videomixer_reset_live (videomixer);
 			break;
 		case GST_EVENT_NEWSEGMENT:
 			videomixer->sendseg = TRUE;
@@ -1327,7 +2323,27 @@ static void
 gst_sh_videomixer_get_property (GObject * object,
 		guint prop_id, GValue * value, GParamSpec * pspec)
 {
+	GstSHVideoMixer *mix = GST_SH_VIDEO_MIXER (object);
+
 	switch (prop_id) {
+		case PROP_BLEND_PASSES:
+			g_value_set_uint (value, mix->blend_passes);
+			break;
+		case PROP_CACHE_STATIC:
+			g_value_set_boolean (value, mix->cache_static);
+			break;
+		case PROP_CACHED_LAYERS:
+			g_value_set_uint (value, mix->cached_layers);
+			break;
+		case PROP_LIVE:
+			g_value_set_boolean (value, mix->live);
+			break;
+		case PROP_BACKGROUND:
+			g_value_set_enum (value, mix->background);
+			break;
+		case PROP_BACKGROUND_COLOUR:
+			g_value_set_uint (value, mix->background_colour);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -1338,7 +2354,42 @@ static void
 gst_sh_videomixer_set_property (GObject * object,
 		guint prop_id, const GValue * value, GParamSpec * pspec)
 {
+	GstSHVideoMixer *mix = GST_SH_VIDEO_MIXER (object);
+
 	switch (prop_id) {
+		case PROP_CACHE_STATIC:
+			GST_SH_VIDEO_MIXER_STATE_LOCK (mix);
+			mix->cache_static = g_value_get_boolean (value);
+			if (!mix->cache_static)
+				mix->nr_cached = 0;
+			GST_SH_VIDEO_MIXER_STATE_UNLOCK (mix);
+			break;
+		case PROP_LIVE:
+			if (GST_STATE (mix) > GST_STATE_READY) {
+				GST_WARNING_OBJECT (mix, "live mode can only be changed in the NULL or READY state");
+				break;
+			}
+			mix->live = g_value_get_boolean (value);
+			break;
+		case PROP_BACKGROUND:
+			GST_SH_VIDEO_MIXER_STATE_LOCK (mix);
+			mix->background = g_value_get_enum (value);
+			if (mix->background_buf) {
+				gst_buffer_unref (mix->background_buf);
+				mix->background_buf = NULL;
+			}
+			gst_sh_videomixer_set_master_geometry (mix);
+			GST_SH_VIDEO_MIXER_STATE_UNLOCK (mix);
+			break;
+		case PROP_BACKGROUND_COLOUR:
+			GST_SH_VIDEO_MIXER_STATE_LOCK (mix);
+			mix->background_colour = g_value_get_uint (value);
+			if (mix->background_buf) {
+				gst_buffer_unref (mix->background_buf);
+				mix->background_buf = NULL;
+			}
+			GST_SH_VIDEO_MIXER_STATE_UNLOCK (mix);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -1356,13 +2407,50 @@ gst_sh_videomixer_change_state (GstElement * element, GstStateChange transition)
 	mix = GST_SH_VIDEO_MIXER (element);
 
 	switch (transition) {
+		case GST_STATE_CHANGE_NULL_TO_READY:
+			/* The uiomux is kept until finalize, for the intermediate
+			   buffers */
+			if (!mix->uiomux)
+				mix->uiomux = uiomux_open ();
+			if (!mix->uiomux) {
+				GST_ELEMENT_ERROR (mix, RESOURCE, OPEN_READ_WRITE,
+						("failed to open uiomux"), (NULL));
+				return GST_STATE_CHANGE_FAILURE;
+			}
+			if (!mix->beu)
+				mix->beu = shbeu_open ();
+			if (!mix->beu) {
+				GST_ELEMENT_ERROR (mix, RESOURCE, OPEN_READ_WRITE,
+						("failed to open the BEU"), (NULL));
+				return GST_STATE_CHANGE_FAILURE;
+			}
+			if (!mix->veu)
+				mix->veu = veu_service_open ();
+			if (!mix->veu) {
+				GST_ELEMENT_ERROR (mix, RESOURCE, OPEN_READ_WRITE,
+						("failed to open the VEU"), (NULL));
+				return GST_STATE_CHANGE_FAILURE;
+			}
+			break;
 		case GST_STATE_CHANGE_READY_TO_PAUSED:
 			GST_LOG_OBJECT (mix, "starting collectpads");
 			gst_collect_pads_start (mix->collect);
 			break;
+		case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+			if (mix->live) {
+				/* Wake the output task & stop it */
+				GST_OBJECT_LOCK (mix);
+				if (mix->clock_id)
+					gst_clock_id_unschedule (mix->clock_id);
+				GST_OBJECT_UNLOCK (mix);
+				gst_pad_pause_task (mix->srcpad);
+			}
+			break;
 		case GST_STATE_CHANGE_PAUSED_TO_READY:
 			GST_LOG_OBJECT (mix, "stopping collectpads");
 			gst_collect_pads_stop (mix->collect);
+			if (mix->live)
+				gst_pad_stop_task (mix->srcpad);
 			break;
 		default:
 			break;
@@ -1371,9 +2459,37 @@ gst_sh_videomixer_change_state (GstElement * element, GstStateChange transition)
 	ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
 
 	switch (transition) {
+		case GST_STATE_CHANGE_READY_TO_PAUSED:
+			if (mix->live && ret != GST_STATE_CHANGE_FAILURE) {
+				/* Like a live source, we produce no data in PAUSED */
+				mix->sendseg = TRUE;
+				ret = GST_STATE_CHANGE_NO_PREROLL;
+			}
+			break;
+		case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+			if (mix->live) {
+				GST_LOG_OBJECT (mix, "starting output task");
+				gst_pad_start_task (mix->srcpad,
+						(GstTaskFunction) gst_sh_videomixer_live_loop, mix->srcpad);
+			}
+			break;
+		case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+			if (mix->live && ret != GST_STATE_CHANGE_FAILURE)
+				ret = GST_STATE_CHANGE_NO_PREROLL;
+			break;
 		case GST_STATE_CHANGE_PAUSED_TO_READY:
 			gst_sh_videomixer_reset (mix);
 			break;
+		case GST_STATE_CHANGE_READY_TO_NULL:
+			if (mix->beu) {
+				shbeu_close (mix->beu);
+				mix->beu = NULL;
+			}
+			if (mix->veu) {
+				veu_service_close (mix->veu);
+				mix->veu = NULL;
+			}
+			break;
 		default:
 			break;
 	}
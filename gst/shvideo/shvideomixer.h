@@ -29,6 +29,7 @@
 #include <uiomux/uiomux.h>
 #include <shbeu/shbeu.h>
 #include "shvideomixerpad.h"
+#include "veusched.h"
 
 G_BEGIN_DECLS
 
@@ -44,6 +45,23 @@ G_BEGIN_DECLS
 
 typedef struct _GstSHVideoMixer GstSHVideoMixer;
 typedef struct _GstSHVideoMixerClass GstSHVideoMixerClass;
+typedef struct _GstSHVideoMixerLayer GstSHVideoMixerLayer;
+
+typedef enum {
+  BACKGROUND_NONE,
+  BACKGROUND_SOLID,
+  BACKGROUND_CHECKER
+} GstSHVideoMixerBackground;
+
+/* A layer blended in the last output frame, used to tell whether the layer
+ * has changed since. A ref is held on the buffer so that a new buffer cannot
+ * be allocated at the same address while it is compared against. */
+struct _GstSHVideoMixerLayer
+{
+  GstSHVideoMixerPad *pad;
+  GstBuffer *buffer;
+  struct shbeu_surface surface;
+};
 
 /**
  * GstSHVideoMixer:
@@ -74,6 +92,9 @@ struct _GstSHVideoMixer
   gint in_width, in_height;
   gint out_width, out_height;
   gint out_format;
+  /* downstream's buffers can't be blended into, don't ask until the caps
+     are set again */
+  gboolean out_own_buffers;
   gboolean setcaps;
   gboolean sendseg;
 
@@ -85,11 +106,45 @@ struct _GstSHVideoMixer
 
   /* sink event handling */
   GstPadEventFunction collect_event;
+  GstPadChainFunction collect_chain;
   guint64	segment_position;
   gdouble	segment_rate;
 
   UIOMux *uiomux;
   SHBEU  *beu;
+  VEU_SERVICE *veu;
+
+  /* Layers to blend, one per sink pad in zorder */
+  struct shbeu_surface *layers;
+  gint nr_layers_alloc;
+
+  /* Intermediate result when blending takes more than one BEU pass */
+  GstBuffer *scratch;
+
+  /* Layers blended in the last output frame */
+  GstSHVideoMixerLayer *last_layers;
+  gint nr_last_layers;
+
+  /* Filled layer under all the inputs */
+  GstSHVideoMixerBackground background;
+  guint32 background_colour;
+  GstBuffer *background_buf;
+
+  /* Bottom layers that have not changed, pre-blended */
+  gboolean cache_static;
+  GstBuffer *cache;
+  gint nr_cached;
+  guint cached_layers;
+
+  /* Number of BEU passes used for the last output frame */
+  guint blend_passes;
+
+  /* Live mode, output is timed by the clock rather than the inputs */
+  gboolean live;
+  gboolean live_eos;
+  GstClockTime live_time;
+  GstClockID clock_id;
+  GstClockTime upstream_latency;
 };
 
 struct _GstSHVideoMixerClass
@@ -26,6 +26,7 @@
 
 #include <gst/gst.h>
 #include <gst/base/gstcollectpads.h>
+#include <shveu/shveu.h>
 
 G_BEGIN_DECLS
 
@@ -63,11 +64,31 @@ struct _GstSHVideoMixerPad
   gint fps_n;
   gint fps_d;
 
+  /* Layout of the input frames, resolved when the caps are set */
+  ren_vid_format_t format;
+  gint pitch;
+  gint c_offset;
+  /* Offset of the 8-bit alpha plane, 0 if there is none */
+  gint a_offset;
+
   gint xpos, ypos;
   guint zorder;
   gint blend_mode;
   gdouble alpha;
 
+  /* Size to scale the input to, 0 to keep the input size */
+  gint width, height;
+
+  /* Scaled input, and the input buffer it was scaled from */
+  GstBuffer *scaled;
+  GstBuffer *scaled_from;
+  gint scaled_width, scaled_height;
+
+  /* Solid colour (ARGB) behind the picture, none if the alpha is 0 */
+  guint32 fill_colour;
+  GstBuffer *fill;
+  gint fill_width, fill_height;
+
   GstSHVideoMixerCollect *mixcol;
 };
 
@@ -0,0 +1,330 @@
+/**
+ * SH VEU scheduler
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <shveu/shveu.h>
+
+#include "veusched.h"
+
+#define MAX_VEUS 4
+#define DEFAULT_VEUS "VEU"
+
+#define OP_RESIZE 0
+#define OP_ROTATE 1
+
+struct veu_job {
+	int op;
+	struct ren_vid_surface src;
+	struct ren_vid_surface dst;
+	int priority;
+	veu_job_done_cb cb;
+	void *user_data;
+
+	/* Set for jobs that a caller is waiting on */
+	int sync;
+	int done;
+	int ret;
+
+	struct veu_job *next;
+};
+
+struct veu_unit {
+	VEU_SERVICE *service;
+	SHVEU *veu;
+	pthread_t thread;
+};
+
+struct VEU_SERVICE {
+	int refs;
+	int stop;
+
+	struct veu_unit units[MAX_VEUS];
+	int nr_units;
+
+	/* Pending jobs, sorted by priority then queue order */
+	struct veu_job *jobs;
+
+	pthread_cond_t job_cond;
+	pthread_cond_t done_cond;
+};
+
+static pthread_mutex_t veu_mutex = PTHREAD_MUTEX_INITIALIZER;
+static VEU_SERVICE *service = NULL;
+
+/* Call with veu_mutex held */
+static void queue_job(VEU_SERVICE *veu, struct veu_job *job)
+{
+	struct veu_job **j;
+
+	/* Jobs of equal priority are run in the order they were queued */
+	for (j = &veu->jobs; *j; j = &(*j)->next) {
+		if ((*j)->priority < job->priority)
+			break;
+	}
+	job->next = *j;
+	*j = job;
+
+	pthread_cond_signal(&veu->job_cond);
+}
+
+static void *veu_worker(void *data)
+{
+	struct veu_unit *unit = data;
+	VEU_SERVICE *veu = unit->service;
+	struct veu_job *job;
+	int ret;
+
+	pthread_mutex_lock(&veu_mutex);
+
+	while (1) {
+		while (!veu->jobs && !veu->stop)
+			pthread_cond_wait(&veu->job_cond, &veu_mutex);
+
+		/* Finish all queued jobs before stopping */
+		job = veu->jobs;
+		if (!job)
+			break;
+		veu->jobs = job->next;
+
+		pthread_mutex_unlock(&veu_mutex);
+		if (job->op == OP_ROTATE) {
+#ifdef HAVE_SHVEU_ROTATE
+			ret = shveu_rotate(unit->veu, &job->src, &job->dst, SHVEU_ROT_90);
+#else
+			ret = -1;
+#endif
+		} else {
+			ret = shveu_resize(unit->veu, &job->src, &job->dst);
+		}
+		pthread_mutex_lock(&veu_mutex);
+
+		if (job->sync) {
+			job->ret = ret;
+			job->done = 1;
+			pthread_cond_broadcast(&veu->done_cond);
+		} else {
+			pthread_mutex_unlock(&veu_mutex);
+			if (job->cb)
+				job->cb(job->user_data, ret);
+			free(job);
+			pthread_mutex_lock(&veu_mutex);
+		}
+	}
+
+	pthread_mutex_unlock(&veu_mutex);
+
+	return NULL;
+}
+
+static void stop_service(VEU_SERVICE *veu)
+{
+	int i;
+
+	pthread_mutex_lock(&veu_mutex);
+	veu->stop = 1;
+	pthread_cond_broadcast(&veu->job_cond);
+	pthread_mutex_unlock(&veu_mutex);
+
+	for (i = 0; i < veu->nr_units; i++) {
+		if (veu->units[i].thread)
+			pthread_join(veu->units[i].thread, NULL);
+		shveu_close(veu->units[i].veu);
+	}
+
+	pthread_cond_destroy(&veu->job_cond);
+	pthread_cond_destroy(&veu->done_cond);
+	free(veu);
+}
+
+static VEU_SERVICE *start_service(void)
+{
+	VEU_SERVICE *veu;
+	const char *names;
+	char *list, *name, *saveptr;
+	int i;
+
+	veu = calloc(1, sizeof(*veu));
+	if (!veu)
+		return NULL;
+
+	pthread_cond_init(&veu->job_cond, NULL);
+	pthread_cond_init(&veu->done_cond, NULL);
+
+	names = getenv("GST_SH_VEU");
+	if (!names || !*names)
+		names = DEFAULT_VEUS;
+
+	list = strdup(names);
+	if (!list) {
+		stop_service(veu);
+		return NULL;
+	}
+
+	for (name = strtok_r(list, ",", &saveptr);
+	     name && veu->nr_units < MAX_VEUS;
+	     name = strtok_r(NULL, ",", &saveptr)) {
+		SHVEU *handle = shveu_open_named(name);
+		if (handle)
+			veu->units[veu->nr_units++].veu = handle;
+	}
+	free(list);
+
+	if (veu->nr_units == 0) {
+		stop_service(veu);
+		return NULL;
+	}
+
+	for (i = 0; i < veu->nr_units; i++) {
+		veu->units[i].service = veu;
+		if (pthread_create(&veu->units[i].thread, NULL, veu_worker, &veu->units[i]) != 0) {
+			veu->units[i].thread = 0;
+			stop_service(veu);
+			return NULL;
+		}
+	}
+
+	return veu;
+}
+
+VEU_SERVICE *veu_service_open(void)
+{
+	VEU_SERVICE *veu;
+
+	pthread_mutex_lock(&veu_mutex);
+	if (!service) {
+		/* Handles are opened without the lock, nobody else can see them yet */
+		pthread_mutex_unlock(&veu_mutex);
+		veu = start_service();
+		pthread_mutex_lock(&veu_mutex);
+
+		if (!veu) {
+			pthread_mutex_unlock(&veu_mutex);
+			return NULL;
+		}
+
+		if (service) {
+			/* Lost the race with another thread */
+			pthread_mutex_unlock(&veu_mutex);
+			stop_service(veu);
+			pthread_mutex_lock(&veu_mutex);
+		} else {
+			service = veu;
+		}
+	}
+	veu = service;
+	veu->refs++;
+	pthread_mutex_unlock(&veu_mutex);
+
+	return veu;
+}
+
+void veu_service_close(VEU_SERVICE *veu)
+{
+	int last;
+
+	if (!veu)
+		return;
+
+	pthread_mutex_lock(&veu_mutex);
+	last = (--veu->refs == 0);
+	if (last)
+		service = NULL;
+	pthread_mutex_unlock(&veu_mutex);
+
+	if (last)
+		stop_service(veu);
+}
+
+int veu_service_resize_async(
+	VEU_SERVICE *veu,
+	const struct ren_vid_surface *src,
+	const struct ren_vid_surface *dst,
+	int priority,
+	veu_job_done_cb cb,
+	void *user_data)
+{
+	struct veu_job *job;
+
+	job = calloc(1, sizeof(*job));
+	if (!job)
+		return -1;
+
+	job->src = *src;
+	job->dst = *dst;
+	job->priority = priority;
+	job->cb = cb;
+	job->user_data = user_data;
+
+	pthread_mutex_lock(&veu_mutex);
+	queue_job(veu, job);
+	pthread_mutex_unlock(&veu_mutex);
+
+	return 0;
+}
+
+static int run_job(
+	VEU_SERVICE *veu,
+	int op,
+	const struct ren_vid_surface *src,
+	const struct ren_vid_surface *dst,
+	int priority)
+{
+	struct veu_job job;
+
+	memset(&job, 0, sizeof(job));
+	job.op = op;
+	job.src = *src;
+	job.dst = *dst;
+	job.priority = priority;
+	job.sync = 1;
+
+	pthread_mutex_lock(&veu_mutex);
+	queue_job(veu, &job);
+	while (!job.done)
+		pthread_cond_wait(&veu->done_cond, &veu_mutex);
+	pthread_mutex_unlock(&veu_mutex);
+
+	return job.ret;
+}
+
+int veu_service_resize(
+	VEU_SERVICE *veu,
+	const struct ren_vid_surface *src,
+	const struct ren_vid_surface *dst,
+	int priority)
+{
+	return run_job(veu, OP_RESIZE, src, dst, priority);
+}
+
+int veu_service_can_rotate(VEU_SERVICE *veu)
+{
+#ifdef HAVE_SHVEU_ROTATE
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+int veu_service_rotate(
+	VEU_SERVICE *veu,
+	const struct ren_vid_surface *src,
+	const struct ren_vid_surface *dst,
+	int priority)
+{
+	if (!veu_service_can_rotate(veu))
+		return -1;
+
+	/* The VEU can't scale or convert while rotating */
+	if (src->format != dst->format || src->w != dst->h || src->h != dst->w)
+		return -1;
+
+	return run_job(veu, OP_ROTATE, src, dst, priority);
+}
@@ -0,0 +1,114 @@
+/**
+ * SH VEU scheduler
+ *
+ * The VEU is shared by every element in the process that scales or
+ * converts frames. Rather than each element opening its own handle and
+ * contending for the hardware, they all queue jobs on a single service.
+ * The service opens one handle for each VEU and runs a worker thread for
+ * each handle, so on SoCs with several VEUs, jobs are spread across them.
+ * Queued jobs are started highest priority first, then in the order they
+ * were queued.
+ *
+ * The VEUs to use are read from the GST_SH_VEU environment variable, as a
+ * comma separated list of UIO names (e.g. "VEU0,VEU1"). The default is
+ * "VEU".
+ */
+
+#ifndef VEUSCHED_H
+#define VEUSCHED_H
+
+#include <shveu/shveu.h>
+
+/**
+ * An opaque handle to the VEU service.
+ */
+struct VEU_SERVICE;
+typedef struct VEU_SERVICE VEU_SERVICE;
+
+#define VEU_PRIORITY_LOW     -10
+#define VEU_PRIORITY_NORMAL    0
+#define VEU_PRIORITY_HIGH     10
+
+/**
+ * Called from a VEU worker thread when an asynchronous job has finished
+ * \param user_data User pointer passed to veu_service_resize_async
+ * \param ret Return value from the hardware operation, 0 on success
+ */
+typedef void (*veu_job_done_cb)(void *user_data, int ret);
+
+/**
+ * Get a reference to the VEU service, starting it if necessary
+ * \retval 0 Failure
+ * \retval >0 Handle
+ */
+VEU_SERVICE *veu_service_open(void);
+
+/**
+ * Release a reference to the VEU service. The service is stopped once all
+ * references have been released and all queued jobs have completed.
+ * \param veu Handle returned from veu_service_open
+ */
+void veu_service_close(VEU_SERVICE *veu);
+
+/**
+ * Queue a scale/colourspace conversion job. The surfaces are copied, but
+ * the memory they point to must remain valid until the job has completed.
+ * \param veu Handle returned from veu_service_open
+ * \param src Input surface
+ * \param dst Output surface
+ * \param priority Priority of the job
+ * \param cb Function called when the job has completed, may be NULL
+ * \param user_data User pointer passed to cb
+ * \retval 0 Success
+ * \retval -1 Failure
+ */
+int veu_service_resize_async(
+	VEU_SERVICE *veu,
+	const struct ren_vid_surface *src,
+	const struct ren_vid_surface *dst,
+	int priority,
+	veu_job_done_cb cb,
+	void *user_data);
+
+/**
+ * Queue a scale/colourspace conversion job and wait for it to complete
+ * \param veu Handle returned from veu_service_open
+ * \param src Input surface
+ * \param dst Output surface
+ * \param priority Priority of the job
+ * \retval 0 Success
+ * \retval <0 Failure
+ */
+int veu_service_resize(
+	VEU_SERVICE *veu,
+	const struct ren_vid_surface *src,
+	const struct ren_vid_surface *dst,
+	int priority);
+
+/**
+ * Check if the VEU can rotate, which depends on the version of libshveu
+ * \param veu Handle returned from veu_service_open
+ * \retval 0 The VEU can't rotate
+ * \retval 1 The VEU can rotate
+ */
+int veu_service_can_rotate(VEU_SERVICE *veu);
+
+/**
+ * Queue a job to rotate a surface 90 degrees clockwise and wait for it to
+ * complete. The VEU can't scale or convert at the same time, so both
+ * surfaces must be the same format, and the output must be the size of the
+ * rotated input.
+ * \param veu Handle returned from veu_service_open
+ * \param src Input surface
+ * \param dst Output surface
+ * \param priority Priority of the job
+ * \retval 0 Success
+ * \retval <0 Failure
+ */
+int veu_service_rotate(
+	VEU_SERVICE *veu,
+	const struct ren_vid_surface *src,
+	const struct ren_vid_surface *dst,
+	int priority);
+
+#endif
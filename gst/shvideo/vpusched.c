@@ -0,0 +1,186 @@
+/**
+ * SH VPU scheduler
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "vpusched.h"
+
+struct VPU_CLIENT {
+	char name[32];
+	int priority;
+
+	/* Scheduling state */
+	int waiting;
+	unsigned long long deadline;
+	unsigned long long last_served;
+
+	/* Statistics */
+	unsigned long long opened;
+	unsigned long long job_start;
+	unsigned long long busy;
+
+	struct VPU_CLIENT *next;
+};
+
+static pthread_mutex_t vpu_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t vpu_cond = PTHREAD_COND_INITIALIZER;
+
+static VPU_CLIENT *clients = NULL;
+static VPU_CLIENT *owner = NULL;
+static unsigned long long serve_count = 0;
+
+static unsigned long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Returns non-zero if a should be served before b */
+static int before(VPU_CLIENT *a, VPU_CLIENT *b)
+{
+	if (a->priority != b->priority)
+		return (a->priority > b->priority);
+
+	/* A job without a deadline can wait */
+	if (a->deadline != b->deadline) {
+		if (!b->deadline)
+			return 1;
+		if (!a->deadline)
+			return 0;
+		return (a->deadline < b->deadline);
+	}
+
+	/* Round robin */
+	return (a->last_served < b->last_served);
+}
+
+/* Call with vpu_mutex held */
+static VPU_CLIENT *next_client(void)
+{
+	VPU_CLIENT *c;
+	VPU_CLIENT *best = NULL;
+
+	for (c = clients; c; c = c->next) {
+		if (c->waiting && (!best || before(c, best)))
+			best = c;
+	}
+
+	return best;
+}
+
+VPU_CLIENT *vpu_client_open(const char *name, int priority)
+{
+	VPU_CLIENT *client;
+
+	client = calloc(1, sizeof(*client));
+	if (!client)
+		return NULL;
+
+	if (name)
+		strncpy(client->name, name, sizeof(client->name) - 1);
+	client->priority = priority;
+	client->opened = now_us();
+
+	pthread_mutex_lock(&vpu_mutex);
+	client->next = clients;
+	clients = client;
+	pthread_mutex_unlock(&vpu_mutex);
+
+	return client;
+}
+
+void vpu_client_close(VPU_CLIENT *client)
+{
+	VPU_CLIENT **c;
+
+	if (!client)
+		return;
+
+	vpu_release(client);
+
+	pthread_mutex_lock(&vpu_mutex);
+	for (c = &clients; *c; c = &(*c)->next) {
+		if (*c == client) {
+			*c = client->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&vpu_mutex);
+
+	free(client);
+}
+
+void vpu_client_set_priority(VPU_CLIENT *client, int priority)
+{
+	pthread_mutex_lock(&vpu_mutex);
+	client->priority = priority;
+	pthread_cond_broadcast(&vpu_cond);
+	pthread_mutex_unlock(&vpu_mutex);
+}
+
+double vpu_client_get_utilisation(VPU_CLIENT *client)
+{
+	unsigned long long now;
+	unsigned long long busy;
+
+	pthread_mutex_lock(&vpu_mutex);
+	now = now_us();
+	busy = client->busy;
+	if (owner == client)
+		busy += now - client->job_start;
+	pthread_mutex_unlock(&vpu_mutex);
+
+	if (now <= client->opened)
+		return 0.0;
+
+	return (double)busy / (now - client->opened);
+}
+
+void vpu_acquire(VPU_CLIENT *client, unsigned long budget_us)
+{
+	if (!client)
+		return;
+
+	pthread_mutex_lock(&vpu_mutex);
+
+	if (owner == client) {
+		pthread_mutex_unlock(&vpu_mutex);
+		return;
+	}
+
+	client->waiting = 1;
+	client->deadline = budget_us ? now_us() + budget_us : 0;
+
+	while (owner || next_client() != client)
+		pthread_cond_wait(&vpu_cond, &vpu_mutex);
+
+	client->waiting = 0;
+	client->job_start = now_us();
+	owner = client;
+
+	pthread_mutex_unlock(&vpu_mutex);
+}
+
+void vpu_release(VPU_CLIENT *client)
+{
+	if (!client)
+		return;
+
+	pthread_mutex_lock(&vpu_mutex);
+
+	if (owner == client) {
+		client->busy += now_us() - client->job_start;
+		client->last_served = ++serve_count;
+		owner = NULL;
+		pthread_cond_broadcast(&vpu_cond);
+	}
+
+	pthread_mutex_unlock(&vpu_mutex);
+}
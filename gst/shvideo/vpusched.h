@@ -0,0 +1,68 @@
+/**
+ * SH VPU scheduler
+ *
+ * The VPU is shared by every encoder and decoder in the process. Each
+ * element instance registers as a client and brackets its per-frame work
+ * with vpu_acquire() & vpu_release(). When several clients are waiting,
+ * the VPU goes to the client with the highest priority, then the earliest
+ * deadline, then the client that was served least recently.
+ */
+
+#ifndef VPUSCHED_H
+#define VPUSCHED_H
+
+/**
+ * An opaque handle to a VPU client.
+ */
+struct VPU_CLIENT;
+typedef struct VPU_CLIENT VPU_CLIENT;
+
+#define VPU_PRIORITY_LOW     -10
+#define VPU_PRIORITY_NORMAL    0
+#define VPU_PRIORITY_HIGH     10
+
+/**
+ * Register a VPU client
+ * \param name Name of the client, used for debug
+ * \param priority Priority of the client's jobs
+ * \retval 0 Failure
+ * \retval >0 Handle
+ */
+VPU_CLIENT *vpu_client_open(const char *name, int priority);
+
+/**
+ * Unregister a VPU client
+ * \param client Handle returned from vpu_client_open
+ */
+void vpu_client_close(VPU_CLIENT *client);
+
+/**
+ * Change the priority of the client's jobs
+ * \param client Handle returned from vpu_client_open
+ * \param priority New priority
+ */
+void vpu_client_set_priority(VPU_CLIENT *client, int priority);
+
+/**
+ * Get the fraction of time the client has held the VPU since it was opened
+ * \param client Handle returned from vpu_client_open
+ * \return Utilisation (0.0 - 1.0)
+ */
+double vpu_client_get_utilisation(VPU_CLIENT *client);
+
+/**
+ * Wait until the client is given the VPU
+ * \param client Handle returned from vpu_client_open
+ * \param budget_us Time (us) from now by which the job should be complete,
+ *                  or 0 for no deadline
+ */
+void vpu_acquire(VPU_CLIENT *client, unsigned long budget_us);
+
+/**
+ * Give the VPU to the next client. Does nothing if the client does not
+ * hold the VPU.
+ * \param client Handle returned from vpu_client_open
+ */
+void vpu_release(VPU_CLIENT *client);
+
+#endif